@@ -0,0 +1,500 @@
+// Benchmarks of the search server on generated corpora with Zipf distributed words.
+// Every benchmark prints one JSON object per line to stdout:
+// {"benchmark": name, "documents": N, "operations": N, "seconds": S, "ops_per_second": X, "p50_us": X, "p99_us": X}
+// Latencies are per operation; a benchmark timing a whole batch reports the batch as one sample.
+//
+// Usage: search_server_benchmark [--documents N] [--queries N] [--seed N] [--filter SUBSTRING]
+
+#include "search_server.h"
+#include "data_generators.h"
+#include "paginator.h"
+#include "process_queries.h"
+#include "sharded_search_server.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <execution>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+struct BenchmarkOptions {
+    int document_count = 20'000;
+    int query_count = 5'000;
+    unsigned seed = 42;
+    string filter;   // runs only the benchmarks with the substring in the name
+};
+
+struct Corpus {
+    vector<string> dictionary;
+    vector<string> documents;
+    vector<string> short_queries;   // 1-3 words
+    vector<string> long_queries;    // 10-20 words
+    vector<string> minus_queries;   // 3-6 words, a third of them with '-'
+    vector<NewDocument> batch;      // documents for the bulk load
+};
+
+const string STOP_WORDS = "and in on the with"s;
+constexpr double ZIPF_EXPONENT = 1.0;
+constexpr int DICTIONARY_SIZE = 50'000;
+
+Corpus GenerateCorpus(const BenchmarkOptions& options) {
+    mt19937 generator(options.seed);
+    Corpus corpus;
+    corpus.dictionary = GenerateDictionary(generator, DICTIONARY_SIZE, 10);
+    // The most frequent ranks go to the stop words, as in natural texts
+    const vector<string> stop_words = SplitIntoWords(STOP_WORDS);
+    corpus.dictionary.insert(corpus.dictionary.begin(), stop_words.begin(), stop_words.end());
+    const ZipfDistribution zipf(corpus.dictionary.size(), ZIPF_EXPONENT);
+
+    corpus.documents = GenerateZipfTexts(generator, corpus.dictionary, zipf, options.document_count, 20, 200);
+    corpus.short_queries = GenerateZipfTexts(generator, corpus.dictionary, zipf, options.query_count, 1, 3);
+    corpus.long_queries = GenerateZipfTexts(generator, corpus.dictionary, zipf, options.query_count, 10, 20);
+    corpus.minus_queries = GenerateZipfTexts(generator, corpus.dictionary, zipf, options.query_count, 3, 6, 1.0 / 3);
+    for (size_t i = 0; i < corpus.documents.size(); ++i) {
+        corpus.batch.push_back({ static_cast<int>(i), corpus.documents[i], DocumentStatus::ACTUAL,
+                                 { static_cast<int>(i % 10), 5 } });
+    }
+    return corpus;
+}
+
+class Benchmark {
+public:
+    Benchmark(string name, const BenchmarkOptions& options)
+        : name_(move(name)),
+        document_count_(options.document_count)
+    {
+    }
+
+    // Times one call of operation as one sample of `operations` operations
+    template <typename Operation>
+    void Sample(Operation operation, size_t operations = 1) {
+        const auto start = chrono::steady_clock::now();
+        operation();
+        const chrono::duration<double> seconds = chrono::steady_clock::now() - start;
+        samples_.push_back(seconds.count());
+        operation_count_ += operations;
+        total_seconds_ += seconds.count();
+    }
+
+    void Report() {
+        sort(samples_.begin(), samples_.end());
+        const double seconds = max(total_seconds_, 1e-9);
+        printf("{\"benchmark\": \"%s\", \"documents\": %d, \"operations\": %zu, \"seconds\": %.6f, "
+               "\"ops_per_second\": %.1f, \"p50_us\": %.3f, \"p99_us\": %.3f}\n",
+               name_.c_str(), document_count_, operation_count_, total_seconds_,
+               operation_count_ / seconds, GetPercentile(0.5) * 1e6, GetPercentile(0.99) * 1e6);
+        fflush(stdout);
+    }
+
+private:
+    string name_;
+    int document_count_;
+    vector<double> samples_;   // seconds
+    size_t operation_count_ = 0;
+    double total_seconds_ = 0;
+
+    // Nearest rank percentile of the sorted samples
+    double GetPercentile(double fraction) const {
+        if (samples_.empty()) {
+            return 0.0;
+        }
+        const auto rank = static_cast<size_t>(fraction * samples_.size() + 0.5);
+        return samples_[min(samples_.size() - 1, rank > 0 ? rank - 1 : 0)];
+    }
+};
+
+SearchServer BuildServer(const Corpus& corpus) {
+    SearchServer search_server(STOP_WORDS);
+    search_server.AddDocuments(execution::par, corpus.batch);
+    return search_server;
+}
+
+void BenchmarkIngest(const Corpus& corpus, const BenchmarkOptions& options) {
+    {
+        Benchmark benchmark("ingest_add_document"s, options);
+        SearchServer search_server(STOP_WORDS);
+        for (const NewDocument& document : corpus.batch) {
+            benchmark.Sample([&] {
+                search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+            });
+        }
+        benchmark.Report();
+    }
+    {
+        Benchmark benchmark("ingest_bulk_par"s, options);
+        SearchServer search_server(STOP_WORDS);
+        benchmark.Sample([&] { search_server.AddDocuments(execution::par, corpus.batch); }, corpus.batch.size());
+        benchmark.Report();
+    }
+}
+
+// Bulk loads the corpus in batches of several sizes on pools of 1, 2, 4... workers.
+// The calling thread takes part too, a pool has at least one worker
+void BenchmarkIngestScaling(const Corpus& corpus, const BenchmarkOptions& options) {
+    const size_t max_worker_count = max<size_t>(4, thread::hardware_concurrency());
+    for (size_t worker_count = 1; worker_count <= max_worker_count; worker_count *= 2) {
+        const auto thread_pool = make_shared<ThreadPool>(worker_count);
+        for (const size_t batch_size : { size_t{ 256 }, size_t{ 4096 }, corpus.batch.size() }) {
+            Benchmark benchmark("ingest_scaling_workers_"s + to_string(worker_count) + "_batch_"s + to_string(batch_size), options);
+            SearchServer search_server(STOP_WORDS);
+            search_server.SetThreadPool(thread_pool);
+            for (size_t begin = 0; begin < corpus.batch.size(); begin += batch_size) {
+                const vector<NewDocument> batch(corpus.batch.begin() + begin,
+                                                corpus.batch.begin() + min(corpus.batch.size(), begin + batch_size));
+                benchmark.Sample([&] { search_server.AddDocuments(execution::par, batch); }, batch.size());
+            }
+            benchmark.Report();
+        }
+    }
+}
+
+void BenchmarkQueries(const string& name, const SearchServer& search_server, const vector<string>& queries,
+                      const BenchmarkOptions& options) {
+    Benchmark benchmark(name, options);
+    size_t result_count = 0;   // keeps the results used
+    for (const string& query : queries) {
+        benchmark.Sample([&] { result_count += search_server.FindTopDocuments(query).size(); });
+    }
+    benchmark.Report();
+    if (result_count == 0) {
+        cerr << name << ": no results"s << endl;
+    }
+}
+
+// The same selection of about half the documents by rating, with a predicate called for every document
+// and with a structured filter evaluated over the status bitmaps and the rating column
+void BenchmarkFilters(const SearchServer& search_server, const Corpus& corpus, const BenchmarkOptions& options) {
+    constexpr int MIN_RATING = 5;
+    size_t result_count = 0;
+    {
+        Benchmark benchmark("filter_predicate"s, options);
+        const auto predicate = [](int, DocumentStatus status, int rating) {
+            return status == DocumentStatus::ACTUAL && rating >= MIN_RATING;
+        };
+        for (const string& query : corpus.short_queries) {
+            benchmark.Sample([&] { result_count += search_server.FindTopDocuments(execution::seq, query, predicate).size(); });
+        }
+        benchmark.Report();
+    }
+    {
+        Benchmark benchmark("filter_bitmap"s, options);
+        const DocumentFilter filter{ DocumentStatus::ACTUAL, MIN_RATING };
+        for (const string& query : corpus.short_queries) {
+            benchmark.Sample([&] { result_count += search_server.FindTopDocuments(execution::seq, query, filter).size(); });
+        }
+        benchmark.Report();
+    }
+    if (result_count == 0) {
+        cerr << "filter: no results"s << endl;
+    }
+}
+
+// The first pages of the results, each sliced from a top of the page end and found with a search-after cursor
+void BenchmarkPages(const SearchServer& search_server, const Corpus& corpus, const BenchmarkOptions& options) {
+    constexpr size_t PAGE_SIZE = 10;
+    constexpr size_t PAGE_COUNT = 20;
+    const DocumentFilter filter{ DocumentStatus::ACTUAL };
+    size_t result_count = 0;
+    {
+        Benchmark benchmark("pages_by_offset"s, options);
+        for (const string& query : corpus.short_queries) {
+            benchmark.Sample([&] {
+                for (size_t page = 0; page < PAGE_COUNT; ++page) {
+                    const auto top = search_server.FindTopDocuments(execution::seq, query, filter, (page + 1) * PAGE_SIZE);
+                    if (top.size() <= page * PAGE_SIZE) {
+                        break;
+                    }
+                    result_count += top.size() - page * PAGE_SIZE;
+                }
+            });
+        }
+        benchmark.Report();
+    }
+    {
+        Benchmark benchmark("pages_by_cursor"s, options);
+        for (const string& query : corpus.short_queries) {
+            benchmark.Sample([&] {
+                size_t page_number = 0;
+                for (const vector<Document>& page : PaginateSearch(search_server, query, filter, PAGE_SIZE)) {
+                    result_count += page.size();
+                    if (++page_number == PAGE_COUNT) {
+                        break;
+                    }
+                }
+            });
+        }
+        benchmark.Report();
+    }
+    if (result_count == 0) {
+        cerr << "pages: no results"s << endl;
+    }
+}
+
+// Two-letter prefixes of dictionary words: their expansion alone, and queries of a word and a prefix
+void BenchmarkWildcards(const SearchServer& search_server, const Corpus& corpus, const BenchmarkOptions& options) {
+    mt19937 generator(options.seed);
+    vector<string> patterns;
+    for (int i = 0; i < options.query_count; ++i) {
+        const string& word = corpus.dictionary[uniform_int_distribution<size_t>(0, corpus.dictionary.size() - 1)(generator)];
+        patterns.push_back(word.substr(0, 2) + "*"s);
+    }
+    size_t result_count = 0;
+    {
+        Benchmark benchmark("wildcard_expansion"s, options);
+        for (const string& pattern : patterns) {
+            benchmark.Sample([&] { result_count += search_server.FindMatchingWords(pattern).size(); });
+        }
+        benchmark.Report();
+    }
+    {
+        Benchmark benchmark("query_wildcard"s, options);
+        for (size_t i = 0; i < patterns.size(); ++i) {
+            const string query = corpus.short_queries[i % corpus.short_queries.size()] + " "s + patterns[i];
+            benchmark.Sample([&] { result_count += search_server.FindTopDocuments(query).size(); });
+        }
+        benchmark.Report();
+    }
+    if (result_count == 0) {
+        cerr << "wildcard: no results"s << endl;
+    }
+}
+
+// Long queries scored by all cores on one index, and scattered over shards each scoring its documents sequentially
+void BenchmarkShards(const SearchServer& search_server, const Corpus& corpus, const BenchmarkOptions& options) {
+    constexpr size_t SHARD_COUNT = 8;
+    ShardedSearchServer sharded_search_server(STOP_WORDS, SHARD_COUNT);
+    for (const NewDocument& document : corpus.batch) {
+        sharded_search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+    }
+    size_t result_count = 0;
+    {
+        Benchmark benchmark("query_one_index_par"s, options);
+        for (const string& query : corpus.long_queries) {
+            benchmark.Sample([&] { result_count += search_server.FindTopDocuments(execution::par, query).size(); });
+        }
+        benchmark.Report();
+    }
+    {
+        Benchmark benchmark("query_8_shards"s, options);
+        for (const string& query : corpus.long_queries) {
+            benchmark.Sample([&] { result_count += sharded_search_server.FindTopDocuments(query).size(); });
+        }
+        benchmark.Report();
+    }
+    if (result_count == 0) {
+        cerr << "shards: no results"s << endl;
+    }
+}
+
+void BenchmarkMatchDocument(const SearchServer& search_server, const Corpus& corpus, const BenchmarkOptions& options) {
+    Benchmark benchmark("match_document"s, options);
+    mt19937 generator(options.seed);
+    size_t matched_count = 0;
+    for (const string& query : corpus.minus_queries) {
+        const int document_id = uniform_int_distribution(0, options.document_count - 1)(generator);
+        benchmark.Sample([&] { matched_count += get<0>(search_server.MatchDocument(query, document_id)).size(); });
+    }
+    benchmark.Report();
+}
+
+void BenchmarkProcessQueries(const SearchServer& search_server, const Corpus& corpus, const BenchmarkOptions& options) {
+    constexpr size_t BATCH_SIZE = 1'000;
+    Benchmark benchmark("process_queries"s, options);
+    vector<string> queries = corpus.short_queries;
+    queries.insert(queries.end(), corpus.minus_queries.begin(), corpus.minus_queries.end());
+    for (size_t begin = 0; begin < queries.size(); begin += BATCH_SIZE) {
+        const vector<string> batch(queries.begin() + begin, queries.begin() + min(queries.size(), begin + BATCH_SIZE));
+        benchmark.Sample([&] { ProcessQueries(search_server, batch); }, batch.size());
+    }
+    benchmark.Report();
+}
+
+// Popular queries repeat within a batch, as in real traffic: every query one by one on the thread pool,
+// the batch sharing the work of the same words, and the batch streamed
+void BenchmarkRepeatedQueries(const SearchServer& search_server, const Corpus& corpus, const BenchmarkOptions& options) {
+    mt19937 generator(options.seed);
+    const ZipfDistribution zipf(corpus.short_queries.size(), ZIPF_EXPONENT);
+    vector<string> queries;
+    queries.reserve(corpus.short_queries.size());
+    for (size_t i = 0; i < corpus.short_queries.size(); ++i) {
+        queries.push_back(corpus.short_queries[zipf(generator)]);
+    }
+    size_t result_count = 0;
+    {
+        Benchmark benchmark("repeated_queries_one_by_one"s, options);
+        vector<vector<Document>> results(queries.size());
+        benchmark.Sample([&] {
+            search_server.GetThreadPool().ParallelFor(queries.size(), [&](size_t i) {
+                results[i] = search_server.FindTopDocuments(queries[i]);
+            });
+        }, queries.size());
+        benchmark.Report();
+    }
+    {
+        Benchmark benchmark("repeated_queries_batch"s, options);
+        benchmark.Sample([&] { result_count += ProcessQueries(search_server, queries).size(); }, queries.size());
+        benchmark.Report();
+    }
+    {
+        Benchmark benchmark("repeated_queries_streamed"s, options);
+        benchmark.Sample([&] {
+            ProcessQueriesStreamed(search_server, queries, [&result_count](Document&&) { ++result_count; });
+        }, queries.size());
+        benchmark.Report();
+    }
+    if (result_count == 0) {
+        cerr << "repeated_queries: no results"s << endl;
+    }
+}
+
+// Saves the index and opens the file again, an open includes the first query of the opened index
+void BenchmarkIndexFile(const SearchServer& search_server, const Corpus& corpus, const BenchmarkOptions& options) {
+    constexpr int REPEAT_COUNT = 10;
+    const string path = "benchmark_index.bin"s;
+    {
+        Benchmark benchmark("index_file_save"s, options);
+        for (int i = 0; i < REPEAT_COUNT; ++i) {
+            benchmark.Sample([&] { search_server.Save(path); });
+        }
+        benchmark.Report();
+    }
+    {
+        Benchmark benchmark("index_file_open"s, options);
+        size_t result_count = 0;
+        for (int i = 0; i < REPEAT_COUNT; ++i) {
+            benchmark.Sample([&] {
+                const SearchServer opened = SearchServer::Open(path);
+                result_count += opened.FindTopDocuments(corpus.short_queries[i % corpus.short_queries.size()]).size();
+            });
+        }
+        benchmark.Report();
+    }
+    remove(path.c_str());
+}
+
+// Removes a tenth of the documents one by one, the samples include the automatic compactions
+void BenchmarkRemoveDocument(const Corpus& corpus, const BenchmarkOptions& options) {
+    SearchServer search_server = BuildServer(corpus);
+    vector<int> document_ids(search_server.begin(), search_server.end());
+    shuffle(document_ids.begin(), document_ids.end(), mt19937(options.seed));
+    document_ids.resize(document_ids.size() / 10);
+    Benchmark benchmark("remove_document"s, options);
+    for (const int document_id : document_ids) {
+        benchmark.Sample([&] { search_server.RemoveDocument(document_id); });
+    }
+    benchmark.Report();
+}
+
+// A tenth of the documents is added once more under new ids
+void BenchmarkRemoveDuplicates(const Corpus& corpus, const BenchmarkOptions& options) {
+    SearchServer search_server = BuildServer(corpus);
+    for (size_t i = 0; i < corpus.documents.size(); i += 10) {
+        search_server.AddDocument(corpus.documents.size() + i, corpus.documents[i], DocumentStatus::ACTUAL, { 1 });
+    }
+    Benchmark benchmark("remove_duplicates"s, options);
+    size_t removed_count = 0;
+    benchmark.Sample([&] { removed_count = RemoveDuplicates(search_server).size(); }, search_server.GetDocumentCount());
+    benchmark.Report();
+    if (removed_count * 10 < corpus.documents.size()) {
+        cerr << "remove_duplicates: "s << removed_count << " duplicates found"s << endl;
+    }
+}
+
+bool ParseOptions(int argc, char* argv[], BenchmarkOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        const string_view argument = argv[i];
+        if (i + 1 == argc) {
+            return false;
+        }
+        const string value = argv[++i];
+        try {
+            if (argument == "--documents"sv) {
+                options.document_count = stoi(value);
+            }
+            else if (argument == "--queries"sv) {
+                options.query_count = stoi(value);
+            }
+            else if (argument == "--seed"sv) {
+                options.seed = static_cast<unsigned>(stoul(value));
+            }
+            else if (argument == "--filter"sv) {
+                options.filter = value;
+            }
+            else {
+                return false;
+            }
+        }
+        catch (const logic_error&) {   // invalid_argument or out_of_range of the number
+            return false;
+        }
+    }
+    return options.document_count > 0 && options.query_count > 0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    BenchmarkOptions options;
+    if (!ParseOptions(argc, argv, options)) {
+        cerr << "Usage: "s << argv[0] << " [--documents N] [--queries N] [--seed N] [--filter SUBSTRING]"s << endl;
+        return 1;
+    }
+    const auto is_selected = [&options](string_view name) {
+        return name.find(options.filter) != string_view::npos;
+    };
+
+    const Corpus corpus = GenerateCorpus(options);
+    if (is_selected("ingest"sv)) {
+        BenchmarkIngest(corpus, options);
+    }
+    if (is_selected("ingest_scaling"sv)) {
+        BenchmarkIngestScaling(corpus, options);
+    }
+    const SearchServer search_server = BuildServer(corpus);
+    if (is_selected("query_short"sv)) {
+        BenchmarkQueries("query_short"s, search_server, corpus.short_queries, options);
+    }
+    if (is_selected("query_long"sv)) {
+        BenchmarkQueries("query_long"s, search_server, corpus.long_queries, options);
+    }
+    if (is_selected("query_minus"sv)) {
+        BenchmarkQueries("query_minus"s, search_server, corpus.minus_queries, options);
+    }
+    if (is_selected("filter_predicate"sv) || is_selected("filter_bitmap"sv)) {
+        BenchmarkFilters(search_server, corpus, options);
+    }
+    if (is_selected("pages_by_offset"sv) || is_selected("pages_by_cursor"sv)) {
+        BenchmarkPages(search_server, corpus, options);
+    }
+    if (is_selected("wildcard_expansion"sv) || is_selected("query_wildcard"sv)) {
+        BenchmarkWildcards(search_server, corpus, options);
+    }
+    if (is_selected("query_one_index_par"sv) || is_selected("query_8_shards"sv)) {
+        BenchmarkShards(search_server, corpus, options);
+    }
+    if (is_selected("match_document"sv)) {
+        BenchmarkMatchDocument(search_server, corpus, options);
+    }
+    if (is_selected("process_queries"sv)) {
+        BenchmarkProcessQueries(search_server, corpus, options);
+    }
+    if (is_selected("repeated_queries"sv)) {
+        BenchmarkRepeatedQueries(search_server, corpus, options);
+    }
+    if (is_selected("index_file"sv)) {
+        BenchmarkIndexFile(search_server, corpus, options);
+    }
+    if (is_selected("remove_document"sv)) {
+        BenchmarkRemoveDocument(corpus, options);
+    }
+    if (is_selected("remove_duplicates"sv)) {
+        BenchmarkRemoveDuplicates(corpus, options);
+    }
+}
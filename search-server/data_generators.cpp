@@ -0,0 +1,94 @@
+#include "data_generators.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+string GenerateWord(mt19937& generator, int max_length) {
+    const int length = uniform_int_distribution(1, max_length)(generator);
+    string word;
+    word.reserve(length);
+    for (int i = 0; i < length; ++i) {
+        word.push_back(uniform_int_distribution('a', 'z')(generator));
+    }
+    return word;
+}
+
+vector<string> GenerateDictionary(mt19937& generator, int word_count, int max_length) {
+    vector<string> words;
+    words.reserve(word_count);
+    for (int i = 0; i < word_count; ++i) {
+        words.push_back(GenerateWord(generator, max_length));
+    }
+    words.erase(unique(words.begin(), words.end()), words.end());
+    return words;
+}
+
+string GenerateQuery(mt19937& generator, const vector<string>& dictionary, int word_count, double minus_prob) {
+    string query;
+    for (int i = 0; i < word_count; ++i) {
+        if (!query.empty()) {
+            query.push_back(' ');
+        }
+        if (uniform_real_distribution<>(0, 1)(generator) < minus_prob) {
+            query.push_back('-');
+        }
+        query += dictionary[uniform_int_distribution<int>(0, dictionary.size() - 1)(generator)];
+    }
+    return query;
+}
+
+vector<string> GenerateQueries(mt19937& generator, const vector<string>& dictionary, int query_count, int max_word_count) {
+    vector<string> queries;
+    queries.reserve(query_count);
+    for (int i = 0; i < query_count; ++i) {
+        queries.push_back(GenerateQuery(generator, dictionary, max_word_count));
+    }
+    return queries;
+}
+
+ZipfDistribution::ZipfDistribution(size_t count, double exponent)
+    : cumulative_(count)
+{
+    double sum = 0;
+    for (size_t rank = 0; rank < count; ++rank) {
+        sum += 1.0 / pow(rank + 1.0, exponent);
+        cumulative_[rank] = sum;
+    }
+    for (double& value : cumulative_) {
+        value /= sum;
+    }
+}
+
+size_t ZipfDistribution::operator()(mt19937& generator) const {
+    const double value = uniform_real_distribution<>(0, 1)(generator);
+    const auto it = lower_bound(cumulative_.begin(), cumulative_.end(), value);
+    return min<size_t>(it - cumulative_.begin(), cumulative_.size() - 1);
+}
+
+string GenerateZipfText(mt19937& generator, const vector<string>& dictionary, const ZipfDistribution& zipf,
+                        int word_count, double minus_prob) {
+    string text;
+    for (int i = 0; i < word_count; ++i) {
+        if (!text.empty()) {
+            text.push_back(' ');
+        }
+        if (minus_prob > 0 && uniform_real_distribution<>(0, 1)(generator) < minus_prob) {
+            text.push_back('-');
+        }
+        text += dictionary[zipf(generator)];
+    }
+    return text;
+}
+
+vector<string> GenerateZipfTexts(mt19937& generator, const vector<string>& dictionary, const ZipfDistribution& zipf,
+                                 int text_count, int min_word_count, int max_word_count, double minus_prob) {
+    vector<string> texts;
+    texts.reserve(text_count);
+    for (int i = 0; i < text_count; ++i) {
+        const int word_count = uniform_int_distribution(min_word_count, max_word_count)(generator);
+        texts.push_back(GenerateZipfText(generator, dictionary, zipf, word_count, minus_prob));
+    }
+    return texts;
+}
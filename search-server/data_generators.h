@@ -0,0 +1,39 @@
+#pragma once
+
+#include <random>
+#include <string>
+#include <vector>
+
+// Random words, texts and queries for the demo and the benchmarks
+
+std::string GenerateWord(std::mt19937& generator, int max_length);
+
+std::vector<std::string> GenerateDictionary(std::mt19937& generator, int word_count, int max_length);
+
+// Words are uniformly distributed over the dictionary; a word gets '-' with minus_prob
+std::string GenerateQuery(std::mt19937& generator, const std::vector<std::string>& dictionary, int word_count,
+                          double minus_prob = 0);
+
+std::vector<std::string> GenerateQueries(std::mt19937& generator, const std::vector<std::string>& dictionary,
+                                         int query_count, int max_word_count);
+
+// Draws ranks in [0, count) with P(rank) proportional to 1 / (rank + 1)^exponent,
+// the way word frequencies of natural texts fall off
+class ZipfDistribution {
+public:
+    ZipfDistribution(size_t count, double exponent);
+
+    size_t operator()(std::mt19937& generator) const;
+
+private:
+    std::vector<double> cumulative_;   // normalized to end at 1
+};
+
+// Like GenerateQuery with the word of rank i drawn by zipf
+std::string GenerateZipfText(std::mt19937& generator, const std::vector<std::string>& dictionary,
+                             const ZipfDistribution& zipf, int word_count, double minus_prob = 0);
+
+// Texts with word counts uniform in [min_word_count, max_word_count]
+std::vector<std::string> GenerateZipfTexts(std::mt19937& generator, const std::vector<std::string>& dictionary,
+                                           const ZipfDistribution& zipf, int text_count,
+                                           int min_word_count, int max_word_count, double minus_prob = 0);
@@ -1,5 +1,7 @@
 #pragma once
 #include <iostream>
+#include <limits>
+#include <optional>
 
 using namespace std::string_literals; // enables s-suffix for std::string literals
 
@@ -23,3 +25,33 @@ enum class DocumentStatus {
     REMOVED,
 };
 
+// Structured filter of FindTopDocuments. Unlike a predicate it is not called for every document:
+// the server evaluates it in bulk over its status bitmaps and rating column
+struct DocumentFilter {
+    std::optional<DocumentStatus> status;   // any status if not set
+    int min_rating = std::numeric_limits<int>::min();
+    int max_rating = std::numeric_limits<int>::max();
+
+    bool HasRatingBounds() const {
+        return min_rating != std::numeric_limits<int>::min() || max_rating != std::numeric_limits<int>::max();
+    }
+};
+
+// Position in the results of a query for search-after pagination: the next page starts with the document
+// ordered right after the last document of the previous one. A default cursor is the start of the results
+class SearchCursor {
+public:
+    SearchCursor() = default;
+
+    explicit SearchCursor(const Document& last_document)
+        : last_document_(last_document)
+    {
+    }
+
+    bool IsStart() const { return !last_document_.has_value(); }
+
+private:
+    friend class SearchServer;
+
+    std::optional<Document> last_document_;   // (relevance, rating, id) is the position
+};
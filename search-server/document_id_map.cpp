@@ -0,0 +1,60 @@
+#include "document_id_map.h"
+
+#include <algorithm>
+#include <limits>
+
+bool DocumentIdMap::Insert(int document_id, DocumentOrdinal ordinal) {
+    if (Contains(document_id)) {
+        return false;
+    }
+    const auto index = static_cast<size_t>(document_id);
+    const size_t dense_limit = std::max(MIN_DENSE_SIZE, 2 * (size_ + 1));
+    if (index >= dense_ordinals_.size() && index < dense_limit) {
+        Grow(std::min(std::max(index + 1, 2 * dense_ordinals_.size()), dense_limit));
+    }
+    if (index < dense_ordinals_.size()) {
+        dense_ordinals_[index] = ordinal;
+    }
+    else {
+        sparse_ordinals_.emplace(document_id, ordinal);
+    }
+    ++size_;
+    return true;
+}
+
+DocumentOrdinal DocumentIdMap::Erase(int document_id) {
+    const auto index = static_cast<size_t>(document_id);
+    DocumentOrdinal ordinal = NO_ORDINAL;
+    if (index < dense_ordinals_.size()) {
+        ordinal = dense_ordinals_[index];
+        dense_ordinals_[index] = NO_ORDINAL;
+    }
+    else {
+        const auto it = sparse_ordinals_.find(document_id);
+        if (it != sparse_ordinals_.end()) {
+            ordinal = it->second;
+            sparse_ordinals_.erase(it);
+        }
+    }
+    if (ordinal != NO_ORDINAL) {
+        --size_;
+    }
+    return ordinal;
+}
+
+size_t DocumentIdMap::GetMemoryUsage() const {
+    // A tree node holds the value, the color and three links
+    const size_t map_node_overhead = 4 * sizeof(void*);
+    return dense_ordinals_.capacity() * sizeof(DocumentOrdinal)
+           + sparse_ordinals_.size() * (sizeof(std::pair<const int, DocumentOrdinal>) + map_node_overhead);
+}
+
+void DocumentIdMap::Grow(size_t size) {
+    size = std::min<size_t>(size, std::numeric_limits<int>::max());
+    dense_ordinals_.resize(size, NO_ORDINAL);
+    const auto covered_end = sparse_ordinals_.lower_bound(static_cast<int>(size));
+    for (auto it = sparse_ordinals_.begin(); it != covered_end; ++it) {
+        dense_ordinals_[it->first] = it->second;
+    }
+    sparse_ordinals_.erase(sparse_ordinals_.begin(), covered_end);
+}
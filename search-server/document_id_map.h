@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <vector>
+#include "posting_list.h"
+
+// Translates external document ids to the dense ordinals the index works with. Ids below a bound
+// proportional to the number of documents are kept in an array indexed by id, so the usual ids 0..N
+// cost one array access; sparse or huge ids go to a tree. Every id of the array is below every id
+// of the tree, so scanning the array and then the tree visits the ids in ascending order.
+// Ids are non-negative
+class DocumentIdMap {
+public:
+    inline static constexpr DocumentOrdinal NO_ORDINAL = PostingList::END_ORDINAL;
+
+    // Iterates ids in ascending order
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = int;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const int*;
+        using reference = const int&;
+
+        Iterator() = default;
+
+        Iterator(const DocumentIdMap& map, size_t dense_index, std::map<int, DocumentOrdinal>::const_iterator sparse_it)
+            : map_(&map),
+            dense_index_(dense_index),
+            sparse_it_(sparse_it)
+        {
+            SkipHoles();
+        }
+
+        reference operator*() const { return id_; }
+
+        DocumentOrdinal GetOrdinal() const {
+            return dense_index_ < map_->dense_ordinals_.size() ? map_->dense_ordinals_[dense_index_] : sparse_it_->second;
+        }
+
+        Iterator& operator++() {
+            if (dense_index_ < map_->dense_ordinals_.size()) {
+                ++dense_index_;
+            }
+            else {
+                ++sparse_it_;
+            }
+            SkipHoles();
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator previous = *this;
+            ++*this;
+            return previous;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return dense_index_ == other.dense_index_ && sparse_it_ == other.sparse_it_;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return !(*this == other);
+        }
+
+    private:
+        const DocumentIdMap* map_ = nullptr;
+        size_t dense_index_ = 0;
+        std::map<int, DocumentOrdinal>::const_iterator sparse_it_;
+        int id_ = 0;
+
+        // Moves to the next present id and caches it
+        void SkipHoles() {
+            const auto& dense_ordinals = map_->dense_ordinals_;
+            while (dense_index_ < dense_ordinals.size() && dense_ordinals[dense_index_] == NO_ORDINAL) {
+                ++dense_index_;
+            }
+            if (dense_index_ < dense_ordinals.size()) {
+                id_ = static_cast<int>(dense_index_);
+            }
+            else if (sparse_it_ != map_->sparse_ordinals_.end()) {
+                id_ = sparse_it_->first;
+            }
+        }
+    };
+
+    // NO_ORDINAL for an unknown id
+    DocumentOrdinal Find(int document_id) const {
+        const auto index = static_cast<size_t>(document_id);
+        if (index < dense_ordinals_.size()) {
+            return dense_ordinals_[index];
+        }
+        if (sparse_ordinals_.empty()) {
+            return NO_ORDINAL;
+        }
+        const auto it = sparse_ordinals_.find(document_id);
+        return it == sparse_ordinals_.end() ? NO_ORDINAL : it->second;
+    }
+
+    bool Contains(int document_id) const { return Find(document_id) != NO_ORDINAL; }
+
+    // Returns false if the id is already there
+    bool Insert(int document_id, DocumentOrdinal ordinal);
+
+    // Returns the ordinal of the erased id, NO_ORDINAL for an unknown one
+    DocumentOrdinal Erase(int document_id);
+
+    size_t size() const { return size_; }
+
+    bool empty() const { return size_ == 0; }
+
+    Iterator begin() const { return Iterator(*this, 0, sparse_ordinals_.begin()); }
+
+    Iterator end() const { return Iterator(*this, dense_ordinals_.size(), sparse_ordinals_.end()); }
+
+    // Heap bytes, tree nodes are estimated from their size and links
+    size_t GetMemoryUsage() const;
+
+private:
+    // The array covers ids below max(MIN_DENSE_SIZE, 2 * size), so holes take at most half of it
+    // unless documents were removed
+    inline static constexpr size_t MIN_DENSE_SIZE = 1024;
+
+    std::vector<DocumentOrdinal> dense_ordinals_;   // by id, NO_ORDINAL for absent ids
+    std::map<int, DocumentOrdinal> sparse_ordinals_;
+    size_t size_ = 0;
+
+    // Extends the array to cover size ids, moving the ids it covers now from the tree
+    void Grow(size_t size);
+};
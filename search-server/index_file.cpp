@@ -0,0 +1,115 @@
+#include "index_file.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std::literals;
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& path) {
+    file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file_ == INVALID_HANDLE_VALUE) {
+        file_ = nullptr;
+        throw std::runtime_error("Can not open index file "s + path);
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file_, &size)) {
+        CloseHandle(file_);
+        throw std::runtime_error("Can not open index file "s + path);
+    }
+    size_ = static_cast<size_t>(size.QuadPart);
+    if (size_ == 0) {
+        return;
+    }
+    mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    data_ = mapping_ != nullptr ? static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+    if (data_ == nullptr) {
+        if (mapping_ != nullptr) {
+            CloseHandle(mapping_);
+        }
+        CloseHandle(file_);
+        throw std::runtime_error("Can not map index file "s + path);
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (data_ != nullptr) {
+        UnmapViewOfFile(data_);
+        CloseHandle(mapping_);
+    }
+    if (file_ != nullptr) {
+        CloseHandle(file_);
+    }
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path) {
+    const int descriptor = open(path.c_str(), O_RDONLY);
+    if (descriptor < 0) {
+        throw std::runtime_error("Can not open index file "s + path);
+    }
+    struct stat file_stat;
+    if (fstat(descriptor, &file_stat) != 0) {
+        close(descriptor);
+        throw std::runtime_error("Can not open index file "s + path);
+    }
+    size_ = static_cast<size_t>(file_stat.st_size);
+    if (size_ > 0) {
+        void* data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, descriptor, 0);
+        if (data == MAP_FAILED) {
+            close(descriptor);
+            throw std::runtime_error("Can not map index file "s + path);
+        }
+        data_ = static_cast<const char*>(data);
+    }
+    close(descriptor);   // the mapping keeps the file open
+}
+
+MappedFile::~MappedFile() {
+    if (data_ != nullptr) {
+        munmap(const_cast<char*>(data_), size_);
+    }
+}
+
+#endif
+
+IndexFileWriter::IndexFileWriter(const std::string& path)
+    : out_(path, std::ios::binary | std::ios::trunc)
+{
+    if (!out_) {
+        throw std::runtime_error("Can not create index file "s + path);
+    }
+}
+
+void IndexFileWriter::Close() {
+    out_.close();
+    if (!out_) {
+        throw std::runtime_error("Can not write index file"s);
+    }
+}
+
+void IndexFileWriter::WriteBytes(const void* data, size_t size) {
+    static const char padding[ALIGNMENT] = {};
+    const size_t padding_size = (ALIGNMENT - position_ % ALIGNMENT) % ALIGNMENT;
+    out_.write(padding, padding_size);
+    out_.write(static_cast<const char*>(data), size);
+    position_ += padding_size + size;
+}
+
+const char* IndexFileReader::Take(size_t size) {
+    const size_t position = (position_ + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    if (position > file_.GetSize() || size > file_.GetSize() - position) {
+        throw std::runtime_error("Index file is truncated");
+    }
+    position_ = position + size;
+    return file_.GetData() + position;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include "storage_vector.h"
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile();
+
+    const char* GetData() const { return data_; }
+
+    size_t GetSize() const { return size_; }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    void* file_ = nullptr;
+    void* mapping_ = nullptr;
+#endif
+};
+
+// Sequential writer of the binary index format. Every value starts at a multiple of 8 bytes,
+// so arrays can be used in place once the file is mapped
+class IndexFileWriter {
+public:
+    explicit IndexFileWriter(const std::string& path);
+
+    template <typename T>
+    void Write(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        WriteBytes(&value, sizeof(T));
+    }
+
+    // Writes the size, then the elements
+    template <typename T>
+    void WriteArray(const T* data, size_t size) {
+        static_assert(std::is_trivially_copyable_v<T> && alignof(T) <= ALIGNMENT);
+        Write<uint64_t>(size);
+        WriteBytes(data, size * sizeof(T));
+    }
+
+    template <typename Container>
+    void WriteArray(const Container& values) {
+        WriteArray(values.data(), values.size());
+    }
+
+    void WriteString(std::string_view text) {
+        WriteArray(text.data(), text.size());
+    }
+
+    // Flushes the file, throws if anything was not written
+    void Close();
+
+private:
+    static constexpr size_t ALIGNMENT = 8;
+
+    std::ofstream out_;
+    uint64_t position_ = 0;
+
+    void WriteBytes(const void* data, size_t size);
+};
+
+// Sequential reader of a mapped index file. Arrays are returned as views into the mapping
+class IndexFileReader {
+public:
+    explicit IndexFileReader(const MappedFile& file)
+        : file_(file)
+    {
+    }
+
+    template <typename T>
+    T Read() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        T value;
+        std::memcpy(&value, Take(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    template <typename T>
+    StorageVector<T> ReadArray() {
+        static_assert(std::is_trivially_copyable_v<T> && alignof(T) <= ALIGNMENT);
+        const auto size = Read<uint64_t>();
+        if (size > file_.GetSize() / sizeof(T)) {
+            throw std::runtime_error("Index file is corrupted");
+        }
+        return StorageVector<T>::View(reinterpret_cast<const T*>(Take(size * sizeof(T))), size);
+    }
+
+    std::string_view ReadString() {
+        const StorageVector<char> chars = ReadArray<char>();
+        return { chars.data(), chars.size() };
+    }
+
+private:
+    static constexpr size_t ALIGNMENT = 8;
+
+    const MappedFile& file_;
+    size_t position_ = 0;
+
+    // Returns the next size bytes, starting at an aligned position
+    const char* Take(size_t size);
+};
@@ -26,7 +26,8 @@ public:
 
         const auto end_time = Clock::now();
         const auto dur = end_time - start_time_;
-        stream_ << id_ << ": "s << duration_cast<milliseconds>(dur).count() << " ms"s << std::endl;
+        // Microsecond resolution so that short scopes do not print 0 ms
+        stream_ << id_ << ": "s << duration_cast<microseconds>(dur).count() / 1000.0 << " ms"s << std::endl;
     }
 
 private:
@@ -1,53 +1,61 @@
 ﻿#include "search_server.h"
+#include "data_generators.h"
 #include "log_duration.h"
+#include "near_duplicates.h"
+#include "paginator.h"
+#include "persistent_map.h"
 #include "process_queries.h"    // для кнопки "ПРОВЕРИТЬ"
+#include "realtime_search_server.h"
+#include "sharded_search_server.h"
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <chrono>
+#include <cstdio>
 #include <execution>
+#include <fstream>
+#include <future>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <optional>
 #include <random>
+#include <set>
 #include <string>
+#include <thread>
 #include <vector>
 
 using namespace std;
 
-string GenerateWord(mt19937& generator, int max_length) {
-    const int length = uniform_int_distribution(1, max_length)(generator);
-    string word;
-    word.reserve(length);
-    for (int i = 0; i < length; ++i) {
-        word.push_back(uniform_int_distribution('a', 'z')(generator));
-    }
-    return word;
-}
-vector<string> GenerateDictionary(mt19937& generator, int word_count, int max_length) {
-    vector<string> words;
-    words.reserve(word_count);
-    for (int i = 0; i < word_count; ++i) {
-        words.push_back(GenerateWord(generator, max_length));
+// Fails the run when the condition is false, release builds included
+#define CHECK(condition)                                                                      \
+    do {                                                                                      \
+        if (!(condition)) {                                                                   \
+            cerr << __FILE__ << ":"s << __LINE__ << ": check failed: "s << #condition << endl; \
+            abort();                                                                          \
+        }                                                                                     \
+    } while (false)
+
+// True when calling function throws Exception
+template <typename Exception, typename Function>
+bool Throws(Function function) {
+    try {
+        function();
     }
-    words.erase(unique(words.begin(), words.end()), words.end());
-    return words;
-}
-string GenerateQuery(mt19937& generator, const vector<string>& dictionary, int word_count, double minus_prob = 0) {
-    string query;
-    for (int i = 0; i < word_count; ++i) {
-        if (!query.empty()) {
-            query.push_back(' ');
-        }
-        if (uniform_real_distribution<>(0, 1)(generator) < minus_prob) {
-            query.push_back('-');
-        }
-        query += dictionary[uniform_int_distribution<int>(0, dictionary.size() - 1)(generator)];
+    catch (const Exception&) {
+        return true;
     }
-    return query;
+    return false;
 }
-vector<string> GenerateQueries(mt19937& generator, const vector<string>& dictionary, int query_count, int max_word_count) {
-    vector<string> queries;
-    queries.reserve(query_count);
-    for (int i = 0; i < query_count; ++i) {
-        queries.push_back(GenerateQuery(generator, dictionary, max_word_count));
-    }
-    return queries;
+
+// Same ids in the same order with the same relevance up to rounding
+bool SameDocuments(const vector<Document>& lhs, const vector<Document>& rhs) {
+    return equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](const Document& lhs, const Document& rhs) {
+        return lhs.id == rhs.id && abs(lhs.relevance - rhs.relevance) < 1e-9;
+    });
 }
+
 template <typename ExecutionPolicy>
 void Test(string_view mark, const SearchServer& search_server, const vector<string>& queries, ExecutionPolicy&& policy) {
     LOG_DURATION(mark);
@@ -60,6 +68,727 @@ void Test(string_view mark, const SearchServer& search_server, const vector<stri
     cout << total_relevance << endl;
 }
 #define TEST(policy) Test(#policy, search_server, queries, execution::policy)
+
+// Decodes every block of a large compressed posting list and reports postings per second
+void TestPostingsDecoding(mt19937& generator) {
+    const int posting_count = 10'000'000;
+    vector<double> inverse_lengths;
+    PostingList postings(true);
+    DocumentOrdinal ordinal = 0;
+    for (int i = 0; i < posting_count; ++i) {
+        ordinal += uniform_int_distribution<DocumentOrdinal>(1, 64)(generator);
+        inverse_lengths.resize(ordinal + 1, 1.0 / 70);
+        postings.Append(ordinal, uniform_int_distribution<uint32_t>(1, 4)(generator), 0.0);
+    }
+    cout << "compressed list: "s << postings.GetMemoryUsage() * 1.0 / posting_count << " bytes per posting"s << endl;
+
+    PostingList::BlockBuffer buffer;
+    double total_term_freq = 0;
+    const auto start = chrono::steady_clock::now();
+    for (size_t block = 0; block < postings.GetBlockCount(); ++block) {
+        const auto decoded = postings.GetBlock(block, &buffer, inverse_lengths.data());
+        for (size_t i = 0; i < decoded.size; ++i) {
+            total_term_freq += decoded.term_freqs[i];
+        }
+    }
+    const chrono::duration<double> seconds = chrono::steady_clock::now() - start;
+    cout << "decode: "s << posting_count / seconds.count() / 1e6 << " M postings/s ("s << total_term_freq << ")"s << endl;
+}
+
+// Tokenizes and validates the same texts with SplitIntoWordsView and a check of every word,
+// as documents were processed before, and with SplitIntoWordsValidated. Reports GB/s
+void TestTokenizer(const vector<string>& documents, const set<string, less<>>& stop_words) {
+    size_t text_size = 0;
+    for (const string& document : documents) {
+        text_size += document.size();
+    }
+    const int repeat_count = 10;
+    const auto report = [&](const string& name, auto tokenize) {
+        size_t word_count = 0;
+        const auto start = chrono::steady_clock::now();
+        for (int i = 0; i < repeat_count; ++i) {
+            for (const string& document : documents) {
+                word_count += tokenize(document);
+            }
+        }
+        const chrono::duration<double> seconds = chrono::steady_clock::now() - start;
+        cout << name << ": "s << text_size * repeat_count / seconds.count() / 1e9 << " GB/s ("s << word_count << " words)"s << endl;
+    };
+    report("split and check words"s, [&](string_view text) {
+        size_t word_count = 0;
+        for (const string_view word : SplitIntoWordsView(text)) {
+            const bool is_valid = none_of(word.begin(), word.end(), [](char symbol) { return symbol >= '\0' && symbol < ' '; });
+            word_count += is_valid && stop_words.count(string(word)) == 0 ? 1 : 0;
+        }
+        return word_count;
+    });
+    vector<string_view> words;
+    report("validating tokenizer"s, [&](string_view text) {
+        size_t word_count = 0;
+        const size_t invalid_word = SplitIntoWordsValidated(text, words);
+        for (size_t i = 0; i < words.size(); ++i) {
+            word_count += i != invalid_word && stop_words.find(words[i]) == stop_words.end() ? 1 : 0;
+        }
+        return word_count;
+    });
+}
+
+// Keeps querying snapshots from another thread while documents are being added and removed
+void TestRealtimeIndexing(const vector<string>& dictionary, const vector<string>& documents, const vector<string>& queries) {
+    RealtimeSearchServer search_server(dictionary[0]);
+    atomic<bool> indexing = true;
+    size_t query_count = 0;
+    thread reader([&] {
+        while (indexing) {
+            const auto snapshot = search_server.GetSnapshot();
+            for (const string_view query : queries) {
+                snapshot->FindTopDocuments(query);
+            }
+            query_count += queries.size();
+        }
+    });
+    {
+        LOG_DURATION("realtime indexing"s);
+        for (size_t i = 0; i < documents.size(); ++i) {
+            search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+            if (i % 10 == 9) {
+                search_server.RemoveDocument(i - 5);
+            }
+        }
+    }
+    indexing = false;
+    reader.join();
+    search_server.WaitForMerges();
+    const auto snapshot = search_server.GetSnapshot();
+    cout << snapshot->GetDocumentCount() << " documents in "s << snapshot->GetSegmentCount() << " segments and "s
+         << snapshot->GetBufferDocumentCount() << " buffered, "s << query_count << " queries during indexing"s << endl;
+
+    // Merged segments, the buffer and the tombstones score as one index of the live documents
+    SearchServer reference(dictionary[0]);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        if (i % 10 != 4 || i + 5 >= documents.size()) {
+            reference.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+        }
+    }
+    CHECK(snapshot->GetDocumentCount() == reference.GetDocumentCount());
+    for (size_t i = 0; i < min<size_t>(queries.size(), 1'000); ++i) {
+        CHECK(SameDocuments(snapshot->FindTopDocuments(queries[i]), reference.FindTopDocuments(queries[i])));
+    }
+
+    // A removed id can be added again, in a sealed segment as well as in the buffer
+    const int last_id = static_cast<int>(documents.size()) - 1;
+    search_server.RemoveDocument(4);
+    search_server.RemoveDocument(last_id);
+    search_server.AddDocument(4, "realtime readded"s, DocumentStatus::ACTUAL, {1});
+    search_server.AddDocument(last_id, "realtime readded"s, DocumentStatus::ACTUAL, {1});
+    CHECK(Throws<invalid_argument>([&] { search_server.AddDocument(4, "realtime"s, DocumentStatus::ACTUAL, {1}); }));
+    const auto readded = search_server.FindTopDocuments("readded"s);
+    CHECK(readded.size() == 2);
+    CHECK(get<0>(search_server.GetSnapshot()->MatchDocument("realtime"s, last_id)) == vector<string_view>{"realtime"sv});
+    // The earlier snapshot keeps its version
+    CHECK(snapshot->HasDocument(last_id) && snapshot->FindTopDocuments("readded"s).empty());
+
+    // Bulk removals rebuild the segments with the most tombstones, only the buffer may keep more of them
+    map<int, string_view> live_documents;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        if (i % 10 != 4 || i + 5 >= documents.size()) {
+            live_documents.emplace(static_cast<int>(i), documents[i]);
+        }
+    }
+    live_documents[4] = live_documents[last_id] = "realtime readded"sv;
+    for (auto it = live_documents.begin(); it != live_documents.end();) {
+        if (it->first % 3 != 0) {
+            search_server.RemoveDocument(it->first);
+            it = live_documents.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+    search_server.WaitForMerges();
+    const auto after_removals = search_server.GetSnapshot();
+    CHECK(after_removals->GetDocumentCount() == static_cast<int>(live_documents.size()));
+    CHECK(after_removals->GetDeletedDocumentCount() <= live_documents.size() / 8 + after_removals->GetBufferDocumentCount());
+    SearchServer live_reference(dictionary[0]);
+    for (const auto& [document_id, document] : live_documents) {
+        live_reference.AddDocument(document_id, document, DocumentStatus::ACTUAL, {1, 2, 3});
+    }
+    for (size_t i = 0; i < min<size_t>(queries.size(), 1'000); ++i) {
+        CHECK(SameDocuments(after_removals->FindTopDocuments(queries[i]), live_reference.FindTopDocuments(queries[i])));
+    }
+}
+
+// A thread waiting for its ParallelFor does not run the tasks of others, and loops nest on one worker
+void TestThreadPool() {
+    atomic<thread::id> submitted_task_thread;
+    {
+        // One worker is held by a task, the other one runs a call of the loop while a task is pending
+        ThreadPool thread_pool(2);
+        promise<void> release;
+        atomic<bool> holding = false;
+        thread_pool.Submit([&holding, released = release.get_future().share()] {
+            holding = true;
+            released.wait();
+        });
+        while (!holding) {
+            this_thread::yield();
+        }
+        const thread::id caller = this_thread::get_id();
+        atomic<bool> worker_call_started = false;
+        thread_pool.ParallelFor(2, [&](size_t) {
+            if (this_thread::get_id() != caller) {
+                worker_call_started = true;
+                this_thread::sleep_for(50ms);
+                return;
+            }
+            while (!worker_call_started) {
+                this_thread::yield();
+            }
+            thread_pool.Submit([&submitted_task_thread] { submitted_task_thread = this_thread::get_id(); });
+        });
+        CHECK(submitted_task_thread.load() != caller);
+        release.set_value();
+    }
+    CHECK(submitted_task_thread.load() != thread::id());
+
+    ThreadPool thread_pool(1);
+    atomic<size_t> call_count = 0;
+    thread_pool.ParallelFor(8, [&](size_t) {
+        thread_pool.ParallelFor(8, [&](size_t) { ++call_count; });
+    });
+    CHECK(call_count == 64);
+    cout << "thread pool: ok"s << endl;
+}
+
+// Copies of a persistent map keep their contents while the others change
+void TestPersistentMap(mt19937& generator) {
+    PersistentMap<int, int> persistent;
+    map<int, int> expected;
+    vector<pair<PersistentMap<int, int>, map<int, int>>> versions;
+    for (int i = 0; i < 100'000; ++i) {
+        const int key = uniform_int_distribution<int>(0, 5'000)(generator);
+        if (uniform_int_distribution<int>(0, 2)(generator) == 0) {
+            CHECK(persistent.Erase(key) == (expected.erase(key) > 0));
+        }
+        else {
+            persistent[key] += i;
+            expected[key] += i;
+        }
+        if (i % 10'000 == 0) {
+            versions.emplace_back(persistent, expected);
+        }
+    }
+    versions.emplace_back(persistent, expected);
+    for (const auto& [version, version_expected] : versions) {
+        CHECK(version.size() == version_expected.size());
+        for (int key = 0; key <= 5'000; ++key) {
+            const int* value = version.Find(key);
+            const auto it = version_expected.find(key);
+            CHECK(it == version_expected.end() ? value == nullptr : value != nullptr && *value == it->second);
+        }
+    }
+    cout << "persistent map: ok"s << endl;
+}
+
+// Removes most documents and compacts: the document arrays shrink, and queries, matching and word
+// frequencies stay the same as in an index of the documents left, for both postings formats
+void TestCompaction(const vector<string>& dictionary, const vector<string>& documents, const vector<string>& queries) {
+    for (const bool compressed : { false, true }) {
+        SearchServer search_server(dictionary[0]);
+        SearchServer reference(dictionary[0]);
+        search_server.SetAutoCompactionRatio(1.0);
+        search_server.SetPostingsCompression(compressed);
+        reference.SetPostingsCompression(compressed);
+        for (size_t i = 0; i < documents.size(); ++i) {
+            search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+            if (i % 10 == 0) {
+                reference.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+            }
+        }
+        const size_t document_bytes = search_server.GetMemoryUsage().document_bytes;
+        for (size_t i = 0; i < documents.size(); ++i) {
+            if (i % 10 != 0) {
+                search_server.RemoveDocument(i);
+            }
+        }
+        search_server.Compact();
+        CHECK(search_server.GetDeletionStats().deleted_document_count == 0);
+        CHECK(search_server.GetMemoryUsage().document_bytes * 4 < document_bytes);
+
+        for (const string& query : queries) {
+            CHECK(SameDocuments(search_server.FindTopDocuments(query), reference.FindTopDocuments(query)));
+        }
+        for (size_t i = 0; i < documents.size(); i += 10) {
+            CHECK(search_server.GetWordFrequencies(i) == reference.GetWordFrequencies(i));
+            CHECK(search_server.MatchDocument(queries[i % queries.size()], i) == reference.MatchDocument(queries[i % queries.size()], i));
+        }
+
+        // Documents added after compaction follow the renumbered ones
+        const int new_id = static_cast<int>(documents.size());
+        search_server.AddDocument(new_id, documents[1], DocumentStatus::BANNED, {5});
+        reference.AddDocument(new_id, documents[1], DocumentStatus::BANNED, {5});
+        CHECK(SameDocuments(search_server.FindTopDocuments(documents[1], DocumentStatus::BANNED),
+                             reference.FindTopDocuments(documents[1], DocumentStatus::BANNED)));
+        CHECK(search_server.GetDocumentCount() == reference.GetDocumentCount());
+    }
+    cout << "compaction: ok"s << endl;
+}
+
+// Builds the same index one document at a time and with the bulk load API
+void TestBulkLoad(const vector<string>& dictionary, const vector<string>& documents) {
+    vector<NewDocument> batch;
+    batch.reserve(documents.size());
+    for (size_t i = 0; i < documents.size(); ++i) {
+        batch.push_back({ static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, {1, 2, 3} });
+    }
+    {
+        SearchServer search_server(dictionary[0]);
+        LOG_DURATION("one by one"s);
+        for (const NewDocument& document : batch) {
+            search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+        }
+    }
+    {
+        SearchServer search_server(dictionary[0]);
+        LOG_DURATION("bulk seq"s);
+        search_server.AddDocuments(execution::seq, batch);
+    }
+    {
+        SearchServer search_server(dictionary[0]);
+        LOG_DURATION("bulk par"s);
+        search_server.AddDocuments(execution::par, batch);
+    }
+}
+
+// Saves the index and opens the file: the opened index answers like the original one
+// and a truncated file is rejected
+void TestIndexFile(const SearchServer& search_server, const vector<string>& queries) {
+    const string path = "search_index.bin"s;
+    search_server.Save(path);
+    {
+        const SearchServer opened = SearchServer::Open(path);
+        CHECK(opened.GetDocumentCount() == search_server.GetDocumentCount());
+        for (const string& query : queries) {
+            CHECK(SameDocuments(opened.FindTopDocuments(query), search_server.FindTopDocuments(query)));
+        }
+        for (const int document_id : { 0, search_server.GetDocumentCount() - 1 }) {
+            CHECK(opened.MatchDocument(queries[0], document_id) == search_server.MatchDocument(queries[0], document_id));
+        }
+        // A copy of an opened index shares the file and moves to memory on its own modification
+        SearchServer copy = opened;
+        CHECK(copy.IsMapped());
+        copy.RemoveDocument(0);
+        CHECK(!copy.IsMapped() && opened.IsMapped() && opened.HasDocument(0));
+        CHECK(copy.GetDocumentCount() + 1 == opened.GetDocumentCount());
+        CHECK(SameDocuments(opened.FindTopDocuments(queries[0]), search_server.FindTopDocuments(queries[0])));
+    }
+
+    // Every array is checked against the file size, so a cut anywhere is reported instead of read past the end
+    string contents;
+    {
+        ifstream in(path, ios::binary);
+        contents.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    }
+    for (const size_t size : { size_t{ 0 }, size_t{ 8 }, contents.size() / 2, contents.size() - 1 }) {
+        {
+            ofstream out(path, ios::binary | ios::trunc);
+            out.write(contents.data(), static_cast<streamsize>(size));
+        }
+        CHECK(Throws<runtime_error>([&path] { SearchServer::Open(path); }));
+    }
+    remove(path.c_str());
+    cout << "index file: ok"s << endl;
+}
+
+// A limit of no results gives empty results, a limit of one the best result, in both scoring modes
+void TestResultLimits(SearchServer& search_server, const vector<string>& queries) {
+    for (const auto scoring_mode : { SearchServer::ScoringMode::EXHAUSTIVE, SearchServer::ScoringMode::MAX_SCORE }) {
+        search_server.SetScoringMode(scoring_mode);
+        for (const string& query : queries) {
+            CHECK(search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, 0).empty());
+            CHECK(search_server.FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL, 0).empty());
+            const vector<Document> all = search_server.FindTopDocuments(query);
+            const vector<Document> best = search_server.FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL, 1);
+            CHECK(SameDocuments(best, vector<Document>(all.begin(), all.begin() + min<size_t>(all.size(), 1))));
+        }
+    }
+    search_server.SetScoringMode(SearchServer::ScoringMode::MAX_SCORE);
+    const auto batch = search_server.FindTopDocumentsBatch(queries, DocumentStatus::ACTUAL, 0);
+    CHECK(batch.size() == queries.size());
+    CHECK(all_of(batch.begin(), batch.end(), [](const vector<Document>& documents) { return documents.empty(); }));
+    cout << "result limits: ok"s << endl;
+}
+
+// Cached results of a filter are not handed to a predicate, and a cache holds what it was asked to
+void TestResultCacheKeys(const SearchServer& search_server, const vector<string>& queries) {
+    const auto reject_all = [](int, DocumentStatus, int) { return false; };
+    for (size_t i = 0; i < min<size_t>(queries.size(), 10); ++i) {
+        const vector<Document> unfiltered = search_server.FindTopDocuments(execution::seq, queries[i], DocumentFilter{});
+        CHECK(search_server.FindTopDocuments(execution::seq, queries[i], reject_all, ""sv).empty());
+        CHECK(SameDocuments(search_server.FindTopDocuments(execution::seq, queries[i], DocumentFilter{}), unfiltered));
+    }
+    for (const size_t capacity : { size_t{ 1 }, size_t{ 5 }, size_t{ 1'000 } }) {
+        CHECK(QueryResultCache(capacity).GetCapacity() == capacity);
+    }
+    cout << "result cache keys: ok"s << endl;
+}
+
+// A copy finds what the original does with a cache of its own and is modified independently of it
+void TestCopy(const SearchServer& search_server, const vector<string>& documents, const vector<string>& queries) {
+    SearchServer copy = search_server;
+    CHECK(copy.GetDocumentCount() == search_server.GetDocumentCount());
+    const auto cache_stats = copy.GetResultCacheStats();
+    CHECK(cache_stats.hit_count == 0 && cache_stats.miss_count == 0 && cache_stats.size == 0);
+    for (const string& query : queries) {
+        CHECK(SameDocuments(copy.FindTopDocuments(query), search_server.FindTopDocuments(query)));
+    }
+    CHECK(copy.GetResultCacheStats().size > 0);
+
+    const int new_document_id = static_cast<int>(documents.size());
+    copy.RemoveDocument(0);
+    copy.AddDocument(new_document_id, documents[0], DocumentStatus::ACTUAL, {1, 2, 3});
+    CHECK(!copy.HasDocument(0) && copy.HasDocument(new_document_id));
+    CHECK(search_server.HasDocument(0) && !search_server.HasDocument(new_document_id));
+    CHECK(copy.MatchDocument(queries[0], new_document_id) == search_server.MatchDocument(queries[0], 0));
+
+    // The terms of a copy do not point into the server it was copied from
+    SearchServer assigned;
+    {
+        const SearchServer temporary = copy;
+        assigned = temporary;
+    }
+    for (const string& query : queries) {
+        CHECK(SameDocuments(assigned.FindTopDocuments(query), copy.FindTopDocuments(query)));
+    }
+    CHECK(assigned.MatchDocument(queries[0], new_document_id) == copy.MatchDocument(queries[0], new_document_id));
+    cout << "copy: ok"s << endl;
+}
+
+// Runs the same status and rating filter as a predicate and as a structured filter
+void TestFilteredSearch(const vector<string>& dictionary, const vector<string>& documents, const vector<string>& queries) {
+    SearchServer search_server(dictionary[0]);
+    for (size_t i = 0; i < documents.size() / 4; ++i) {
+        search_server.AddDocument(i, documents[i], static_cast<DocumentStatus>(i % 4), { static_cast<int>(i % 11) - 5 });
+    }
+    const auto check_filter = [&](const DocumentFilter& filter, bool matches_nothing = false) {
+        const auto predicate = [&filter](int, DocumentStatus status, int rating) {
+            return (!filter.status || status == *filter.status) && rating >= filter.min_rating && rating <= filter.max_rating;
+        };
+        for (const string& query : queries) {
+            const vector<Document> by_filter = search_server.FindTopDocuments(execution::seq, query, filter);
+            CHECK(SameDocuments(by_filter, search_server.FindTopDocuments(execution::seq, query, predicate)));
+            CHECK(SameDocuments(search_server.FindTopDocuments(execution::par, query, filter), by_filter));
+            CHECK(!matches_nothing || by_filter.empty());
+        }
+    };
+    check_filter(DocumentFilter{ DocumentStatus::ACTUAL, 2 });
+    check_filter(DocumentFilter{ DocumentStatus::BANNED });
+    check_filter(DocumentFilter{ nullopt });
+    check_filter(DocumentFilter{ nullopt, -2, 3 });
+    check_filter(DocumentFilter{ DocumentStatus::REMOVED, numeric_limits<int>::min(), -5 });
+    // Rating ranges outside of all the ratings and empty ones select no document
+    check_filter(DocumentFilter{ nullopt, 6 }, true);
+    check_filter(DocumentFilter{ DocumentStatus::IRRELEVANT, 3, 2 }, true);
+    cout << "filters: ok"s << endl;
+}
+
+// Pages walked with search-after cursors and sliced from a top of every page end make up the results in order
+void TestSearchAfterPages(const SearchServer& search_server, const vector<string>& queries) {
+    const size_t page_size = 10;
+    const size_t page_count = 20;
+    const DocumentFilter filter{ DocumentStatus::ACTUAL };
+    for (size_t i = 0; i < min<size_t>(queries.size(), 20); ++i) {
+        const vector<Document> all = search_server.FindTopDocuments(execution::seq, queries[i], filter, search_server.GetDocumentCount());
+        const vector<Document> first_pages(all.begin(), all.begin() + min(all.size(), page_count * page_size));
+        vector<Document> by_offset;
+        for (size_t page = 0; page < page_count; ++page) {
+            const auto top = search_server.FindTopDocuments(execution::seq, queries[i], filter, (page + 1) * page_size);
+            if (top.size() <= page * page_size) {
+                break;
+            }
+            by_offset.insert(by_offset.end(), top.begin() + page * page_size, top.end());
+        }
+        CHECK(SameDocuments(by_offset, first_pages));
+        vector<Document> by_cursor;
+        size_t page_number = 0;
+        for (const vector<Document>& page : PaginateSearch(search_server, queries[i], filter, page_size)) {
+            CHECK(page.size() == page_size || by_cursor.size() + page.size() == all.size());
+            by_cursor.insert(by_cursor.end(), page.begin(), page.end());
+            if (++page_number == page_count) {
+                break;
+            }
+        }
+        CHECK(SameDocuments(by_cursor, first_pages));
+
+        // An empty cursor starts at the top, a cursor at the last document ends the results
+        CHECK(SameDocuments(search_server.FindTopDocuments(queries[i], filter, page_size, SearchCursor()),
+                            search_server.FindTopDocuments(execution::seq, queries[i], filter, page_size)));
+        if (!all.empty()) {
+            CHECK(search_server.FindTopDocuments(queries[i], filter, page_size, SearchCursor(all.back())).empty());
+        }
+        // A stale cursor, whose document is gone, continues with the first document ranked after it
+        for (size_t k = 0; k + 1 < all.size(); ++k) {
+            if (all[k].relevance - all[k + 1].relevance < 4 * EPSILON) {
+                continue;
+            }
+            const Document stale(-1, (all[k].relevance + all[k + 1].relevance) / 2, all[k].rating);
+            const vector<Document> page = search_server.FindTopDocuments(queries[i], filter, page_size, SearchCursor(stale));
+            CHECK(SameDocuments(page, vector<Document>(all.begin() + k + 1, all.begin() + min(all.size(), k + 1 + page_size))));
+            break;
+        }
+    }
+    // A query without results has no pages
+    auto no_pages = PaginateSearch(search_server, "nosuchword"s, filter, page_size);
+    CHECK(no_pages.begin() == no_pages.end());
+    cout << "pages: ok"s << endl;
+}
+
+// A wildcard query scores like its matching words written out, and a wildcard matching nothing drops out
+void TestWildcardQueries(const SearchServer& search_server, const vector<string>& dictionary) {
+    const auto expand = [&search_server](const string& pattern, const string& prefix) {
+        string expanded_query;
+        for (const string_view word : search_server.FindMatchingWords(pattern)) {
+            expanded_query += prefix + string(word) + " "s;
+        }
+        return expanded_query;
+    };
+    for (size_t i = 1; i < dictionary.size(); i += 10) {
+        const string prefix = dictionary[i].substr(0, 2);
+        const string pattern = prefix + "*"s;
+        const vector<string_view> words = search_server.FindMatchingWords(pattern);
+        CHECK(!words.empty());
+        for (const string_view word : words) {
+            CHECK(word.substr(0, prefix.size()) == prefix);
+        }
+        CHECK(SameDocuments(search_server.FindTopDocuments(pattern), search_server.FindTopDocuments(expand(pattern, ""s))));
+        // In a minus word the wildcard excludes the documents with any of its words
+        const string other_word = dictionary[(i + 1) % dictionary.size()];
+        CHECK(SameDocuments(search_server.FindTopDocuments(other_word + " -"s + pattern),
+                            search_server.FindTopDocuments(other_word + " "s + expand(pattern, "-"s))));
+    }
+    const string one_char_pattern = "?"s + dictionary[1].substr(1);
+    CHECK(SameDocuments(search_server.FindTopDocuments(one_char_pattern),
+                        search_server.FindTopDocuments(expand(one_char_pattern, ""s))));
+
+    const string no_match_pattern = "zzzzqq*"s;
+    CHECK(search_server.FindMatchingWords(no_match_pattern).empty());
+    CHECK(search_server.FindTopDocuments(no_match_pattern).empty());
+    CHECK(SameDocuments(search_server.FindTopDocuments(dictionary[1] + " "s + no_match_pattern),
+                        search_server.FindTopDocuments(dictionary[1])));
+
+    // Every added word is found while new words go through the tail into the blocks, in no order
+    SearchServer growing_server(""s);
+    vector<string> added_words;
+    for (int i = 0; i < 3000; ++i) {
+        added_words.push_back("t"s + to_string(i * 7919 % 3000));
+        growing_server.AddDocument(i, added_words.back(), DocumentStatus::ACTUAL, {1});
+        if (i % 97 != 0 && i + 1 != 3000) {
+            continue;
+        }
+        for (const string& pattern : { "t*"s, "t1*"s, "t12?"s, "t29*"s, added_words.front() }) {
+            const string_view prefix = string_view(pattern).substr(0, pattern.find_first_of("*?"));
+            vector<string> expected;
+            for (const string& word : added_words) {
+                if (word.substr(0, prefix.size()) == prefix
+                    && (pattern.back() == '*' || word.size() == pattern.size())) {
+                    expected.push_back(word);
+                }
+            }
+            vector<string> found;
+            for (const string_view word : growing_server.FindMatchingWords(pattern)) {
+                found.emplace_back(word);
+            }
+            sort(expected.begin(), expected.end());
+            sort(found.begin(), found.end());
+            CHECK(found == expected);
+        }
+    }
+    cout << "wildcards: ok"s << endl;
+}
+
+// Shards of an index find, match and remove what the one index does, also with more shards than documents
+void TestShardedSearch(const SearchServer& search_server, const vector<string>& dictionary, const vector<string>& documents,
+                       const vector<string>& queries) {
+    ShardedSearchServer sharded_search_server(dictionary[0], 8);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        sharded_search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+    }
+    CHECK(sharded_search_server.GetDocumentCount() == search_server.GetDocumentCount());
+    for (const string& query : queries) {
+        CHECK(SameDocuments(sharded_search_server.FindTopDocuments(query), search_server.FindTopDocuments(execution::par, query)));
+    }
+    const string wildcard_query = dictionary[1].substr(0, 2) + "* "s + dictionary[2];
+    CHECK(SameDocuments(sharded_search_server.FindTopDocuments(wildcard_query), search_server.FindTopDocuments(wildcard_query)));
+    for (const int document_id : { 0, 1, static_cast<int>(documents.size()) - 1 }) {
+        CHECK(sharded_search_server.MatchDocument(queries[0], document_id) == search_server.MatchDocument(queries[0], document_id));
+    }
+
+    // Most shards stay empty, their zero counts must not change the scores
+    const vector<string> few_documents(documents.begin(), documents.begin() + 3);
+    ShardedSearchServer sparse_sharded_search_server(dictionary[0], 8);
+    SearchServer few_documents_server(dictionary[0]);
+    for (size_t i = 0; i < few_documents.size(); ++i) {
+        sparse_sharded_search_server.AddDocument(i, few_documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+        few_documents_server.AddDocument(i, few_documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+    }
+    CHECK(sparse_sharded_search_server.GetDocumentCount() == 3);
+    for (const string& query : queries) {
+        CHECK(SameDocuments(sparse_sharded_search_server.FindTopDocuments(query), few_documents_server.FindTopDocuments(query)));
+    }
+    sparse_sharded_search_server.RemoveDocuments({ 0, 1, 2, 100 });
+    CHECK(sparse_sharded_search_server.GetDocumentCount() == 0);
+    CHECK(sparse_sharded_search_server.FindTopDocuments(queries[0]).empty());
+    cout << "shards: ok"s << endl;
+}
+
+// A batch with repeated queries, run with the shared work batch and streamed, finds what the queries find one by one
+void TestBatchQueries(mt19937& generator, const SearchServer& search_server, const vector<string>& dictionary) {
+    vector<string> distinct_queries;
+    for (int i = 0; i < 2'000; ++i) {
+        distinct_queries.push_back(GenerateQuery(generator, dictionary, uniform_int_distribution(1, 5)(generator), 0.1));
+    }
+    vector<string> queries;
+    for (int i = 0; i < 20'000; ++i) {   // popular queries repeat
+        const int index = min(uniform_int_distribution<int>(0, distinct_queries.size() - 1)(generator),
+                              uniform_int_distribution<int>(0, distinct_queries.size() - 1)(generator));
+        queries.push_back(distinct_queries[index]);
+    }
+    // Queries matching nothing and consisting of stop or minus words only get empty results in their places
+    queries.push_back("nosuchword"s);
+    queries.push_back(dictionary[0]);
+    queries.push_back("-"s + dictionary[1]);
+    vector<vector<Document>> one_by_one(queries.size());
+    search_server.GetThreadPool().ParallelFor(queries.size(), [&](size_t i) {
+        one_by_one[i] = search_server.FindTopDocuments(queries[i]);
+    });
+    const vector<vector<Document>> batch = ProcessQueries(search_server, queries);
+    CHECK(batch.size() == queries.size());
+    for (size_t i = 0; i < queries.size(); ++i) {
+        CHECK(SameDocuments(batch[i], one_by_one[i]));
+    }
+    CHECK(batch.back().empty() && batch[batch.size() - 2].empty() && batch[batch.size() - 3].empty());
+    CHECK(ProcessQueries(search_server, {}).empty());
+
+    // Joined and streamed documents come in query order, streamed ones with any window size
+    vector<Document> joined;
+    for (const vector<Document>& documents : one_by_one) {
+        joined.insert(joined.end(), documents.begin(), documents.end());
+    }
+    CHECK(SameDocuments(ProcessQueriesJoined(search_server, queries), joined));
+    for (const size_t window_size : { size_t{ 1 }, size_t{ 7 }, QUERY_WINDOW_SIZE }) {
+        vector<Document> streamed;
+        ProcessQueriesStreamed(search_server, queries, [&streamed](Document&& document) { streamed.push_back(std::move(document)); }, window_size);
+        CHECK(SameDocuments(streamed, joined));
+    }
+    {
+        // The sink runs one call at a time and may use the pool the queries run on, its error comes out
+        SearchServer pooled_server = search_server;
+        pooled_server.SetThreadPool(make_shared<ThreadPool>(2));
+        vector<Document> streamed;
+        atomic<int> sink_call_count = 0;
+        ProcessQueriesStreamed(pooled_server, queries, [&](Document&& document) {
+            CHECK(++sink_call_count == 1);
+            atomic<size_t> call_count = 0;
+            pooled_server.GetThreadPool().ParallelFor(4, [&call_count](size_t) { ++call_count; });
+            CHECK(call_count == 4);
+            streamed.push_back(std::move(document));
+            --sink_call_count;
+        }, 7);
+        CHECK(SameDocuments(streamed, joined));
+        CHECK(Throws<runtime_error>([&] {
+            ProcessQueriesStreamed(pooled_server, queries, [](Document&&) { throw runtime_error("sink"s); }, 7);
+        }));
+    }
+    size_t empty_streamed_count = 0;
+    ProcessQueriesStreamed(search_server, {}, [&empty_streamed_count](Document&&) { ++empty_streamed_count; });
+    CHECK(empty_streamed_count == 0);
+    cout << "batch queries: ok"s << endl;
+}
+
+// Finds the copies of documents with a full pass and with detection on insert
+void TestDuplicates(const vector<string>& dictionary, const vector<string>& documents) {
+    SearchServer search_server(dictionary[0]);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+        if (i % 10 == 0) {
+            search_server.AddDocument(documents.size() + i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+        }
+    }
+    {
+        LOG_DURATION("remove duplicates"s);
+        cout << RemoveDuplicates(search_server).size() << " duplicates removed"s << endl;
+    }
+    search_server.SetDuplicateMode(SearchServer::DuplicateMode::REJECT);
+    int rejected_count = 0;
+    for (size_t i = 0; i < documents.size(); i += 10) {
+        try {
+            search_server.AddDocument(2 * documents.size() + i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+        }
+        catch (const invalid_argument&) {
+            ++rejected_count;
+        }
+    }
+    cout << rejected_count << " duplicates rejected on insert"s << endl;
+}
+
+// Words of the Thue-Morse sequence and of its complement have equal polynomial hashes modulo 2^64
+// whatever the odd base, documents of them have different words and must not be taken for duplicates
+void TestDuplicateWordSets() {
+    string thue_morse;
+    string complement;
+    for (size_t i = 0; i < 2048; ++i) {
+        const bool odd = bitset<16>(i).count() % 2 == 1;
+        thue_morse += odd ? 'b' : 'a';
+        complement += odd ? 'a' : 'b';
+    }
+    const string first = thue_morse + " cat"s;
+    const string second = complement + " cat"s;
+    const string copy = "cat "s + thue_morse + " "s + thue_morse;
+    {
+        SearchServer search_server("and"s);
+        search_server.SetDuplicateMode(SearchServer::DuplicateMode::REJECT);
+        search_server.AddDocument(1, first, DocumentStatus::ACTUAL, {1});
+        CHECK(!Throws<invalid_argument>([&] { search_server.AddDocument(2, second, DocumentStatus::ACTUAL, {1}); }));
+        CHECK(Throws<invalid_argument>([&] { search_server.AddDocument(3, copy, DocumentStatus::ACTUAL, {1}); }));
+        CHECK(search_server.GetDocumentCount() == 2);
+        search_server.SetDuplicateMode(SearchServer::DuplicateMode::ALLOW);
+        search_server.AddDocument(3, copy, DocumentStatus::ACTUAL, {1});
+        CHECK(RemoveDuplicates(search_server) == vector<int>{3});
+    }
+    {
+        SearchServer search_server("and"s);
+        search_server.SetDuplicateMode(SearchServer::DuplicateMode::FLAG);
+        search_server.AddDocuments(execution::par, { {1, first, DocumentStatus::ACTUAL, {1}}, {2, second, DocumentStatus::ACTUAL, {1}},
+                                                     {3, copy, DocumentStatus::ACTUAL, {1}} });
+        CHECK(!search_server.IsDuplicate(1) && !search_server.IsDuplicate(2) && search_server.IsDuplicate(3));
+    }
+    {
+        SearchServer search_server("and"s);
+        search_server.SetDuplicateMode(SearchServer::DuplicateMode::REJECT);
+        CHECK(!Throws<invalid_argument>([&] {
+            search_server.AddDocuments(execution::par, { {1, first, DocumentStatus::ACTUAL, {1}}, {2, second, DocumentStatus::ACTUAL, {1}} });
+        }));
+        CHECK(Throws<invalid_argument>([&] { search_server.AddDocuments({ {3, copy, DocumentStatus::ACTUAL, {1}} }); }));
+    }
+}
+
+// Adds copies of documents with an extra word and finds them as near duplicates
+void TestNearDuplicates(mt19937& generator, const vector<string>& dictionary, const vector<string>& documents) {
+    SearchServer search_server(dictionary[0]);
+    vector<string> copies;
+    for (size_t i = 0; i < documents.size(); i += 10) {
+        copies.push_back(documents[i] + " "s + GenerateQuery(generator, dictionary, 1));
+    }
+    for (size_t i = 0; i < documents.size(); ++i) {
+        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+    }
+    for (size_t i = 0; i < copies.size(); ++i) {
+        search_server.AddDocument(documents.size() + i, copies[i], DocumentStatus::ACTUAL, {1, 2, 3});
+    }
+    LOG_DURATION("remove near duplicates"s);
+    cout << RemoveNearDuplicates(search_server).size() << " of "s << copies.size() << " near duplicates removed"s << endl;
+}
+
 int main() {
     mt19937 generator;
     const auto dictionary = GenerateDictionary(generator, 1000, 10);
@@ -71,4 +800,41 @@ int main() {
     const auto queries = GenerateQueries(generator, dictionary, 100, 70);
     TEST(seq);
     TEST(par);
+    TestResultLimits(search_server, queries);
+
+    const auto memory_usage = search_server.GetMemoryUsage();
+    cout << "index memory: "s << memory_usage.GetTotal() / 1024 << " KB, terms "s << memory_usage.term_text_bytes / 1024
+         << " KB, dictionary "s << memory_usage.term_dictionary_bytes / 1024 << " KB, documents "s
+         << memory_usage.document_bytes / 1024 << " KB"s << endl;
+    cout << "flat postings: "s << search_server.GetPostingsMemoryUsage() / 1024 << " KB"s << endl;
+    search_server.SetPostingsCompression(true);
+    cout << "compressed postings: "s << search_server.GetPostingsMemoryUsage() / 1024 << " KB"s << endl;
+    TEST(seq);
+    TEST(par);
+    search_server.SetResultCacheCapacity(1000);
+    TEST(seq);
+    TEST(par);
+    const auto cache_stats = search_server.GetResultCacheStats();
+    cout << "result cache: "s << cache_stats.hit_count << " hits, "s << cache_stats.miss_count << " misses, "s
+         << cache_stats.contention_count << " contended locks"s << endl;
+    TestResultCacheKeys(search_server, queries);
+    TestCopy(search_server, documents, queries);
+    search_server.SetResultCacheCapacity(0);
+    search_server.GetQueryMetrics().WriteText(cout);
+    TestPostingsDecoding(generator);
+    TestThreadPool();
+    TestPersistentMap(generator);
+    TestRealtimeIndexing(dictionary, documents, queries);
+    TestCompaction(dictionary, documents, queries);
+    TestBulkLoad(dictionary, GenerateQueries(generator, dictionary, 100'000, 70));
+    TestIndexFile(search_server, queries);
+    TestFilteredSearch(dictionary, documents, queries);
+    TestSearchAfterPages(search_server, queries);
+    TestWildcardQueries(search_server, dictionary);
+    TestShardedSearch(search_server, dictionary, documents, queries);
+    TestBatchQueries(generator, search_server, dictionary);
+    TestDuplicates(dictionary, documents);
+    TestDuplicateWordSets();
+    TestNearDuplicates(generator, dictionary, documents);
+    TestTokenizer(documents, MakeUniqueNonEmptyStrings(SplitIntoWordsView(dictionary[0])));
 }
\ No newline at end of file
@@ -0,0 +1,140 @@
+#include "near_duplicates.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include "word_hash.h"
+
+using namespace std::string_literals;
+
+namespace {
+
+// Buckets larger than this compare their documents with the first one only, so a band shared by many
+// documents (empty texts, a common template) does not take quadratic time
+constexpr size_t MAX_PAIRWISE_BUCKET_SIZE = 32;
+
+// A fixed key keeps the signatures, and so the pairs found, the same from run to run
+constexpr WordHashKey SIGNATURE_KEY{ 0x6e65'6172'2d64'7570, 0x6d69'6e68'6173'6821 };
+
+// Distinct words of a document in word order, pointing into the forward index of the server
+using DocumentWords = std::vector<std::string_view>;
+
+// The i-th value is the minimum of the i-th hash function over the words
+std::vector<uint64_t> ComputeSignature(const DocumentWords& words, size_t signature_size) {
+    std::vector<uint64_t> signature(signature_size, std::numeric_limits<uint64_t>::max());
+    for (const std::string_view word : words) {
+        const uint64_t word_hash = HashWord(word, SIGNATURE_KEY);
+        for (size_t i = 0; i < signature_size; ++i) {
+            signature[i] = std::min(signature[i], Mix(word_hash + (i + 1) * 0x9e37'79b9'7f4a'7c15));
+        }
+    }
+    return signature;
+}
+
+// Both lists are sorted by word, so the intersection is a merge. Two empty sets are equal
+double ComputeJaccardSimilarity(const DocumentWords& lhs, const DocumentWords& rhs) {
+    if (lhs.empty() && rhs.empty()) {
+        return 1.0;
+    }
+    size_t common_count = 0;
+    for (auto lhs_it = lhs.begin(), rhs_it = rhs.begin(); lhs_it != lhs.end() && rhs_it != rhs.end();) {
+        if (*lhs_it < *rhs_it) {
+            ++lhs_it;
+        }
+        else if (*rhs_it < *lhs_it) {
+            ++rhs_it;
+        }
+        else {
+            ++common_count;
+            ++lhs_it;
+            ++rhs_it;
+        }
+    }
+    return common_count * 1.0 / (lhs.size() + rhs.size() - common_count);
+}
+
+} // namespace
+
+std::vector<NearDuplicatePair> FindNearDuplicates(const SearchServer& search_server, const NearDuplicateOptions& options) {
+    if (!(options.min_similarity > 0.0 && options.min_similarity <= 1.0)) {
+        throw std::invalid_argument("Similarity threshold must be in (0, 1]"s);
+    }
+    if (options.band_count == 0 || options.band_size == 0) {
+        throw std::invalid_argument("Signature must have at least one band of one value"s);
+    }
+    ThreadPool& thread_pool = search_server.GetThreadPool();
+    const std::vector<int> document_ids(search_server.begin(), search_server.end());
+    const size_t signature_size = options.band_count * options.band_size;
+
+    std::vector<DocumentWords> document_words(document_ids.size());
+    std::vector<std::vector<uint64_t>> signatures(document_ids.size());
+    thread_pool.ParallelFor(document_ids.size(), [&](size_t i) {
+        search_server.ForEachDocumentWord(document_ids[i], [&words = document_words[i]](std::string_view word, uint32_t) {
+            words.push_back(word);
+        });
+        signatures[i] = ComputeSignature(document_words[i], signature_size);
+    });
+
+    // Documents with equal hashes of a band fall into one bucket; every bucket gives candidate pairs
+    std::vector<std::vector<std::pair<size_t, size_t>>> band_candidates(options.band_count);
+    thread_pool.ParallelFor(options.band_count, [&](size_t band) {
+        std::vector<std::pair<uint64_t, size_t>> band_hashes(document_ids.size());
+        for (size_t i = 0; i < document_ids.size(); ++i) {
+            uint64_t hash = band;
+            for (size_t row = band * options.band_size; row < (band + 1) * options.band_size; ++row) {
+                hash = Mix(hash ^ signatures[i][row]);
+            }
+            band_hashes[i] = { hash, i };
+        }
+        std::sort(band_hashes.begin(), band_hashes.end());
+        auto& candidates = band_candidates[band];
+        for (auto it = band_hashes.begin(); it != band_hashes.end();) {
+            const auto bucket_end = std::find_if(it, band_hashes.end(), [it](const auto& entry) { return entry.first != it->first; });
+            const bool pairwise = static_cast<size_t>(bucket_end - it) <= MAX_PAIRWISE_BUCKET_SIZE;
+            for (auto first = it; first != bucket_end && (pairwise || first == it); ++first) {
+                for (auto second = first + 1; second != bucket_end; ++second) {
+                    candidates.emplace_back(first->second, second->second);   // indexes ascend with ids
+                }
+            }
+            it = bucket_end;
+        }
+    });
+
+    std::vector<std::pair<size_t, size_t>> candidates;
+    for (const auto& band : band_candidates) {
+        candidates.insert(candidates.end(), band.begin(), band.end());
+    }
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+    std::vector<double> similarities(candidates.size());
+    thread_pool.ParallelFor(candidates.size(), [&](size_t i) {
+        similarities[i] = ComputeJaccardSimilarity(document_words[candidates[i].first], document_words[candidates[i].second]);
+    });
+    std::vector<NearDuplicatePair> pairs;
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        if (similarities[i] >= options.min_similarity) {
+            pairs.push_back({ document_ids[candidates[i].first], document_ids[candidates[i].second], similarities[i] });
+        }
+    }
+    return pairs;
+}
+
+std::vector<int> RemoveNearDuplicates(SearchServer& search_server, const NearDuplicateOptions& options) {
+    auto pairs = FindNearDuplicates(search_server, options);
+    // Documents are decided in id order: one is removed if it is close to a kept document with a smaller id
+    std::sort(pairs.begin(), pairs.end(), [](const NearDuplicatePair& lhs, const NearDuplicatePair& rhs) {
+        return std::pair(lhs.second_id, lhs.first_id) < std::pair(rhs.second_id, rhs.first_id);
+    });
+    std::vector<int> removed_ids;
+    for (const NearDuplicatePair& pair : pairs) {
+        const bool is_removed = !removed_ids.empty() && removed_ids.back() == pair.second_id;
+        if (!is_removed && !std::binary_search(removed_ids.begin(), removed_ids.end(), pair.first_id)) {
+            removed_ids.push_back(pair.second_id);
+        }
+    }
+    for (const int document_id : removed_ids) {
+        search_server.RemoveDocument(document_id);
+    }
+    return removed_ids;
+}
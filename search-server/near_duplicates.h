@@ -0,0 +1,29 @@
+#pragma once
+
+#include <vector>
+#include "search_server.h"
+
+struct NearDuplicateOptions {
+    double min_similarity = 0.8;   // Jaccard similarity of the word sets, in (0, 1]
+    // The signature has band_count * band_size MinHash values. Pairs with the similarity s become
+    // candidates with the probability 1 - (1 - s^band_size)^band_count: about 0.95 for 0.8 by default
+    size_t band_count = 16;
+    size_t band_size = 8;
+};
+
+struct NearDuplicatePair {
+    int first_id;    // the smaller id
+    int second_id;
+    double similarity;
+};
+
+// Finds the pairs of documents whose word sets have at least options.min_similarity Jaccard similarity.
+// MinHash signatures are bucketed band by band (LSH), so only documents sharing a band are compared,
+// exactly, by their words. Signatures, bands and comparisons run on the thread pool of the server.
+// A pair may be missed with the small probability above. Returns the pairs sorted by ids
+std::vector<NearDuplicatePair> FindNearDuplicates(const SearchServer& search_server,
+                                                  const NearDuplicateOptions& options = {});
+
+// Removes every document that is a near duplicate of a kept document with a smaller id.
+// Returns the removed ids in ascending order
+std::vector<int> RemoveNearDuplicates(SearchServer& search_server, const NearDuplicateOptions& options = {});
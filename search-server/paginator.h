@@ -2,7 +2,11 @@
 
 #include <vector>
 #include <iostream>
+#include <execution>
 #include <iterator>
+#include <string>
+#include <utility>
+#include "document.h"
 
 template <typename Iterator>
 class IteratorRange {
@@ -73,3 +77,84 @@ template <typename Container>
 auto Paginate(const Container& c, size_t page_size) {
     return Paginator(begin(c), end(c), page_size);
 }
+
+// Pages fetched one at a time while iterating, for results too many to materialize.
+// fetch_page(previous_page) returns the page following previous_page, the first one for an empty page.
+// A page shorter than page_size is the last one. Single pass: begin() fetches the first page
+template <typename Page, typename FetchPage>
+class LazyPaginator {
+public:
+    class Iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = Page;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Page*;
+        using reference = const Page&;
+
+        Iterator() = default;
+
+        explicit Iterator(LazyPaginator* paginator)
+            : paginator_(paginator)
+        {
+        }
+
+        reference operator*() const { return paginator_->page_; }
+
+        pointer operator->() const { return &paginator_->page_; }
+
+        Iterator& operator++() {
+            paginator_->FetchNext();
+            return *this;
+        }
+
+        bool operator==(const Iterator& other) const { return IsEnd() == other.IsEnd(); }
+
+        bool operator!=(const Iterator& other) const { return !(*this == other); }
+
+    private:
+        LazyPaginator* paginator_ = nullptr;
+
+        bool IsEnd() const { return paginator_ == nullptr || paginator_->page_.empty(); }
+    };
+
+    LazyPaginator(FetchPage fetch_page, size_t page_size)
+        : fetch_page_(std::move(fetch_page)),
+        page_size_(page_size)
+    {
+    }
+
+    Iterator begin() {
+        page_ = fetch_page_(Page());
+        return Iterator(this);
+    }
+
+    Iterator end() {
+        return Iterator();
+    }
+
+private:
+    FetchPage fetch_page_;
+    size_t page_size_;
+    Page page_;
+
+    void FetchNext() {
+        page_ = page_.size() < page_size_ ? Page() : fetch_page_(page_);
+    }
+};
+
+// Pages of the results of a query, each found by a search-after query from the last document
+// of the previous page (see SearchServer::FindTopDocuments with a SearchCursor)
+template <typename ExecPolicy, typename Server>
+auto PaginateSearch(ExecPolicy policy, const Server& server, std::string raw_query, DocumentFilter filter, size_t page_size) {
+    auto fetch_page = [policy, &server, raw_query = std::move(raw_query), filter, page_size](const std::vector<Document>& previous_page) {
+        const SearchCursor after = previous_page.empty() ? SearchCursor() : SearchCursor(previous_page.back());
+        return server.FindTopDocuments(policy, raw_query, filter, page_size, after);
+    };
+    return LazyPaginator<std::vector<Document>, decltype(fetch_page)>(std::move(fetch_page), page_size);
+}
+
+template <typename Server>
+auto PaginateSearch(const Server& server, std::string raw_query, DocumentFilter filter, size_t page_size) {
+    return PaginateSearch(std::execution::seq, server, std::move(raw_query), filter, page_size);
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Hash map whose copies share everything they did not change, so copying it costs a pointer.
+// Keys are placed by their hash in a tree of LEVEL_COUNT levels of FANOUT children with small
+// leaves at the bottom. A change copies only the nodes on the path to its leaf, and only those
+// that another copy still holds: the nodes a map has copied once are its own and change in place.
+// A map must not be changed while another thread reads it, copies of it may be read meanwhile.
+// Lookups accept any type that Hash hashes and that compares equal to Key
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class PersistentMap {
+public:
+    size_t size() const { return size_; }
+
+    bool empty() const { return size_ == 0; }
+
+    template <typename LookupKey>
+    const Value* Find(const LookupKey& key) const {
+        const uint64_t hash = GetHash(key);
+        const Node* node = root_.get();
+        for (int level = 0; level < LEVEL_COUNT && node != nullptr; ++level) {
+            node = static_cast<const Inner*>(node)->children[GetChildIndex(hash, level)].get();
+        }
+        if (node == nullptr) {
+            return nullptr;
+        }
+        for (const auto& [entry_key, value] : static_cast<const Leaf*>(node)->entries) {
+            if (entry_key == key) {
+                return &value;
+            }
+        }
+        return nullptr;
+    }
+
+    template <typename LookupKey>
+    bool Contains(const LookupKey& key) const {
+        return Find(key) != nullptr;
+    }
+
+    // Value of the key, a default constructed one is inserted if there is none
+    template <typename LookupKey>
+    Value& operator[](const LookupKey& key) {
+        Leaf& leaf = GetOwnLeaf(GetHash(key));
+        for (auto& [entry_key, value] : leaf.entries) {
+            if (entry_key == key) {
+                return value;
+            }
+        }
+        ++size_;
+        return leaf.entries.emplace_back(Key(key), Value()).second;
+    }
+
+    // Returns false if there is no such key
+    template <typename LookupKey>
+    bool Erase(const LookupKey& key) {
+        if (!Contains(key)) {
+            return false;
+        }
+        auto& entries = GetOwnLeaf(GetHash(key)).entries;
+        for (auto& entry : entries) {
+            if (entry.first == key) {
+                std::swap(entry, entries.back());
+                entries.pop_back();
+                break;
+            }
+        }
+        --size_;
+        return true;
+    }
+
+private:
+    inline static constexpr int LEVEL_BITS = 4;
+    inline static constexpr int LEVEL_COUNT = 4;
+    inline static constexpr size_t FANOUT = size_t{ 1 } << LEVEL_BITS;
+
+    // Inner nodes and leaves are told apart by their level
+    struct Node {
+    };
+
+    struct Inner : Node {
+        std::array<std::shared_ptr<Node>, FANOUT> children;
+    };
+
+    struct Leaf : Node {
+        std::vector<std::pair<Key, Value>> entries;
+    };
+
+    std::shared_ptr<Node> root_;
+    size_t size_ = 0;
+
+    // Fibonacci hashing spreads hashes that differ in the low bits only, e.g. consecutive integers
+    template <typename LookupKey>
+    static uint64_t GetHash(const LookupKey& key) {
+        return static_cast<uint64_t>(Hash()(key)) * uint64_t{ 0x9E37'79B9'7F4A'7C15 };
+    }
+
+    static size_t GetChildIndex(uint64_t hash, int level) {
+        return static_cast<size_t>(hash >> (64 - LEVEL_BITS * (level + 1))) & (FANOUT - 1);
+    }
+
+    // Makes node one that this map alone holds: a new one, or a copy if another map shares it
+    template <typename T>
+    static T& Own(std::shared_ptr<Node>& node) {
+        if (!node) {
+            node = std::make_shared<T>();
+        }
+        else if (node.use_count() > 1) {
+            node = std::make_shared<T>(static_cast<const T&>(*node));
+        }
+        else {
+            // The maps that released the node are done reading it
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return static_cast<T&>(*node);
+    }
+
+    Leaf& GetOwnLeaf(uint64_t hash) {
+        std::shared_ptr<Node>* node = &root_;
+        for (int level = 0; level < LEVEL_COUNT; ++level) {
+            node = &Own<Inner>(*node).children[GetChildIndex(hash, level)];
+        }
+        return Own<Leaf>(*node);
+    }
+};
+
+// Set of keys with the sharing of PersistentMap
+template <typename Key, typename Hash = std::hash<Key>>
+class PersistentSet {
+public:
+    size_t size() const { return map_.size(); }
+
+    bool empty() const { return map_.empty(); }
+
+    template <typename LookupKey>
+    bool Contains(const LookupKey& key) const {
+        return map_.Contains(key);
+    }
+
+    void Insert(const Key& key) {
+        map_[key];
+    }
+
+    template <typename LookupKey>
+    bool Erase(const LookupKey& key) {
+        return map_.Erase(key);
+    }
+
+private:
+    struct Unit {
+    };
+
+    PersistentMap<Key, Unit, Hash> map_;
+};
@@ -0,0 +1,241 @@
+#include "posting_list.h"
+#include "index_file.h"
+
+#include <cmath>
+
+void PostingList::Append(DocumentOrdinal ordinal, uint32_t term_count, double term_freq) {
+    if (size_ % BLOCK_SIZE == 0) {
+        blocks_.push_back({ ordinal, term_freq });
+    }
+    else {
+        blocks_.back().last_ordinal = ordinal;
+        blocks_.back().max_term_freq = std::max(blocks_.back().max_term_freq, term_freq);
+    }
+    max_term_freq_ = std::max(max_term_freq_, term_freq);
+    ++size_;
+
+    ordinals_.push_back(ordinal);
+    if (compressed_) {
+        term_counts_.push_back(term_count);
+        if (ordinals_.size() == BLOCK_SIZE) {
+            EncodeLastBlock();
+        }
+    }
+    else {
+        term_freqs_.push_back(term_freq);
+    }
+}
+
+bool PostingList::Contains(DocumentOrdinal ordinal) const {
+    const size_t block_index = FindBlock(ordinal);
+    if (block_index == blocks_.size()) {
+        return false;
+    }
+    BlockBuffer buffer;
+    const Block block = GetBlock(block_index, &buffer, nullptr);
+    return std::binary_search(block.ordinals, block.ordinals + block.size, ordinal);
+}
+
+PostingList::Block PostingList::GetBlock(size_t block, BlockBuffer* buffer, const double* inverse_lengths) const {
+    const size_t begin = block * BLOCK_SIZE;
+    const size_t size = std::min(BLOCK_SIZE, size_ - begin);
+    if (!compressed_) {
+        return { ordinals_.data() + begin, term_freqs_.data() + begin, size };
+    }
+
+    const DocumentOrdinal* ordinals = ordinals_.data();
+    const uint32_t* term_counts = term_counts_.data();
+    if (block < block_offsets_.size()) {
+        const DocumentOrdinal base = block > 0 ? blocks_[block - 1].last_ordinal : 0;
+        const uint32_t* in = DecodeOrdinalBlock(encoded_.data() + block_offsets_[block], base, buffer->ordinals);
+        ordinals = buffer->ordinals;
+        if (inverse_lengths != nullptr) {
+            DecodeValueBlock(in, buffer->term_counts);
+            term_counts = buffer->term_counts;
+        }
+    }
+    if (inverse_lengths == nullptr) {
+        return { ordinals, nullptr, size };
+    }
+    for (size_t i = 0; i < size; ++i) {
+        buffer->term_freqs[i] = term_counts[i] * inverse_lengths[ordinals[i]];
+    }
+    return { ordinals, buffer->term_freqs, size };
+}
+
+void PostingList::Compress(const double* inverse_lengths) {
+    if (compressed_) {
+        return;
+    }
+    std::vector<DocumentOrdinal> ordinals;
+    std::vector<uint32_t> term_counts;
+    Decode(ordinals, term_counts, inverse_lengths);
+    compressed_ = true;
+    Assign(ordinals, term_counts, inverse_lengths);
+}
+
+void PostingList::Decompress(const double* inverse_lengths) {
+    if (!compressed_) {
+        return;
+    }
+    std::vector<DocumentOrdinal> ordinals;
+    std::vector<uint32_t> term_counts;
+    Decode(ordinals, term_counts, inverse_lengths);
+    compressed_ = false;
+    Assign(ordinals, term_counts, inverse_lengths);
+}
+
+size_t PostingList::GetMemoryUsage() const {
+    return ordinals_.capacity() * sizeof(DocumentOrdinal)
+           + term_freqs_.capacity() * sizeof(double)
+           + term_counts_.capacity() * sizeof(uint32_t)
+           + encoded_.capacity() * sizeof(uint32_t)
+           + block_offsets_.capacity() * sizeof(uint32_t)
+           + blocks_.capacity() * sizeof(BlockInfo);
+}
+
+void PostingList::Decode(std::vector<DocumentOrdinal>& ordinals, std::vector<uint32_t>& term_counts,
+                         const double* inverse_lengths) const {
+    ordinals.reserve(size_);
+    term_counts.reserve(size_);
+    if (!compressed_) {
+        ordinals.assign(ordinals_.begin(), ordinals_.end());
+        for (size_t i = 0; i < size_; ++i) {
+            term_counts.push_back(static_cast<uint32_t>(std::lround(term_freqs_[i] / inverse_lengths[ordinals_[i]])));
+        }
+        return;
+    }
+    BlockBuffer buffer;
+    for (size_t block = 0; block < block_offsets_.size(); ++block) {
+        const DocumentOrdinal base = block > 0 ? blocks_[block - 1].last_ordinal : 0;
+        const uint32_t* in = DecodeOrdinalBlock(encoded_.data() + block_offsets_[block], base, buffer.ordinals);
+        DecodeValueBlock(in, buffer.term_counts);
+        ordinals.insert(ordinals.end(), buffer.ordinals, buffer.ordinals + BLOCK_SIZE);
+        term_counts.insert(term_counts.end(), buffer.term_counts, buffer.term_counts + BLOCK_SIZE);
+    }
+    ordinals.insert(ordinals.end(), ordinals_.begin(), ordinals_.end());
+    term_counts.insert(term_counts.end(), term_counts_.begin(), term_counts_.end());
+}
+
+void PostingList::Save(IndexFileWriter& writer) const {
+    writer.Write(compressed_);
+    writer.Write<uint64_t>(size_);
+    writer.Write(max_term_freq_);
+    writer.WriteArray(ordinals_);
+    writer.WriteArray(term_freqs_);
+    writer.WriteArray(term_counts_);
+    writer.WriteArray(encoded_);
+    writer.WriteArray(block_offsets_);
+    writer.WriteArray(blocks_);
+}
+
+PostingList PostingList::Load(IndexFileReader& reader) {
+    PostingList postings(reader.Read<bool>());
+    postings.size_ = reader.Read<uint64_t>();
+    postings.max_term_freq_ = reader.Read<double>();
+    postings.ordinals_ = reader.ReadArray<DocumentOrdinal>();
+    postings.term_freqs_ = reader.ReadArray<double>();
+    postings.term_counts_ = reader.ReadArray<uint32_t>();
+    postings.encoded_ = reader.ReadArray<uint32_t>();
+    postings.block_offsets_ = reader.ReadArray<uint32_t>();
+    postings.blocks_ = reader.ReadArray<BlockInfo>();
+
+    const size_t tail_size = postings.compressed_ ? postings.size_ % BLOCK_SIZE : postings.size_;
+    if (postings.blocks_.size() != (postings.size_ + BLOCK_SIZE - 1) / BLOCK_SIZE
+        || postings.ordinals_.size() != tail_size
+        || (postings.compressed_ ? postings.term_counts_.size() : postings.term_freqs_.size()) != tail_size
+        || (postings.compressed_ && postings.block_offsets_.size() != postings.size_ / BLOCK_SIZE)) {
+        throw std::runtime_error("Index file is corrupted");
+    }
+    return postings;
+}
+
+void PostingList::Renumber(const DocumentOrdinal* new_ordinals, const double* old_inverse_lengths,
+                           const double* new_inverse_lengths) {
+    // Ordinals only move down, so a list whose last ordinal stays put is unchanged
+    if (blocks_.empty() || new_ordinals[blocks_.back().last_ordinal] == blocks_.back().last_ordinal) {
+        return;
+    }
+    std::vector<DocumentOrdinal> ordinals;
+    std::vector<uint32_t> term_counts;
+    Decode(ordinals, term_counts, old_inverse_lengths);
+    size_t kept = 0;
+    for (size_t i = 0; i < ordinals.size(); ++i) {
+        if (new_ordinals[ordinals[i]] != END_ORDINAL) {
+            ordinals[kept] = new_ordinals[ordinals[i]];
+            term_counts[kept] = term_counts[i];
+            ++kept;
+        }
+    }
+    ordinals.resize(kept);
+    term_counts.resize(kept);
+    Assign(ordinals, term_counts, new_inverse_lengths);
+}
+
+void PostingList::Assign(const std::vector<DocumentOrdinal>& ordinals, const std::vector<uint32_t>& term_counts,
+                         const double* inverse_lengths) {
+    const bool compressed = compressed_;
+    *this = PostingList(compressed);
+    for (size_t i = 0; i < ordinals.size(); ++i) {
+        Append(ordinals[i], term_counts[i], term_counts[i] * inverse_lengths[ordinals[i]]);
+    }
+    ordinals_.shrink_to_fit();
+    term_freqs_.shrink_to_fit();
+    encoded_.shrink_to_fit();
+}
+
+void PostingList::EncodeLastBlock() {
+    const size_t block = block_offsets_.size();
+    const DocumentOrdinal base = block > 0 ? blocks_[block - 1].last_ordinal : 0;
+    block_offsets_.push_back(static_cast<uint32_t>(encoded_.size()));
+    std::vector<uint32_t> encoded_block;
+    EncodeOrdinalBlock(ordinals_.data(), base, encoded_block);
+    EncodeValueBlock(term_counts_.data(), encoded_block);
+    encoded_.append(encoded_block.data(), encoded_block.size());
+    ordinals_.clear();
+    term_counts_.clear();
+}
+
+PostingList::Cursor::Cursor(const PostingList& postings, const double* inverse_lengths)
+    : postings_(&postings),
+    inverse_lengths_(inverse_lengths),
+    buffer_(postings.compressed_ ? std::make_unique<BlockBuffer>() : nullptr)
+{
+    LoadBlock(0);
+}
+
+void PostingList::Cursor::SkipTo(DocumentOrdinal ordinal) {
+    if (IsEnd() || block_.ordinals[pos_] >= ordinal) {
+        return;
+    }
+    // Whole blocks are skipped by their last ordinal, then the block is searched
+    const auto& blocks = postings_->blocks_;
+    size_t block_index = block_index_;
+    while (block_index < blocks.size() && blocks[block_index].last_ordinal < ordinal) {
+        ++block_index;
+    }
+    if (block_index != block_index_) {
+        LoadBlock(block_index);
+        if (IsEnd()) {
+            return;
+        }
+    }
+    pos_ = std::lower_bound(block_.ordinals + pos_, block_.ordinals + block_.size, ordinal) - block_.ordinals;
+}
+
+double PostingList::Cursor::GetBlockMaxTermFreq(DocumentOrdinal ordinal) {
+    const auto& blocks = postings_->blocks_;
+    bound_block_ = std::max(bound_block_, block_index_);
+    while (bound_block_ < blocks.size() && blocks[bound_block_].last_ordinal < ordinal) {
+        ++bound_block_;
+    }
+    return bound_block_ < blocks.size() ? blocks[bound_block_].max_term_freq : 0.0;
+}
+
+void PostingList::Cursor::LoadBlock(size_t block_index) {
+    block_index_ = block_index;
+    pos_ = 0;
+    if (!IsEnd()) {
+        block_ = postings_->GetBlock(block_index, buffer_.get(), inverse_lengths_);
+    }
+}
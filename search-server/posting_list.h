@@ -0,0 +1,182 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+#include "postings_codec.h"
+#include "storage_vector.h"
+
+class IndexFileWriter;
+class IndexFileReader;
+
+// Internal dense document number. Ordinals are handed out in insertion order,
+// so every posting list is sorted just by appending to it.
+using DocumentOrdinal = uint32_t;
+
+// Postings of a single term sorted by ordinal, so scoring a term is a linear scan over contiguous memory.
+// Postings are grouped in blocks of BLOCK_SIZE with the largest term frequency of every block,
+// which gives the query engine upper bounds to skip documents with.
+//
+// A list is kept in one of two formats:
+//  - flat: parallel arrays of ordinals and term frequencies;
+//  - compressed: full blocks are bit packed (see postings_codec.h) as ordinal deltas and term counts,
+//    only the last incomplete block stays plain. A term frequency is the term count divided
+//    by the document length, so it is restored exactly from inverse_lengths[ordinal] = 1 / length.
+// The arrays of a list loaded from an index file view the mapped file until the list is modified.
+class PostingList {
+public:
+    inline static constexpr size_t BLOCK_SIZE = CODEC_BLOCK_SIZE;
+    inline static constexpr DocumentOrdinal END_ORDINAL = std::numeric_limits<DocumentOrdinal>::max();
+
+    struct BlockInfo {
+        DocumentOrdinal last_ordinal;
+        double max_term_freq;
+    };
+
+    // Postings of one block. Points either into the list or into a BlockBuffer
+    struct Block {
+        const DocumentOrdinal* ordinals;
+        const double* term_freqs;
+        size_t size;
+    };
+
+    struct BlockBuffer {
+        DocumentOrdinal ordinals[BLOCK_SIZE];
+        uint32_t term_counts[BLOCK_SIZE];
+        double term_freqs[BLOCK_SIZE];
+    };
+
+    class Cursor;
+
+    PostingList() = default;
+
+    explicit PostingList(bool compressed)
+        : compressed_(compressed)
+    {
+    }
+
+    // Ordinal must be greater than any ordinal already in the list
+    void Append(DocumentOrdinal ordinal, uint32_t term_count, double term_freq);
+
+    // Moves every posting to the ordinal new_ordinals[ordinal], removing the ones mapped to END_ORDINAL.
+    // The kept ordinals must stay in order. Postings are read with old_inverse_lengths and written
+    // with new_inverse_lengths, which is indexed by the new ordinals
+    void Renumber(const DocumentOrdinal* new_ordinals, const double* old_inverse_lengths, const double* new_inverse_lengths);
+
+    bool Contains(DocumentOrdinal ordinal) const;
+
+    size_t Size() const {
+        return size_;
+    }
+
+    bool Empty() const {
+        return size_ == 0;
+    }
+
+    size_t GetBlockCount() const {
+        return blocks_.size();
+    }
+
+    const StorageVector<BlockInfo>& GetBlocks() const {
+        return blocks_;
+    }
+
+    // Index of the first block that may contain the ordinal or a greater one
+    size_t FindBlock(DocumentOrdinal ordinal) const {
+        return std::partition_point(blocks_.begin(), blocks_.end(), [ordinal](const BlockInfo& block) {
+            return block.last_ordinal < ordinal;
+        }) - blocks_.begin();
+    }
+
+    // Returns the postings of a block. buffer receives decoded postings of a compressed list
+    // and may be null for a flat one. Term frequencies are not restored when inverse_lengths is null
+    Block GetBlock(size_t block, BlockBuffer* buffer, const double* inverse_lengths) const;
+
+    double GetMaxTermFreq() const {
+        return max_term_freq_;
+    }
+
+    bool IsCompressed() const {
+        return compressed_;
+    }
+
+    void Compress(const double* inverse_lengths);
+
+    void Decompress(const double* inverse_lengths);
+
+    // Heap bytes owned by the list, arrays viewing a mapped file are not counted
+    size_t GetMemoryUsage() const;
+
+    void Save(IndexFileWriter& writer) const;
+
+    // The list views the memory of the reader's file
+    static PostingList Load(IndexFileReader& reader);
+
+private:
+    bool compressed_ = false;
+    size_t size_ = 0;
+    // All postings of a flat list, the postings of the incomplete last block of a compressed one
+    StorageVector<DocumentOrdinal> ordinals_;
+    StorageVector<double> term_freqs_;        // flat format
+    StorageVector<uint32_t> term_counts_;     // compressed format
+    StorageVector<uint32_t> encoded_;         // compressed format, full blocks
+    StorageVector<uint32_t> block_offsets_;   // compressed format, position of every full block in encoded_
+    StorageVector<BlockInfo> blocks_;
+    double max_term_freq_ = 0.0;
+
+    // Extracts all postings as ordinals and term counts
+    void Decode(std::vector<DocumentOrdinal>& ordinals, std::vector<uint32_t>& term_counts,
+                const double* inverse_lengths) const;
+
+    // Replaces the content of the list keeping its format
+    void Assign(const std::vector<DocumentOrdinal>& ordinals, const std::vector<uint32_t>& term_counts,
+                const double* inverse_lengths);
+
+    void EncodeLastBlock();
+};
+
+// Forward-only iterator over a posting list for document-at-a-time scoring
+class PostingList::Cursor {
+public:
+    // Term frequencies are available only with inverse_lengths
+    Cursor(const PostingList& postings, const double* inverse_lengths);
+
+    bool IsEnd() const {
+        return block_index_ >= postings_->blocks_.size();
+    }
+
+    // END_ORDINAL once the cursor is exhausted
+    DocumentOrdinal GetOrdinal() const {
+        return IsEnd() ? END_ORDINAL : block_.ordinals[pos_];
+    }
+
+    double GetTermFreq() const {
+        return block_.term_freqs[pos_];
+    }
+
+    void Next() {
+        if (++pos_ == block_.size) {
+            LoadBlock(block_index_ + 1);
+        }
+    }
+
+    // Moves to the first posting with an ordinal not less than the given one
+    void SkipTo(DocumentOrdinal ordinal);
+
+    // Largest term frequency of the block that may contain the ordinal. Does not decode anything,
+    // so checking the bound costs nothing when the document turns out to be hopeless
+    double GetBlockMaxTermFreq(DocumentOrdinal ordinal);
+
+private:
+    const PostingList* postings_;
+    const double* inverse_lengths_;
+    std::unique_ptr<BlockBuffer> buffer_;   // compressed lists only
+    Block block_ = {};
+    size_t block_index_ = 0;
+    size_t pos_ = 0;
+    size_t bound_block_ = 0;
+
+    void LoadBlock(size_t block_index);
+};
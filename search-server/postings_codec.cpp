@@ -0,0 +1,117 @@
+#include "postings_codec.h"
+
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+constexpr size_t LANE_COUNT = 4;
+constexpr size_t LANE_LENGTH = CODEC_BLOCK_SIZE / LANE_COUNT;
+
+uint32_t BitWidth(uint32_t value) {
+    uint32_t width = 1;   // a block is never packed with 0 bits, the header stays meaningful
+    while (width < 32 && (value >> width) != 0) {
+        ++width;
+    }
+    return width;
+}
+
+void PackBlock(const uint32_t* values, std::vector<uint32_t>& out) {
+    const uint32_t width = BitWidth(*std::max_element(values, values + CODEC_BLOCK_SIZE));
+    out.push_back(width);
+    const size_t words_begin = out.size();
+    out.resize(words_begin + LANE_COUNT * width, 0);
+    uint32_t* words = out.data() + words_begin;
+
+    for (size_t lane = 0; lane < LANE_COUNT; ++lane) {
+        for (size_t j = 0; j < LANE_LENGTH; ++j) {
+            const uint32_t value = values[j * LANE_COUNT + lane];
+            const size_t bit = j * width;
+            const size_t word = bit / 32;
+            const uint32_t shift = bit % 32;
+            words[word * LANE_COUNT + lane] |= value << shift;
+            if (shift + width > 32) {
+                words[(word + 1) * LANE_COUNT + lane] |= value >> (32 - shift);
+            }
+        }
+    }
+}
+
+// Unpacks a block; with PrefixSum every lane value is added to the previous value of the lane
+template <bool PrefixSum>
+const uint32_t* UnpackBlock(const uint32_t* in, uint32_t base, uint32_t* values) {
+    const uint32_t width = *in++;
+    const uint32_t* words = in;
+
+#if defined(__SSE2__)
+    const __m128i mask = _mm_set1_epi32(width == 32 ? ~0u : (1u << width) - 1);
+    __m128i previous = _mm_set1_epi32(static_cast<int>(base));
+    for (size_t j = 0; j < LANE_LENGTH; ++j) {
+        const size_t bit = j * width;
+        const size_t word = bit / 32;
+        const uint32_t shift = bit % 32;
+        __m128i lanes = _mm_srl_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(words + word * LANE_COUNT)),
+                                      _mm_cvtsi32_si128(static_cast<int>(shift)));
+        if (shift + width > 32) {
+            const __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i*>(words + (word + 1) * LANE_COUNT));
+            lanes = _mm_or_si128(lanes, _mm_sll_epi32(next, _mm_cvtsi32_si128(static_cast<int>(32 - shift))));
+        }
+        lanes = _mm_and_si128(lanes, mask);
+        if constexpr (PrefixSum) {
+            lanes = _mm_add_epi32(lanes, previous);
+            previous = lanes;
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(values + j * LANE_COUNT), lanes);
+    }
+#else
+    const uint32_t mask = width == 32 ? ~0u : (1u << width) - 1;
+    for (size_t lane = 0; lane < LANE_COUNT; ++lane) {
+        uint32_t previous = base;
+        for (size_t j = 0; j < LANE_LENGTH; ++j) {
+            const size_t bit = j * width;
+            const size_t word = bit / 32;
+            const uint32_t shift = bit % 32;
+            uint32_t value = words[word * LANE_COUNT + lane] >> shift;
+            if (shift + width > 32) {
+                value |= words[(word + 1) * LANE_COUNT + lane] << (32 - shift);
+            }
+            value &= mask;
+            if constexpr (PrefixSum) {
+                value += previous;
+                previous = value;
+            }
+            values[j * LANE_COUNT + lane] = value;
+        }
+    }
+#endif
+    return words + LANE_COUNT * width;
+}
+
+} // namespace
+
+void EncodeOrdinalBlock(const uint32_t* ordinals, uint32_t base, std::vector<uint32_t>& out) {
+    uint32_t deltas[CODEC_BLOCK_SIZE];
+    for (size_t i = 0; i < CODEC_BLOCK_SIZE; ++i) {
+        deltas[i] = ordinals[i] - (i < LANE_COUNT ? base : ordinals[i - LANE_COUNT]);
+    }
+    PackBlock(deltas, out);
+}
+
+void EncodeValueBlock(const uint32_t* values, std::vector<uint32_t>& out) {
+    PackBlock(values, out);
+}
+
+const uint32_t* DecodeOrdinalBlock(const uint32_t* in, uint32_t base, uint32_t* ordinals) {
+    return UnpackBlock<true>(in, base, ordinals);
+}
+
+const uint32_t* DecodeValueBlock(const uint32_t* in, uint32_t* values) {
+    return UnpackBlock<false>(in, 0, values);
+}
+
+const uint32_t* SkipEncodedBlock(const uint32_t* in) {
+    return in + 1 + LANE_COUNT * *in;
+}
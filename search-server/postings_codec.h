@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Bit packing of posting blocks of exactly CODEC_BLOCK_SIZE values (SIMD-BP128 layout).
+// A block is viewed as 32 vectors of 4 lanes; every lane packs its 32 values with the same bit width,
+// and lane words are interleaved so that one 128-bit load feeds all four lanes.
+// Sorted ordinals are stored as differences with the value 4 positions earlier (D4 deltas),
+// which turns decoding into a lane-wise prefix sum. Decoding uses SSE2 where available.
+inline constexpr size_t CODEC_BLOCK_SIZE = 128;
+
+// Appends a block of ascending ordinals. base must be less than the first ordinal
+void EncodeOrdinalBlock(const uint32_t* ordinals, uint32_t base, std::vector<uint32_t>& out);
+
+// Appends a block of arbitrary values (term counts)
+void EncodeValueBlock(const uint32_t* values, std::vector<uint32_t>& out);
+
+// Decode a block written at in, return the position right after it
+const uint32_t* DecodeOrdinalBlock(const uint32_t* in, uint32_t base, uint32_t* ordinals);
+const uint32_t* DecodeValueBlock(const uint32_t* in, uint32_t* values);
+
+// Skips an encoded block without decoding it
+const uint32_t* SkipEncodedBlock(const uint32_t* in);
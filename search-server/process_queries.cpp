@@ -4,21 +4,16 @@
 
 std::vector<std::vector<Document>> ProcessQueries(const SearchServer& search_server, const std::vector<std::string>& queries)
 {
-    std::vector<std::vector<Document>> result;
-    result.resize(queries.size());
-    std::transform(std::execution::par, queries.begin(), queries.end(), result.begin(),
-                   [&search_server](const std::string_view query) {
-        return search_server.FindTopDocuments(query);
-        });
-    return result;
+    // The batch shares the work of repeated queries and common words between the queries
+    return search_server.FindTopDocumentsBatch(queries);
 }
 
 std::vector<Document> ProcessQueriesJoined(const SearchServer& search_server, const std::vector<std::string>& queries)
 {
+    // Streamed straight into the joined vector, the per-query results are never all kept at once
     std::vector<Document> documents_joined;
-    for (auto &documents : ProcessQueries(search_server, queries)) {
-        for (auto &doc : documents)
-            documents_joined.push_back(doc);
-    }
+    ProcessQueriesStreamed(search_server, queries, [&documents_joined](Document&& document) {
+        documents_joined.push_back(std::move(document));
+        });
     return documents_joined;
-}
\ No newline at end of file
+}
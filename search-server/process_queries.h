@@ -1,9 +1,196 @@
 #pragma once
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
 #include "search_server.h"
 
+// ProcessQueriesStreamed holds the results of at most this many queries at a time
+inline constexpr size_t QUERY_WINDOW_SIZE = 1024;
+
 std::vector<std::vector<Document>> ProcessQueries(const SearchServer& search_server,
     const std::vector<std::string>& queries);
 
 std::vector<Document> ProcessQueriesJoined(
     const SearchServer& search_server,
     const std::vector<std::string>& queries);
+
+// Shared by the caller of ProcessQueriesStreamed and its helper tasks on the pool. A helper may
+// start after the call returned, so it finds the state closed and touches nothing else
+template <typename Sink>
+class QueryStream : public std::enable_shared_from_this<QueryStream<Sink>> {
+public:
+    QueryStream(const SearchServer& search_server, const std::vector<std::string>& queries, Sink sink, size_t window_size)
+        : search_server_(search_server),
+        queries_(queries),
+        sink_(std::move(sink)),
+        window_size_(window_size),
+        thread_pool_(search_server.GetThreadPool()),
+        // Two chunks per thread in a window keep the threads busy while the cursor catches up
+        chunk_size_(std::max<size_t>(1, window_size / (2 * (thread_pool_.GetWorkerCount() + 1)))),
+        chunk_count_((queries.size() + chunk_size_ - 1) / chunk_size_),
+        results_(window_size),
+        ready_(window_size, 0)
+    {
+    }
+
+    // Runs the chunks on the calling thread and the helpers, returns when every result is handed out
+    void Run() {
+        std::unique_lock lock(mutex_);
+        AddHelpers();
+        try {
+            while (true) {
+                RunChunks(lock);
+                if (error_ || cursor_ == queries_.size()) {
+                    break;
+                }
+                // The window is full: the cursor moves once the chunks at it are done and handed out
+                changed_.wait(lock, [this] { return error_ || CanTakeChunk() || cursor_ == queries_.size(); });
+            }
+        }
+        catch (...) {
+            SetError(lock);
+        }
+        changed_.wait(lock, [this] { return busy_count_ == 0 && !emitting_; });
+        closed_ = true;
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+    }
+
+private:
+    const SearchServer& search_server_;
+    const std::vector<std::string>& queries_;
+    Sink sink_;
+    const size_t window_size_;
+    ThreadPool& thread_pool_;
+    const size_t chunk_size_;
+    const size_t chunk_count_;
+
+    std::mutex mutex_;   // guards everything below and the slots
+    std::condition_variable changed_;
+    std::vector<std::vector<Document>> results_;   // of query i in slot i % window_size_
+    std::vector<char> ready_;
+    size_t next_chunk_ = 0;     // chunks are taken in order
+    size_t cursor_ = 0;         // first query not handed out
+    size_t busy_count_ = 0;     // chunks being run
+    size_t helper_count_ = 0;   // helpers submitted and not done
+    bool emitting_ = false;     // a thread is handing out results
+    bool closed_ = false;       // Run returned, helpers still queued leave at once
+    std::exception_ptr error_;  // a chunk or the sink threw, no more chunks are taken
+
+    bool CanTakeChunk() const {
+        return next_chunk_ < chunk_count_
+            && std::min(queries_.size(), (next_chunk_ + 1) * chunk_size_) - cursor_ <= window_size_;
+    }
+
+    // Helpers take the chunks that fit in the window and leave instead of waiting for the cursor,
+    // so no worker is held while the window is full. The thread moving the cursor adds them again
+    void AddHelpers() {
+        if (!CanTakeChunk()) {
+            return;
+        }
+        const size_t wanted = std::min(thread_pool_.GetWorkerCount(), chunk_count_ - next_chunk_);
+        for (; helper_count_ < wanted; ++helper_count_) {
+            thread_pool_.Submit([stream = this->shared_from_this()] { stream->RunHelper(); });
+        }
+    }
+
+    void RunHelper() {
+        std::unique_lock lock(mutex_);
+        if (!closed_) {
+            try {
+                RunChunks(lock);
+            }
+            catch (...) {
+                SetError(lock);
+            }
+        }
+        --helper_count_;
+    }
+
+    // Takes chunks while they fit in the window, hands out the results ready at the cursor
+    void RunChunks(std::unique_lock<std::mutex>& lock) {
+        while (!error_ && CanTakeChunk()) {
+            const size_t begin = next_chunk_ * chunk_size_;
+            const size_t end = std::min(queries_.size(), begin + chunk_size_);
+            ++next_chunk_;
+            ++busy_count_;
+            lock.unlock();
+            std::vector<std::vector<Document>> chunk_results;
+            try {
+                const std::vector<std::string_view> chunk_queries(queries_.begin() + begin, queries_.begin() + end);
+                chunk_results = search_server_.FindTopDocumentsBatch(std::execution::seq, chunk_queries);
+            }
+            catch (...) {
+                lock.lock();
+                --busy_count_;
+                throw;
+            }
+            lock.lock();
+            --busy_count_;
+            for (size_t i = begin; i < end; ++i) {
+                results_[i % window_size_] = std::move(chunk_results[i - begin]);
+                ready_[i % window_size_] = 1;
+            }
+            if (!emitting_) {
+                Emit(lock);
+            }
+        }
+    }
+
+    void Emit(std::unique_lock<std::mutex>& lock) {
+        emitting_ = true;
+        try {
+            while (!error_ && cursor_ < queries_.size() && ready_[cursor_ % window_size_]) {
+                std::vector<Document> documents = std::move(results_[cursor_ % window_size_]);
+                ready_[cursor_ % window_size_] = 0;
+                ++cursor_;
+                AddHelpers();
+                lock.unlock();
+                changed_.notify_all();
+                for (Document& document : documents) {
+                    sink_(std::move(document));
+                }
+                lock.lock();
+            }
+        }
+        catch (...) {
+            if (!lock.owns_lock()) {
+                lock.lock();
+            }
+            emitting_ = false;
+            throw;
+        }
+        emitting_ = false;
+        changed_.notify_all();
+    }
+
+    // Called with the lock held, keeps the first error
+    void SetError(std::unique_lock<std::mutex>& lock) {
+        if (!error_) {
+            error_ = std::current_exception();
+        }
+        lock.unlock();
+        changed_.notify_all();
+        lock.lock();
+    }
+};
+
+// Calls sink(document) for the results of every query in query order without collecting them.
+// Queries run in chunks, every chunk as one sequential batch, on the calling thread and on helper
+// tasks of the server's thread pool. The thread that finishes a chunk hands out the ready queries
+// from the cursor on while the others keep running. Chunks are taken in order and only while they
+// end at most window_size queries past the cursor, so at most a window of results is kept whatever
+// the number of queries. A helper finding the window full leaves rather than waits, so no worker
+// of the pool is held and sink may use the pool itself. sink is called on the calling thread or
+// on the workers, one call at a time
+template <typename Sink>
+void ProcessQueriesStreamed(const SearchServer& search_server, const std::vector<std::string>& queries, Sink sink,
+                            size_t window_size = QUERY_WINDOW_SIZE) {
+    if (queries.empty()) {
+        return;
+    }
+    window_size = std::clamp<size_t>(window_size, 1, queries.size());
+    std::make_shared<QueryStream<Sink>>(search_server, queries, std::move(sink), window_size)->Run();
+}
@@ -0,0 +1,149 @@
+#include "query_metrics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+using namespace std::literals;
+
+void LatencyHistogram::Record(uint64_t nanoseconds) {
+    bucket_counts_[GetBucket(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(nanoseconds, std::memory_order_relaxed);
+    uint64_t max = max_.load(std::memory_order_relaxed);
+    while (nanoseconds > max && !max_.compare_exchange_weak(max, nanoseconds, std::memory_order_relaxed)) {
+    }
+}
+
+double LatencyHistogram::GetMean() const {
+    const uint64_t count = GetCount();
+    return count == 0 ? 0.0 : sum_.load(std::memory_order_relaxed) * 1.0 / count;
+}
+
+uint64_t LatencyHistogram::GetPercentile(double fraction) const {
+    const uint64_t count = GetCount();
+    if (count == 0) {
+        return 0;
+    }
+    const auto rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(std::clamp(fraction, 0.0, 1.0) * count)));
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+        seen += bucket_counts_[bucket].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return std::min(GetBucketUpperBound(bucket), GetMax());
+        }
+    }
+    return GetMax();   // samples recorded while reading
+}
+
+void LatencyHistogram::Reset() {
+    for (auto& bucket_count : bucket_counts_) {
+        bucket_count.store(0, std::memory_order_relaxed);
+    }
+    count_.store(0, std::memory_order_relaxed);
+    sum_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+}
+
+// Values below SUB_BUCKET_COUNT have a bucket each. A greater value with the highest bit b
+// falls into sub-bucket by the SUB_BUCKET_BITS bits below b of the group b - SUB_BUCKET_BITS + 1
+size_t LatencyHistogram::GetBucket(uint64_t value) {
+    if (value < SUB_BUCKET_COUNT) {
+        return static_cast<size_t>(value);
+    }
+    const int highest_bit = 63 - __builtin_clzll(value);
+    const int shift = highest_bit - SUB_BUCKET_BITS;
+    const size_t group = shift + 1;
+    return group * SUB_BUCKET_COUNT + ((value >> shift) & (SUB_BUCKET_COUNT - 1));
+}
+
+uint64_t LatencyHistogram::GetBucketUpperBound(size_t bucket) {
+    if (bucket < SUB_BUCKET_COUNT) {
+        return bucket;
+    }
+    const size_t shift = bucket / SUB_BUCKET_COUNT - 1;
+    const uint64_t lower = (SUB_BUCKET_COUNT + bucket % SUB_BUCKET_COUNT) << shift;
+    return lower + ((uint64_t{1} << shift) - 1);
+}
+
+void QueryMetrics::Reset() {
+    for (LatencyHistogram& histogram : histograms_) {
+        histogram.Reset();
+    }
+    for (auto& counter : counters_) {
+        counter.store(0, std::memory_order_relaxed);
+    }
+}
+
+QueryMetrics& QueryMetrics::GetDefault() {
+    static QueryMetrics metrics;
+    return metrics;
+}
+
+void QueryMetrics::WriteText(std::ostream& output) const {
+    const auto flags = output.flags();
+    output << std::fixed << std::setprecision(3);
+    for (size_t i = 0; i < STAGE_COUNT; ++i) {
+        const LatencyHistogram& histogram = histograms_[i];
+        output << GetName(static_cast<QueryStage>(i)) << ": count "sv << histogram.GetCount()
+               << ", mean "sv << histogram.GetMean() / 1e3 << " us, p50 "sv << histogram.GetPercentile(0.5) / 1e3
+               << " us, p99 "sv << histogram.GetPercentile(0.99) / 1e3 << " us, max "sv << histogram.GetMax() / 1e3
+               << " us\n"sv;
+    }
+    for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+        output << GetName(static_cast<QueryCounter>(i)) << ": "sv << counters_[i].load(std::memory_order_relaxed) << '\n';
+    }
+    output.flags(flags);
+}
+
+void QueryMetrics::WriteJson(std::ostream& output) const {
+    const auto flags = output.flags();
+    output << std::fixed << std::setprecision(3) << "{\"stages\": {"sv;
+    for (size_t i = 0; i < STAGE_COUNT; ++i) {
+        const LatencyHistogram& histogram = histograms_[i];
+        output << (i > 0 ? ", "sv : ""sv) << '"' << GetName(static_cast<QueryStage>(i)) << "\": {\"count\": "sv
+               << histogram.GetCount() << ", \"mean_us\": "sv << histogram.GetMean() / 1e3
+               << ", \"p50_us\": "sv << histogram.GetPercentile(0.5) / 1e3
+               << ", \"p99_us\": "sv << histogram.GetPercentile(0.99) / 1e3
+               << ", \"max_us\": "sv << histogram.GetMax() / 1e3 << '}';
+    }
+    output << "}, \"counters\": {"sv;
+    for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+        output << (i > 0 ? ", "sv : ""sv) << '"' << GetName(static_cast<QueryCounter>(i)) << "\": "sv
+               << counters_[i].load(std::memory_order_relaxed);
+    }
+    output << "}}"sv;
+    output.flags(flags);
+}
+
+std::string_view QueryMetrics::GetName(QueryStage stage) {
+    switch (stage) {
+    case QueryStage::QUERY:
+        return "query"sv;
+    case QueryStage::PARSE:
+        return "parse"sv;
+    case QueryStage::SCORE:
+        return "score"sv;
+    case QueryStage::MINUS_FILTER:
+        return "minus_filter"sv;
+    case QueryStage::TOP_K:
+        return "top_k"sv;
+    case QueryStage::SORT:
+        return "sort"sv;
+    case QueryStage::BATCH:
+        return "batch"sv;
+    }
+    return "unknown"sv;
+}
+
+std::string_view QueryMetrics::GetName(QueryCounter counter) {
+    switch (counter) {
+    case QueryCounter::QUERIES:
+        return "queries"sv;
+    case QueryCounter::POSTINGS_SCANNED:
+        return "postings_scanned"sv;
+    case QueryCounter::DOCUMENTS_SCORED:
+        return "documents_scored"sv;
+    }
+    return "unknown"sv;
+}
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string_view>
+
+// Instrumentation of query processing: latency histograms by stage and event counters.
+// Defining SEARCH_SERVER_DISABLE_METRICS compiles the recording macros to nothing
+
+// Lock-free histogram of durations in nanoseconds. Buckets are HDR-style: 16 linear sub-buckets
+// per power of two, so a percentile is off by at most 1/16 of its value
+class LatencyHistogram {
+public:
+    void Record(uint64_t nanoseconds);
+
+    uint64_t GetCount() const { return count_.load(std::memory_order_relaxed); }
+
+    uint64_t GetMax() const { return max_.load(std::memory_order_relaxed); }
+
+    double GetMean() const;
+
+    // Upper bound of the bucket holding the value of the given rank, fraction in [0, 1]
+    uint64_t GetPercentile(double fraction) const;
+
+    void Reset();
+
+private:
+    inline static constexpr int SUB_BUCKET_BITS = 4;
+    inline static constexpr size_t SUB_BUCKET_COUNT = size_t{1} << SUB_BUCKET_BITS;
+    inline static constexpr size_t BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+
+    std::array<std::atomic<uint64_t>, BUCKET_COUNT> bucket_counts_ = {};
+    std::atomic<uint64_t> count_ = 0;
+    std::atomic<uint64_t> sum_ = 0;
+    std::atomic<uint64_t> max_ = 0;
+
+    static size_t GetBucket(uint64_t value);
+    static uint64_t GetBucketUpperBound(size_t bucket);
+};
+
+// The scoring stages are recorded per range of ordinals scored by one thread
+enum class QueryStage {
+    QUERY,          // whole FindTopDocuments
+    PARSE,
+    SCORE,          // walking the postings of the plus words
+    MINUS_FILTER,   // excluding documents with minus words
+    TOP_K,          // selecting the best scored documents
+    SORT,           // ordering the selected documents
+    BATCH,          // whole FindTopDocumentsBatch
+};
+
+enum class QueryCounter {
+    QUERIES,
+    POSTINGS_SCANNED,
+    DOCUMENTS_SCORED,   // documents offered to the top
+};
+
+class QueryMetrics {
+public:
+#ifdef SEARCH_SERVER_DISABLE_METRICS
+    inline static constexpr bool IS_ENABLED = false;
+#else
+    inline static constexpr bool IS_ENABLED = true;
+#endif
+
+    void Record(QueryStage stage, uint64_t nanoseconds) {
+        histograms_[static_cast<size_t>(stage)].Record(nanoseconds);
+    }
+
+    void Add(QueryCounter counter, uint64_t value) {
+        counters_[static_cast<size_t>(counter)].fetch_add(value, std::memory_order_relaxed);
+    }
+
+    const LatencyHistogram& GetHistogram(QueryStage stage) const {
+        return histograms_[static_cast<size_t>(stage)];
+    }
+
+    uint64_t GetCounter(QueryCounter counter) const {
+        return counters_[static_cast<size_t>(counter)].load(std::memory_order_relaxed);
+    }
+
+    void Reset();
+
+    // A line per stage with count, mean, p50, p99 and max in microseconds, then a line per counter
+    void WriteText(std::ostream& output) const;
+
+    // {"stages": {"parse": {"count": N, "mean_us": X, "p50_us": X, "p99_us": X, "max_us": X}, ...}, "counters": {...}}
+    void WriteJson(std::ostream& output) const;
+
+    static std::string_view GetName(QueryStage stage);
+    static std::string_view GetName(QueryCounter counter);
+
+    // Metrics shared by the servers that are not given their own
+    static QueryMetrics& GetDefault();
+
+private:
+    inline static constexpr size_t STAGE_COUNT = static_cast<size_t>(QueryStage::BATCH) + 1;
+    inline static constexpr size_t COUNTER_COUNT = static_cast<size_t>(QueryCounter::DOCUMENTS_SCORED) + 1;
+
+    std::array<LatencyHistogram, STAGE_COUNT> histograms_;
+    std::array<std::atomic<uint64_t>, COUNTER_COUNT> counters_ = {};
+};
+
+// Total time of the sections of a stage that interleave with another stage, recorded as one sample.
+// Sections may be as short as a few reads of the clock, so only one in SAMPLE_PERIOD is timed and
+// the total is estimated from the mean of the timed ones
+class StageStopwatch {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    inline static constexpr uint64_t SAMPLE_PERIOD = 64;
+
+    // Adds the time from construction to destruction to the stopwatch if the section is sampled
+    class Section {
+    public:
+        explicit Section(StageStopwatch& stopwatch)
+            : stopwatch_(stopwatch),
+            sampled_(stopwatch.section_count_++ % SAMPLE_PERIOD == 0)
+        {
+            if (sampled_) {
+                start_time_ = Clock::now();
+            }
+        }
+
+        Section(const Section&) = delete;
+        Section& operator=(const Section&) = delete;
+
+        ~Section() {
+            if (sampled_) {
+                stopwatch_.sampled_nanoseconds_ +=
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_time_).count();
+            }
+        }
+
+    private:
+        StageStopwatch& stopwatch_;
+        const bool sampled_;
+        Clock::time_point start_time_;
+    };
+
+    uint64_t GetNanoseconds() const {
+        const uint64_t sampled_count = (section_count_ + SAMPLE_PERIOD - 1) / SAMPLE_PERIOD;
+        return sampled_count == 0 ? 0 : sampled_nanoseconds_ * section_count_ / sampled_count;
+    }
+
+private:
+    uint64_t section_count_ = 0;
+    uint64_t sampled_nanoseconds_ = 0;
+};
+
+// Records the time from construction to destruction as a sample of the stage,
+// less the time of the excluded stopwatch
+class StageTimer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    StageTimer(QueryMetrics& metrics, QueryStage stage, const StageStopwatch* excluded = nullptr)
+        : metrics_(metrics),
+        stage_(stage),
+        excluded_(excluded)
+    {
+    }
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+    ~StageTimer() {
+        const auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_time_);
+        const uint64_t nanoseconds = static_cast<uint64_t>(duration.count());
+        // The excluded time is an estimate and may exceed the measured one
+        const uint64_t excluded_nanoseconds = excluded_ != nullptr ? std::min(excluded_->GetNanoseconds(), nanoseconds) : 0;
+        metrics_.Record(stage_, nanoseconds - excluded_nanoseconds);
+    }
+
+private:
+    QueryMetrics& metrics_;
+    QueryStage stage_;
+    const StageStopwatch* excluded_;
+    const Clock::time_point start_time_ = Clock::now();
+};
+
+// Locks the mutex, counting the times it was held by another thread. The counter is
+// changed under the lock, so it needs no synchronization of its own
+template <typename Mutex>
+std::unique_lock<Mutex> LockCountingContention(Mutex& mutex, [[maybe_unused]] uint64_t& contention_count) {
+#ifdef SEARCH_SERVER_DISABLE_METRICS
+    return std::unique_lock<Mutex>(mutex);
+#else
+    std::unique_lock<Mutex> lock(mutex, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        lock.lock();
+        ++contention_count;
+    }
+    return lock;
+#endif
+}
+
+#define METRICS_CONCAT_INTERNAL(X, Y) X##Y
+#define METRICS_CONCAT(X, Y) METRICS_CONCAT_INTERNAL(X, Y)
+
+// A stage interleaved with another one: QUERY_METRICS_STOPWATCH declares a stopwatch, QUERY_METRICS_SECTION
+// times a section of the stage into it, QUERY_METRICS_STAGE_EXCLUDING times the enclosing stage without
+// the sections and QUERY_METRICS_RECORD records the stopwatch as one sample
+#ifdef SEARCH_SERVER_DISABLE_METRICS
+#define QUERY_METRICS_STAGE(metrics, stage)
+#define QUERY_METRICS_ADD(metrics, counter, value)
+#define QUERY_METRICS_STOPWATCH(name)
+#define QUERY_METRICS_SECTION(stopwatch)
+#define QUERY_METRICS_STAGE_EXCLUDING(metrics, stage, stopwatch)
+#define QUERY_METRICS_RECORD(metrics, stage, stopwatch)
+#else
+#define QUERY_METRICS_STAGE(metrics, stage) StageTimer METRICS_CONCAT(stageTimer, __LINE__)((metrics), (stage))
+#define QUERY_METRICS_ADD(metrics, counter, value) (metrics).Add((counter), (value))
+#define QUERY_METRICS_STOPWATCH(name) StageStopwatch name
+#define QUERY_METRICS_SECTION(stopwatch) StageStopwatch::Section METRICS_CONCAT(stopwatchSection, __LINE__)(stopwatch)
+#define QUERY_METRICS_STAGE_EXCLUDING(metrics, stage, stopwatch) \
+    StageTimer METRICS_CONCAT(stageTimer, __LINE__)((metrics), (stage), &(stopwatch))
+#define QUERY_METRICS_RECORD(metrics, stage, stopwatch) (metrics).Record((stage), (stopwatch).GetNanoseconds())
+#endif
@@ -0,0 +1,81 @@
+#include "query_result_cache.h"
+
+#include <algorithm>
+#include <functional>
+
+namespace {
+
+// Every bucket holds at least one result
+size_t GetBucketCount(size_t capacity, size_t bucket_count) {
+    return std::max<size_t>(1, std::min(capacity, bucket_count));
+}
+
+} // namespace
+
+QueryResultCache::QueryResultCache(size_t capacity, size_t bucket_count)
+    : capacity_(capacity),
+    bucket_capacity_(std::max<size_t>(1, capacity / GetBucketCount(capacity, bucket_count))),
+    buckets_(GetBucketCount(capacity, bucket_count))
+{
+}
+
+std::optional<std::vector<Document>> QueryResultCache::Find(const Key& key, uint64_t generation) {
+    Bucket& bucket = GetBucket(key);
+    const auto guard = LockCountingContention(bucket.mutex, bucket.contention_count);
+    const auto it = bucket.index.find(key);
+    if (it == bucket.index.end() || it->second->generation != generation) {
+        ++bucket.miss_count;
+        return std::nullopt;
+    }
+    ++bucket.hit_count;
+    bucket.entries.splice(bucket.entries.begin(), bucket.entries, it->second);
+    return it->second->documents;
+}
+
+void QueryResultCache::Insert(const Key& key, uint64_t generation, std::vector<Document> documents) {
+    Bucket& bucket = GetBucket(key);
+    const auto guard = LockCountingContention(bucket.mutex, bucket.contention_count);
+    const auto it = bucket.index.find(key);
+    if (it != bucket.index.end()) {   // a stale entry or a result computed by a parallel query
+        it->second->generation = generation;
+        it->second->documents = std::move(documents);
+        bucket.entries.splice(bucket.entries.begin(), bucket.entries, it->second);
+        return;
+    }
+    if (bucket.entries.size() >= bucket_capacity_) {
+        if (bucket.entries.empty()) {
+            return;
+        }
+        bucket.index.erase(bucket.entries.back().key);
+        bucket.entries.pop_back();
+    }
+    bucket.entries.push_front({ key, generation, std::move(documents) });
+    bucket.index.emplace(key, bucket.entries.begin());
+}
+
+QueryResultCache::Stats QueryResultCache::GetStats() const {
+    Stats stats;
+    for (const Bucket& bucket : buckets_) {
+        std::lock_guard guard(bucket.mutex);
+        stats.hit_count += bucket.hit_count;
+        stats.miss_count += bucket.miss_count;
+        stats.size += bucket.entries.size();
+        stats.contention_count += bucket.contention_count;
+    }
+    return stats;
+}
+
+void QueryResultCache::Clear() {
+    for (Bucket& bucket : buckets_) {
+        std::lock_guard guard(bucket.mutex);
+        bucket.index.clear();
+        bucket.entries.clear();
+    }
+}
+
+size_t QueryResultCache::KeyHash::operator()(const Key& key) const {
+    size_t hash = std::hash<std::string>()(key.query);
+    hash = hash * 37 + std::hash<std::string>()(key.predicate_key);
+    hash = hash * 37 + static_cast<size_t>(key.status + 1);
+    return hash * 37 + key.max_result_count;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "document.h"
+#include "query_metrics.h"
+
+// Thread-safe LRU cache of search results. Keys are split between buckets with a lock and
+// an LRU list of their own, so parallel queries rarely wait for each other.
+// Every entry remembers the index generation it was computed for and is a miss for any other
+// generation, so a modification of the index invalidates the whole cache at once
+class QueryResultCache {
+public:
+    inline static constexpr size_t DEFAULT_BUCKET_COUNT = 16;
+
+    struct Key {
+        std::string query;           // plus words, then minus words with '-', sorted and deduplicated
+        int status = -1;             // DocumentStatus, -1 for a predicate
+        std::string predicate_key;   // identifies the predicate
+        size_t max_result_count = 0;
+
+        bool operator==(const Key& other) const {
+            return query == other.query && status == other.status
+                   && predicate_key == other.predicate_key && max_result_count == other.max_result_count;
+        }
+    };
+
+    struct Stats {
+        uint64_t hit_count = 0;
+        uint64_t miss_count = 0;
+        size_t size = 0;
+        uint64_t contention_count = 0;   // lookups and inserts that waited for another thread, 0 without metrics
+    };
+
+    // Holds at most capacity results, a small capacity gets fewer buckets
+    explicit QueryResultCache(size_t capacity, size_t bucket_count = DEFAULT_BUCKET_COUNT);
+
+    std::optional<std::vector<Document>> Find(const Key& key, uint64_t generation);
+
+    void Insert(const Key& key, uint64_t generation, std::vector<Document> documents);
+
+    Stats GetStats() const;
+
+    // The capacity it was created with
+    size_t GetCapacity() const { return capacity_; }
+
+    void Clear();
+
+private:
+    struct KeyHash {
+        size_t operator()(const Key& key) const;
+    };
+
+    struct Entry {
+        Key key;
+        uint64_t generation;
+        std::vector<Document> documents;
+    };
+
+    struct Bucket {
+        mutable std::mutex mutex;
+        std::list<Entry> entries;   // the most recently used first
+        std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index;
+        uint64_t hit_count = 0;
+        uint64_t miss_count = 0;
+        uint64_t contention_count = 0;
+    };
+
+    size_t capacity_;
+    size_t bucket_capacity_;
+    std::vector<Bucket> buckets_;
+
+    Bucket& GetBucket(const Key& key) {
+        return buckets_[KeyHash()(key) % buckets_.size()];
+    }
+};
@@ -0,0 +1,372 @@
+#include "realtime_search_server.h"
+
+RealtimeSearchServer::~RealtimeSearchServer() {
+    std::unique_lock lock(merge_mutex_);
+    stopping_ = true;
+    merge_done_.wait(lock, [this] { return !merge_running_; });
+}
+
+void RealtimeSearchServer::AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings) {
+    std::lock_guard guard(write_mutex_);
+    const auto current = GetSnapshot();
+    if (current->HasDocument(document_id)) {
+        throw std::invalid_argument("Document with this id already exists");
+    }
+
+    auto next = std::make_shared<Snapshot>(*current);
+    if (next->deleted_document_ids_.Contains(document_id)) {
+        // The old version of the document must leave its segment, ids are unique within a snapshot
+        if (next->buffer_->positions.count(document_id) > 0) {
+            SealBuffer(*next);
+        }
+        for (const auto& segment : next->segments_) {
+            if (segment.server->HasDocument(document_id)) {
+                const SegmentList rebuilt{ segment.server };
+                ReplaceSegments(*next, rebuilt, BuildMergedSegment(rebuilt, *next));
+                break;
+            }
+        }
+    }
+
+    Buffer& buffer = *next->buffer_;
+    {
+        std::unique_lock lock(buffer.mutex);
+        buffer.segment->AddDocument(document_id, document, status, ratings);   // validates before anything is changed
+        buffer.positions.emplace(document_id, buffer.document_ids.size());
+        buffer.document_ids.push_back(document_id);
+    }
+    next->buffer_document_count_ = buffer.document_ids.size();
+    ++next->document_count_;
+    ++next->generation_;
+    if (next->buffer_document_count_ >= BUFFER_DOCUMENT_COUNT) {
+        SealBuffer(*next);
+    }
+    const bool has_merge = !PickMerge(*next).empty();
+    Publish(std::move(next));
+    if (has_merge) {
+        ScheduleMerges();
+    }
+}
+
+void RealtimeSearchServer::RemoveDocument(int document_id) {
+    std::lock_guard guard(write_mutex_);
+    const auto current = GetSnapshot();
+    const Snapshot::Segment* segment = current->FindSegment(document_id);
+    // The writer is the only one to change the buffer
+    const bool is_buffered = segment == nullptr && !current->deleted_document_ids_.Contains(document_id)
+                             && current->buffer_->positions.count(document_id) > 0;
+    if (segment == nullptr && !is_buffered) {
+        return;
+    }
+
+    auto next = std::make_shared<Snapshot>(*current);
+    const SearchServer& server = is_buffered ? *current->buffer_->segment : *segment->server;
+    if (is_buffered) {
+        ++next->buffer_deleted_document_count_;
+    }
+    else {
+        ++next->segments_[static_cast<size_t>(segment - current->segments_.data())].deleted_document_count;
+    }
+    next->deleted_document_ids_.Insert(document_id);
+    server.ForEachDocumentWord(document_id, [&next](std::string_view word, uint32_t) {
+        ++next->deleted_word_document_counts_[word];
+    });
+    --next->document_count_;
+    ++next->generation_;
+
+    const bool has_merge = !PickMerge(*next).empty();
+    Publish(std::move(next));
+    if (has_merge) {
+        ScheduleMerges();
+    }
+}
+
+void RealtimeSearchServer::WaitForMerges() {
+    std::unique_lock lock(merge_mutex_);
+    merge_done_.wait(lock, [this] { return !merge_running_; });
+}
+
+std::vector<Document> RealtimeSearchServer::FindTopDocuments(const std::string_view raw_query, DocumentStatus status,
+                                                             size_t max_result_count) const {
+    return GetSnapshot()->FindTopDocuments(raw_query, status, max_result_count);
+}
+
+int RealtimeSearchServer::GetDocumentCount() const {
+    return GetSnapshot()->GetDocumentCount();
+}
+
+std::shared_ptr<SearchServer> RealtimeSearchServer::MakeSegment() const {
+    auto segment = std::make_shared<SearchServer>(stop_words_);
+    segment->SetQueryMetrics(query_metrics_);
+    return segment;
+}
+
+std::shared_ptr<RealtimeSearchServer::Buffer> RealtimeSearchServer::MakeBuffer() const {
+    auto buffer = std::make_shared<Buffer>();
+    buffer->segment = MakeSegment();
+    return buffer;
+}
+
+std::shared_ptr<const RealtimeSearchServer::Snapshot> RealtimeSearchServer::MakeEmptySnapshot() const {
+    auto snapshot = std::make_shared<Snapshot>();
+    snapshot->buffer_ = MakeBuffer();
+    return snapshot;
+}
+
+void RealtimeSearchServer::SealBuffer(Snapshot& snapshot) const {
+    // Versions that still hold the buffer keep reading it, no one writes to it anymore
+    snapshot.segments_.push_back({ snapshot.buffer_->segment, snapshot.buffer_deleted_document_count_ });
+    snapshot.buffer_ = MakeBuffer();
+    snapshot.buffer_document_count_ = 0;
+    snapshot.buffer_deleted_document_count_ = 0;
+}
+
+RealtimeSearchServer::SegmentList RealtimeSearchServer::PickMerge(const Snapshot& snapshot) {
+    const auto& segments = snapshot.segments_;
+    // Tombstones cost a lookup per scored document, rebuild the segment with the most of them once they pile up
+    if (snapshot.deleted_document_ids_.size() > MAX_DELETED_DOCUMENTS_RATIO * snapshot.document_count_) {
+        const auto most_deleted = std::max_element(segments.begin(), segments.end(), [](const auto& lhs, const auto& rhs) {
+            return lhs.deleted_document_count < rhs.deleted_document_count;
+        });
+        if (most_deleted != segments.end() && most_deleted->deleted_document_count > 0) {
+            return { most_deleted->server };
+        }
+    }
+
+    // Level of a segment is log(document count) in base MERGE_FACTOR
+    const auto get_level = [](const SearchServer& segment) {
+        int level = 0;
+        for (int document_count = segment.GetDocumentCount(); document_count >= static_cast<int>(MERGE_FACTOR); document_count /= MERGE_FACTOR) {
+            ++level;
+        }
+        return level;
+    };
+    if (segments.size() < MERGE_FACTOR) {
+        return {};
+    }
+    const auto first = segments.end() - MERGE_FACTOR;
+    const int level = get_level(*first->server);
+    if (!std::all_of(first + 1, segments.end(), [&](const auto& segment) { return get_level(*segment.server) >= level; })) {
+        return {};
+    }
+    SegmentList merged_segments;
+    for (auto it = first; it != segments.end(); ++it) {
+        merged_segments.push_back(it->server);
+    }
+    return merged_segments;
+}
+
+RealtimeSearchServer::MergedSegment RealtimeSearchServer::BuildMergedSegment(const SegmentList& segments, const Snapshot& snapshot) const {
+    MergedSegment merged{ MakeSegment(), {} };
+    for (const auto& segment : segments) {
+        merged.segment->AddDocuments(*segment, [&](int document_id, [[maybe_unused]] DocumentStatus status, [[maybe_unused]] int rating) {
+            if (snapshot.deleted_document_ids_.Contains(document_id)) {
+                merged.dropped_document_ids.push_back(document_id);
+                segment->ForEachDocumentWord(document_id, [&merged](std::string_view word, uint32_t) {
+                    ++merged.dropped_word_document_counts[word];
+                });
+                return false;
+            }
+            return true;
+        });
+    }
+    return merged;
+}
+
+bool RealtimeSearchServer::ReplaceSegments(Snapshot& snapshot, const SegmentList& segments, const MergedSegment& merged) {
+    auto& current = snapshot.segments_;
+    std::vector<size_t> positions;
+    // Documents removed after the merge had started stay in the merged segment along with their tombstones
+    size_t deleted_document_count = 0;
+    for (const auto& segment : segments) {
+        const size_t position = snapshot.FindSegmentPosition(segment);
+        if (position == current.size()) {
+            return false;
+        }
+        positions.push_back(position);
+        deleted_document_count += current[position].deleted_document_count;
+    }
+    deleted_document_count -= merged.dropped_document_ids.size();
+
+    // Removed documents are gone physically now, their tombstones are not needed anymore
+    for (const int document_id : merged.dropped_document_ids) {
+        snapshot.deleted_document_ids_.Erase(document_id);
+    }
+    for (const auto& [word, document_count] : merged.dropped_word_document_counts) {
+        if ((snapshot.deleted_word_document_counts_[word] -= document_count) == 0) {
+            snapshot.deleted_word_document_counts_.Erase(word);
+        }
+    }
+
+    // The merged segment takes the place of the first one, the order of segments does not affect results
+    const size_t first = *std::min_element(positions.begin(), positions.end());
+    std::vector<Snapshot::Segment> next_segments;
+    next_segments.reserve(current.size() - segments.size() + 1);
+    for (size_t i = 0; i < current.size(); ++i) {
+        if (i == first && merged.segment->GetDocumentCount() > 0) {
+            next_segments.push_back({ merged.segment, deleted_document_count });
+        }
+        if (std::find(positions.begin(), positions.end(), i) == positions.end()) {
+            next_segments.push_back(current[i]);
+        }
+    }
+    current = std::move(next_segments);
+    return true;
+}
+
+void RealtimeSearchServer::ScheduleMerges() {
+    std::lock_guard guard(merge_mutex_);
+    merge_requested_ = true;
+    if (merge_running_ || stopping_) {
+        return;
+    }
+    merge_running_ = true;
+    if (!thread_pool_) {
+        thread_pool_ = std::make_shared<ThreadPool>(1);
+    }
+    thread_pool_->Submit([this] { RunMerges(); });
+}
+
+void RealtimeSearchServer::RunMerges() {
+    while (true) {
+        {
+            std::lock_guard guard(merge_mutex_);
+            if (stopping_ || !merge_requested_) {
+                merge_running_ = false;
+                merge_done_.notify_all();
+                return;
+            }
+            merge_requested_ = false;
+        }
+        try {
+            while (MergeOnce()) {
+                std::lock_guard guard(merge_mutex_);
+                if (stopping_) {
+                    break;
+                }
+            }
+        }
+        catch (...) {
+            // A failed merge leaves the segments as they were, queries stay correct without it
+        }
+    }
+}
+
+bool RealtimeSearchServer::MergeOnce() {
+    const auto snapshot = GetSnapshot();
+    const SegmentList segments = PickMerge(*snapshot);
+    if (segments.empty()) {
+        return false;
+    }
+    const MergedSegment merged = BuildMergedSegment(segments, *snapshot);
+
+    std::lock_guard guard(write_mutex_);
+    auto next = std::make_shared<Snapshot>(*GetSnapshot());
+    // A writer may have rebuilt one of the segments meanwhile, the next round picks again
+    if (ReplaceSegments(*next, segments, merged)) {
+        Publish(std::move(next));
+    }
+    return true;
+}
+
+void RealtimeSearchServer::Publish(std::shared_ptr<const Snapshot> snapshot) {
+    std::atomic_store(&snapshot_, std::move(snapshot));
+}
+
+bool RealtimeSearchServer::Snapshot::HasDocument(int document_id) const {
+    if (FindSegment(document_id) != nullptr) {
+        return true;
+    }
+    if (buffer_document_count_ == 0 || deleted_document_ids_.Contains(document_id)) {
+        return false;
+    }
+    std::shared_lock lock(buffer_->mutex);
+    return IsBuffered(document_id);
+}
+
+bool RealtimeSearchServer::Snapshot::IsBuffered(int document_id) const {
+    const auto it = buffer_->positions.find(document_id);
+    return it != buffer_->positions.end() && it->second < buffer_document_count_;
+}
+
+const RealtimeSearchServer::Snapshot::Segment* RealtimeSearchServer::Snapshot::FindSegment(int document_id) const {
+    if (deleted_document_ids_.Contains(document_id)) {
+        return nullptr;
+    }
+    for (const Segment& segment : segments_) {
+        if (segment.server->HasDocument(document_id)) {
+            return &segment;
+        }
+    }
+    return nullptr;
+}
+
+size_t RealtimeSearchServer::Snapshot::FindSegmentPosition(const std::shared_ptr<const SearchServer>& server) const {
+    const auto it = std::find_if(segments_.begin(), segments_.end(), [&server](const Segment& segment) {
+        return segment.server == server;
+    });
+    return static_cast<size_t>(it - segments_.begin());
+}
+
+std::tuple<std::vector<std::string_view>, DocumentStatus> RealtimeSearchServer::Snapshot::MatchDocument(
+        const std::string_view raw_query, int document_id) const {
+    if (const Segment* segment = FindSegment(document_id)) {
+        return segment->server->MatchDocument(raw_query, document_id);
+    }
+    if (!deleted_document_ids_.Contains(document_id)) {
+        std::shared_lock lock(buffer_->mutex);
+        if (IsBuffered(document_id)) {
+            return buffer_->segment->MatchDocument(raw_query, document_id);
+        }
+    }
+    throw std::invalid_argument("Document with this id does not exist");
+}
+
+CorpusStatistics RealtimeSearchServer::Snapshot::CollectStatistics(const std::string_view raw_query) const {
+    CorpusStatistics corpus_statistics;
+    corpus_statistics.document_count = document_count_;
+    std::shared_lock lock(buffer_->mutex);
+    // The buffer counts the documents added after this version too
+    std::map<std::string_view, int> newer_word_document_counts;
+    for (size_t i = buffer_document_count_; i < buffer_->document_ids.size(); ++i) {
+        buffer_->segment->ForEachDocumentWord(buffer_->document_ids[i], [&](std::string_view word, uint32_t) {
+            ++newer_word_document_counts[word];
+        });
+    }
+    const auto add_word = [&](std::string_view word) {
+        const auto [it, inserted] = corpus_statistics.document_freqs.emplace(word, 0);
+        if (!inserted) {
+            return;
+        }
+        for (const Segment& segment : segments_) {
+            it->second += segment.server->GetWordDocumentCount(word);
+        }
+        it->second += buffer_->segment->GetWordDocumentCount(word);
+        const auto newer_it = newer_word_document_counts.find(word);
+        if (newer_it != newer_word_document_counts.end()) {
+            it->second -= newer_it->second;
+        }
+        if (const int* deleted_count = deleted_word_document_counts_.Find(word)) {
+            it->second -= *deleted_count;
+        }
+    };
+    for (std::string_view word : SplitIntoWordsView(raw_query)) {
+        if (!word.empty() && word[0] == '-') {
+            word.remove_prefix(1);
+        }
+        if (!IsWildcardPattern(word)) {
+            add_word(word);
+            continue;
+        }
+        // Segments expand the pattern into the words of their own dictionaries
+        for (const Segment& segment : segments_) {
+            for (const std::string_view matching_word : segment.server->FindMatchingWords(word)) {
+                add_word(matching_word);
+            }
+        }
+        for (const std::string_view matching_word : buffer_->segment->FindMatchingWords(word)) {
+            add_word(matching_word);
+        }
+    }
+    return corpus_statistics;
+}
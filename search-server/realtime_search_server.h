@@ -0,0 +1,261 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include "persistent_map.h"
+#include "search_server.h"
+
+// Index that takes AddDocument/RemoveDocument while queries keep running.
+// New documents go to a buffer: a mutable SearchServer segment that is sealed once it holds
+// BUFFER_DOCUMENT_COUNT documents. Sealed segments are immutable. Every change publishes a new
+// Snapshot (a version of the segment list) with an atomic pointer swap. A reader pins the current
+// snapshot and queries the sealed segments without locks, so ingestion does not stall queries.
+// The buffer is guarded by a shared mutex, which a writer holds to append one document and
+// a reader holds while it scores the buffer; a snapshot sees only the buffered documents added
+// before it, so it stays a consistent version. Writers are serialized by a mutex.
+//
+// MERGE_FACTOR sealed segments of the same size level are merged into one of the next level, so
+// a document is copied O(log N) times and a query visits O(log N) segments. Merges run on a thread
+// of their own, off the writer path and off the pool of the queries: a merge reads immutable segments
+// only, and its result is published with the snapshot swap unless a writer has replaced one of its
+// segments meanwhile. Removed documents are hidden by per-snapshot tombstones until their segment
+// is rebuilt; versions share the tombstones they have in common, so a removal copies a few nodes.
+// Queries are scored with the IDF of all live documents, so results are the same as with
+// one SearchServer holding them.
+class RealtimeSearchServer {
+public:
+    class Snapshot;
+
+    template <typename StringContainer>
+    explicit RealtimeSearchServer(const StringContainer& stop_words)
+        : stop_words_(MakeUniqueNonEmptyStrings(stop_words))
+    {
+        SearchServer validator(stop_words_);   // throws on invalid stop words
+        snapshot_ = MakeEmptySnapshot();
+    }
+
+    explicit RealtimeSearchServer(const std::string_view stop_words_text)
+        : RealtimeSearchServer(SplitIntoWordsView(stop_words_text))
+    {
+    }
+
+    explicit RealtimeSearchServer(const std::string& stop_words_text)
+        : RealtimeSearchServer(std::string_view(stop_words_text))
+    {
+    }
+
+    RealtimeSearchServer(const RealtimeSearchServer&) = delete;
+    RealtimeSearchServer& operator=(const RealtimeSearchServer&) = delete;
+
+    // Waits for the running merge
+    ~RealtimeSearchServer();
+
+    void AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+
+    void RemoveDocument(int document_id);
+
+    // Merges run on this pool instead of a thread of their own, which is started by the first merge.
+    // A pool that queries wait on runs merges in the middle of them
+    void SetThreadPool(std::shared_ptr<ThreadPool> thread_pool) {
+        std::lock_guard guard(merge_mutex_);
+        thread_pool_ = std::move(thread_pool);
+    }
+
+    // Returns once the merges and rebuilds due for the published snapshot are done
+    void WaitForMerges();
+
+    // Current version of the index. It stays valid and unchanged for as long as it is held
+    std::shared_ptr<const Snapshot> GetSnapshot() const {
+        return std::atomic_load(&snapshot_);
+    }
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate,
+                                           size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL,
+                                           size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    int GetDocumentCount() const;
+
+    // Queries of all segments are recorded together
+    const QueryMetrics& GetQueryMetrics() const {
+        return query_metrics_ ? *query_metrics_ : QueryMetrics::GetDefault();
+    }
+
+private:
+    struct Buffer;
+    using SegmentList = std::vector<std::shared_ptr<const SearchServer>>;
+
+    // Segment built from others and the removed documents it left out
+    struct MergedSegment {
+        std::shared_ptr<SearchServer> segment;
+        std::vector<int> dropped_document_ids;
+        // Words of the dropped documents, counted before the writers are locked out. Point into the segments
+        std::unordered_map<std::string_view, int> dropped_word_document_counts;
+    };
+
+    // Segments with removed documents are rebuilt once tombstones exceed this share of live documents
+    inline static constexpr double MAX_DELETED_DOCUMENTS_RATIO = 0.125;
+    inline static constexpr size_t MERGE_FACTOR = 4;
+    inline static constexpr size_t BUFFER_DOCUMENT_COUNT = 256;
+
+    std::set<std::string, std::less<>> stop_words_;
+    std::shared_ptr<const Snapshot> snapshot_;   // accessed with std::atomic_load/atomic_store only
+    std::mutex write_mutex_;
+    // Shared by the segments, null when metrics are compiled out
+    std::shared_ptr<QueryMetrics> query_metrics_ = QueryMetrics::IS_ENABLED ? std::make_shared<QueryMetrics>() : nullptr;
+    std::shared_ptr<ThreadPool> thread_pool_;   // a pool of one worker unless set, guarded by merge_mutex_
+
+    // At most one merge task runs at a time, it keeps merging while merges are due
+    std::mutex merge_mutex_;
+    std::condition_variable merge_done_;
+    bool merge_running_ = false;
+    bool merge_requested_ = false;
+    bool stopping_ = false;
+
+    std::shared_ptr<SearchServer> MakeSegment() const;
+
+    std::shared_ptr<Buffer> MakeBuffer() const;
+
+    std::shared_ptr<const Snapshot> MakeEmptySnapshot() const;
+
+    // Makes the buffer of the snapshot a sealed segment and starts an empty one
+    void SealBuffer(Snapshot& snapshot) const;
+
+    // Segments of the next merge or rebuild due, empty if none is
+    static SegmentList PickMerge(const Snapshot& snapshot);
+
+    // One segment of the documents of segments that are not removed
+    MergedSegment BuildMergedSegment(const SegmentList& segments, const Snapshot& snapshot) const;
+
+    // Puts the merged segment in place of segments and drops the tombstones of the documents it left out.
+    // Returns false and changes nothing if the snapshot does not have all of segments anymore
+    static bool ReplaceSegments(Snapshot& snapshot, const SegmentList& segments, const MergedSegment& merged);
+
+    // Starts the merge task unless it is running. Called by writers after publishing
+    void ScheduleMerges();
+
+    void RunMerges();
+
+    // Builds and publishes the next merge due, returns false if none is
+    bool MergeOnce();
+
+    void Publish(std::shared_ptr<const Snapshot> snapshot);
+};
+
+// Only the writer holding write_mutex_ changes a buffer, and it stops when the buffer is sealed
+struct RealtimeSearchServer::Buffer {
+    mutable std::shared_mutex mutex;
+    std::shared_ptr<SearchServer> segment;
+    std::unordered_map<int, size_t> positions;   // by id, documents are numbered in the order of adding
+    std::vector<int> document_ids;   // by position
+};
+
+class RealtimeSearchServer::Snapshot {
+public:
+    // Incremented by every change of the index
+    uint64_t GetGeneration() const { return generation_; }
+
+    int GetDocumentCount() const { return document_count_; }
+
+    // Sealed segments, the buffer is not counted
+    size_t GetSegmentCount() const { return segments_.size(); }
+
+    // Removed documents still held by segments or the buffer
+    size_t GetDeletedDocumentCount() const { return deleted_document_ids_.size(); }
+
+    size_t GetBufferDocumentCount() const { return buffer_document_count_; }
+
+    bool HasDocument(int document_id) const;
+
+    template <typename ExecPolicy, typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(ExecPolicy&& policy, const std::string_view raw_query, DocumentPredicate document_predicate,
+                                           size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const {
+        const CorpusStatistics corpus_statistics = CollectStatistics(raw_query);
+        const auto live_document_predicate = [this, &document_predicate](int document_id, DocumentStatus status, int rating) {
+            return !deleted_document_ids_.Contains(document_id) && document_predicate(document_id, status, rating);
+        };
+        TopDocuments top_documents(max_result_count);
+        for (const Segment& segment : segments_) {
+            for (const Document& document : segment.server->FindTopDocuments(policy, raw_query, live_document_predicate,
+                                                                              max_result_count, corpus_statistics)) {
+                top_documents.Push(document);
+            }
+        }
+        if (buffer_document_count_ > 0) {
+            std::shared_lock lock(buffer_->mutex);
+            const auto buffered_document_predicate = [this, &live_document_predicate](int document_id, DocumentStatus status, int rating) {
+                return IsBuffered(document_id) && live_document_predicate(document_id, status, rating);
+            };
+            // The buffer is small, scoring it in parallel is not worth the tasks
+            for (const Document& document : buffer_->segment->FindTopDocuments(std::execution::seq, raw_query, buffered_document_predicate,
+                                                                               max_result_count, corpus_statistics)) {
+                top_documents.Push(document);
+            }
+        }
+        return std::move(top_documents).Extract();
+    }
+
+    template <typename ExecPolicy>
+    std::vector<Document> FindTopDocuments(ExecPolicy&& policy, const std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL,
+                                           size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const {
+        return FindTopDocuments(policy, raw_query, [status](
+                [[maybe_unused]] int document_id, DocumentStatus document_status, [[maybe_unused]] int rating) {
+            return document_status == status;
+        }, max_result_count);
+    }
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate,
+                                           size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const {
+        return FindTopDocuments(std::execution::seq, raw_query, document_predicate, max_result_count);
+    }
+
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL,
+                                           size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const {
+        return FindTopDocuments(std::execution::seq, raw_query, status, max_result_count);
+    }
+
+    // The matched words point into the snapshot, so they are valid while it is held
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::string_view raw_query, int document_id) const;
+
+private:
+    friend class RealtimeSearchServer;
+
+    struct Segment {
+        std::shared_ptr<const SearchServer> server;
+        size_t deleted_document_count = 0;   // its documents among the tombstones
+    };
+
+    std::vector<Segment> segments_;
+    // Documents removed from segments or the buffer that were not rebuilt yet
+    PersistentSet<int> deleted_document_ids_;
+    // Words of the removed documents, to correct the document frequencies
+    PersistentMap<std::string, int, std::hash<std::string_view>> deleted_word_document_counts_;
+    std::shared_ptr<Buffer> buffer_;   // shared by versions until sealed
+    size_t buffer_document_count_ = 0;   // documents of the buffer this version sees
+    size_t buffer_deleted_document_count_ = 0;   // of them among the tombstones
+    uint64_t generation_ = 0;
+    int document_count_ = 0;
+
+    // Sealed segment of a document that is not removed, null if there is none
+    const Segment* FindSegment(int document_id) const;
+
+    // Position of the segment in segments_, segments_.size() if there is none
+    size_t FindSegmentPosition(const std::shared_ptr<const SearchServer>& server) const;
+
+    // True for a document of the buffer that this version sees, removed or not. Needs the buffer lock
+    bool IsBuffered(int document_id) const;
+
+    CorpusStatistics CollectStatistics(const std::string_view raw_query) const;
+};
+
+template <typename DocumentPredicate>
+std::vector<Document> RealtimeSearchServer::FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate,
+                                                             size_t max_result_count) const {
+    return GetSnapshot()->FindTopDocuments(raw_query, document_predicate, max_result_count);
+}
@@ -1,9 +1,9 @@
 #include "request_queue.h"
 
 std::vector<Document> RequestQueue::AddFindRequest(const std::string_view raw_query, DocumentStatus status) {
-    return AddFindRequest(raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-        return document_status == status;
-        });
+    auto result = search_server.FindTopDocuments(raw_query, status);   // goes through the result cache
+    AddRequest(result.size());
+    return result;
 }
 
 std::vector<Document> RequestQueue::AddFindRequest(const std::string_view raw_query) {
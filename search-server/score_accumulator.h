@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "posting_list.h"
+
+// Dense relevance accumulator for a contiguous range of document ordinals.
+// Documents are marked as touched with a per-query stamp, so starting a new query
+// does not clear the arrays. One instance is kept per thread and reused by every query.
+class ScoreAccumulator {
+public:
+    static ScoreAccumulator& ForCurrentThread() {
+        thread_local ScoreAccumulator accumulator;
+        return accumulator;
+    }
+
+    // Prepares the accumulator for ordinals in [begin, end)
+    void Reset(DocumentOrdinal begin, DocumentOrdinal end) {
+        begin_ = begin;
+        const size_t size = end - begin;
+        if (scores_.size() < size) {
+            scores_.resize(size);
+            stamps_.resize(size);
+        }
+        if (++stamp_ == 0) {   // the stamp wrapped around, old marks could match again
+            std::fill(stamps_.begin(), stamps_.end(), 0);
+            stamp_ = 1;
+        }
+        touched_.clear();
+    }
+
+    bool IsTouched(DocumentOrdinal ordinal) const {
+        return stamps_[ordinal - begin_] == stamp_;
+    }
+
+    // Starts accumulating the document. An excluded document stays out of the result
+    // whatever is added to it later
+    void Touch(DocumentOrdinal ordinal, bool excluded) {
+        stamps_[ordinal - begin_] = stamp_;
+        scores_[ordinal - begin_] = excluded ? EXCLUDED : 0.0;
+        touched_.push_back(ordinal);
+    }
+
+    void Add(DocumentOrdinal ordinal, double score) {
+        scores_[ordinal - begin_] += score;
+    }
+
+    // Keeps the document out of the result before anything is added to it. Scores added
+    // later do not bring it back, and it is not visited by ForEachScored
+    void ExcludeAhead(DocumentOrdinal ordinal) {
+        stamps_[ordinal - begin_] = stamp_;
+        scores_[ordinal - begin_] = EXCLUDED;
+    }
+
+    // Calls function(ordinal, relevance) for every touched document that is not excluded
+    template <typename Function>
+    void ForEachScored(Function function) const {
+        for (const DocumentOrdinal ordinal : touched_) {
+            const double score = scores_[ordinal - begin_];
+            if (score != EXCLUDED) {
+                function(ordinal, score);
+            }
+        }
+    }
+
+private:
+    inline static constexpr double EXCLUDED = -std::numeric_limits<double>::infinity();
+
+    DocumentOrdinal begin_ = 0;
+    std::vector<double> scores_;
+    std::vector<uint32_t> stamps_;
+    uint32_t stamp_ = 0;
+    std::vector<DocumentOrdinal> touched_;
+};
@@ -1,93 +1,1190 @@
 #include "search_server.h"
 #include <numeric> // for accumulate
 #include <iterator>
+#include <unordered_map>
+#include <unordered_set>
+#include "index_file.h"
 
 void SearchServer::AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings) {
+        Detach();
         if (document_id < 0) {
             throw std::invalid_argument("Incorrect document id. Id < 0");
         }
-        if (documents_.count(document_id) > 0)
+        if (document_ids_.Contains(document_id))
             throw std::invalid_argument("Document with this id already exists");
 
-        words_.emplace_back(document); // deque
-
-        const auto words = SplitIntoWordsNoStop(words_.back());
+        // The text is not kept: the index points to the stored terms only
+        auto words = SplitIntoWordsNoStop(document);
         const double inv_word_count = 1.0 / static_cast<int>(words.size());
-        for (const std::string_view word : words) {
-            //auto [elem, _] = words_.insert(std::string(word));    // set
-            word_to_document_freqs_[word][document_id] += inv_word_count;
-            document_to_word_freqs_[document_id][word] += inv_word_count;
+        WordSetFingerprint fingerprint;
+        if (duplicate_mode_ != DuplicateMode::ALLOW) {
+            std::vector<std::string_view> distinct_words;
+            ForEachWordCount(words, [&](std::string_view word, uint32_t) {
+                fingerprint.AddWord(word);
+                distinct_words.push_back(word);
+            });
+            CheckDuplicate(fingerprint, distinct_words);
+        }
+
+        // Term frequency is always count * (1 / length), so compressed postings can restore it exactly
+        const DocumentOrdinal ordinal = AddOrdinal(document_id, ComputeAverageRating(ratings), status, inv_word_count);
+        ForEachWordCount(words, [&](std::string_view word, uint32_t term_count) {
+            const TermId term_id = AddTerm(word);
+            AddDocumentWord(term_id, term_count);
+            term_postings_[term_id].Append(ordinal, term_count, term_count * inv_word_count);
+        });
+        if (duplicate_mode_ != DuplicateMode::ALLOW) {
+            RegisterFingerprint(document_id, ordinal, fingerprint);
+        }
+        ++generation_;
+}
+
+void SearchServer::AddDocuments(const std::vector<NewDocument>& documents) {
+    AddDocuments(std::execution::seq, documents);
+}
+
+void SearchServer::CheckNewDocumentIds(const std::vector<NewDocument>& documents) const {
+    std::set<int> batch_ids;
+    for (const NewDocument& document : documents) {
+        if (document.id < 0) {
+            throw std::invalid_argument("Incorrect document id. Id < 0");
+        }
+        if (document_ids_.Contains(document.id) || !batch_ids.insert(document.id).second)
+            throw std::invalid_argument("Document with this id already exists");
+    }
+}
+
+void SearchServer::BuildPartialIndex(const std::vector<NewDocument>& documents, DocumentOrdinal first_ordinal,
+                                     PartialIndex& partial_index) const {
+    const size_t document_count = partial_index.range.end - partial_index.range.begin;
+    partial_index.document_term_offsets.reserve(document_count + 1);
+    partial_index.document_term_offsets.push_back(0);
+    partial_index.inverse_lengths.reserve(document_count);
+    const bool has_fingerprints = duplicate_mode_ != DuplicateMode::ALLOW;
+    if (has_fingerprints) {
+        partial_index.fingerprints.resize(document_count);
+    }
+    for (size_t i = 0; i < document_count; ++i) {
+        const size_t position = partial_index.range.begin + i;
+        auto words = SplitIntoWordsNoStop(documents[position].text);
+        const auto ordinal = static_cast<DocumentOrdinal>(first_ordinal + position);
+        ForEachWordCount(words, [&](std::string_view word, uint32_t term_count) {
+            if (has_fingerprints) {
+                partial_index.fingerprints[i].AddWord(word);
+            }
+            const auto [it, inserted] = partial_index.local_term_ids.emplace(word, static_cast<TermId>(partial_index.terms.size()));
+            const TermId term_id = it->second;
+            if (inserted) {
+                partial_index.terms.push_back(word);
+                partial_index.postings.emplace_back();
+            }
+            partial_index.postings[term_id].emplace_back(ordinal, term_count);
+            partial_index.document_terms.emplace_back(term_id, term_count);
+        });
+        partial_index.document_term_offsets.push_back(partial_index.document_terms.size());
+        partial_index.inverse_lengths.push_back(1.0 / static_cast<int>(words.size()));
+    }
+}
+
+void SearchServer::CheckNewDocumentDuplicates(const std::vector<WordSetFingerprint>& fingerprints,
+                                              const std::vector<std::vector<std::string_view>>& document_words) const {
+    if (duplicate_mode_ != DuplicateMode::REJECT) {
+        return;
+    }
+    // Positions of the documents of the batch by fingerprint
+    std::unordered_map<WordSetFingerprint, std::vector<size_t>, WordSetFingerprintHash> batch_positions;
+    for (size_t i = 0; i < fingerprints.size(); ++i) {
+        CheckDuplicate(fingerprints[i], document_words[i]);
+        auto& same_fingerprint_positions = batch_positions[fingerprints[i]];
+        for (const size_t position : same_fingerprint_positions) {
+            if (document_words[position] == document_words[i]) {
+                throw std::invalid_argument("Document duplicates another document of the batch");
+            }
         }
-        documents_.emplace(document_id, DocumentData{ ComputeAverageRating(ratings), status });
-        document_ids_.insert(document_id);
+        same_fingerprint_positions.push_back(i);
+    }
+}
+
+void SearchServer::CheckNewDocumentDuplicates(const std::vector<PartialIndex>& partial_indexes) const {
+    if (duplicate_mode_ != DuplicateMode::REJECT) {
+        return;
+    }
+    std::vector<WordSetFingerprint> fingerprints;
+    std::vector<std::vector<std::string_view>> document_words;
+    for (const PartialIndex& partial_index : partial_indexes) {
+        fingerprints.insert(fingerprints.end(), partial_index.fingerprints.begin(), partial_index.fingerprints.end());
+        const auto& offsets = partial_index.document_term_offsets;
+        for (size_t i = 0; i + 1 < offsets.size(); ++i) {
+            std::vector<std::string_view>& words = document_words.emplace_back();
+            words.reserve(offsets[i + 1] - offsets[i]);
+            for (size_t j = offsets[i]; j < offsets[i + 1]; ++j) {
+                words.push_back(partial_index.terms[partial_index.document_terms[j].first]);
+            }
+        }
+    }
+    CheckNewDocumentDuplicates(fingerprints, document_words);
 }
 
-std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(raw_query, [status]
-    ([[maybe_unused]] int document_id, DocumentStatus document_status, [[maybe_unused]] int rating) {
-        return document_status == status;
+void SearchServer::AddDocumentsSequentially(const std::vector<NewDocument>& documents) {
+    // Nothing is modified until every document is tokenized and checked, so an invalid document
+    // leaves the index as it was. The distinct words of all documents are kept in one array
+    // in word order with their counts, document i has [word_offsets[i], word_offsets[i + 1])
+    std::vector<std::string_view> words;
+    std::vector<uint32_t> term_counts;
+    std::vector<size_t> word_offsets{ 0 };
+    std::vector<double> inverse_lengths(documents.size());
+    word_offsets.reserve(documents.size() + 1);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        auto document_words = SplitIntoWordsNoStop(documents[i].text);
+        inverse_lengths[i] = 1.0 / static_cast<int>(document_words.size());
+        ForEachWordCount(document_words, [&](std::string_view word, uint32_t term_count) {
+            words.push_back(word);
+            term_counts.push_back(term_count);
         });
+        word_offsets.push_back(words.size());
+    }
+    const bool has_fingerprints = duplicate_mode_ != DuplicateMode::ALLOW;
+    std::vector<WordSetFingerprint> fingerprints;
+    if (has_fingerprints) {
+        fingerprints.resize(documents.size());
+        for (size_t i = 0; i < documents.size(); ++i) {
+            for (size_t j = word_offsets[i]; j < word_offsets[i + 1]; ++j) {
+                fingerprints[i].AddWord(words[j]);
+            }
+        }
+        if (duplicate_mode_ == DuplicateMode::REJECT) {
+            std::vector<std::vector<std::string_view>> document_words;
+            document_words.reserve(documents.size());
+            for (size_t i = 0; i < documents.size(); ++i) {
+                document_words.emplace_back(words.begin() + word_offsets[i], words.begin() + word_offsets[i + 1]);
+            }
+            CheckNewDocumentDuplicates(fingerprints, document_words);
+        }
+    }
+
+    for (size_t i = 0; i < documents.size(); ++i) {
+        const NewDocument& document = documents[i];
+        const double inv_word_count = inverse_lengths[i];
+        const DocumentOrdinal ordinal = AddOrdinal(document.id, ComputeAverageRating(document.ratings), document.status,
+                                                   inv_word_count);
+        for (size_t j = word_offsets[i]; j < word_offsets[i + 1]; ++j) {
+            const TermId term_id = AddTerm(words[j]);
+            AddDocumentWord(term_id, term_counts[j]);
+            term_postings_[term_id].Append(ordinal, term_counts[j], term_counts[j] * inv_word_count);
+        }
+        if (has_fingerprints) {
+            RegisterFingerprint(document.id, ordinal, fingerprints[i]);
+        }
+    }
+    ++generation_;
+}
+
+void SearchServer::AddNewDocumentData(const std::vector<NewDocument>& documents, const std::vector<PartialIndex>& partial_indexes) {
+    for (const PartialIndex& partial_index : partial_indexes) {
+        const auto& offsets = partial_index.document_term_offsets;
+        for (size_t i = 0; i < partial_index.inverse_lengths.size(); ++i) {
+            const NewDocument& document = documents[partial_index.range.begin + i];
+            const DocumentOrdinal ordinal = AddOrdinal(document.id, ComputeAverageRating(document.ratings), document.status,
+                                                       partial_index.inverse_lengths[i]);
+            for (size_t j = offsets[i]; j < offsets[i + 1]; ++j) {
+                const auto [local_term_id, term_count] = partial_index.document_terms[j];
+                AddDocumentWord(partial_index.term_ids[local_term_id], term_count);
+            }
+            if (duplicate_mode_ != DuplicateMode::ALLOW) {
+                RegisterFingerprint(document.id, ordinal, partial_index.fingerprints[i]);
+            }
+        }
+    }
+}
+
+void SearchServer::CopyDocument(const SearchServer& source, DocumentOrdinal source_ordinal) {
+    const int document_id = source.ordinal_to_document_id_[source_ordinal];
+    if (document_ids_.Contains(document_id))
+        throw std::invalid_argument("Document with this id already exists");
+
+    const uint64_t words_begin = source.word_offsets_[source_ordinal];
+    const uint64_t words_end = source.word_offsets_[source_ordinal + 1];
+    WordSetFingerprint fingerprint;
+    if (duplicate_mode_ != DuplicateMode::ALLOW) {
+        std::vector<std::string_view> words;
+        for (uint64_t i = words_begin; i < words_end; ++i) {
+            words.push_back(source.term_dictionary_.GetTerm(source.word_term_ids_[i]));
+            fingerprint.AddWord(words.back());
+        }
+        CheckDuplicate(fingerprint, words);
+    }
+
+    const double inv_word_count = source.inverse_document_lengths_[source_ordinal];
+    const DocumentOrdinal ordinal = AddOrdinal(document_id, source.document_ratings_[source_ordinal],
+                                                source.document_statuses_[source_ordinal], inv_word_count);
+    for (uint64_t i = words_begin; i < words_end; ++i) {
+        const TermId term_id = AddTerm(source.term_dictionary_.GetTerm(source.word_term_ids_[i]));
+        const uint32_t term_count = source.word_term_counts_[i];
+        AddDocumentWord(term_id, term_count);
+        term_postings_[term_id].Append(ordinal, term_count, term_count * inv_word_count);
+    }
+    if (duplicate_mode_ != DuplicateMode::ALLOW) {
+        RegisterFingerprint(document_id, ordinal, fingerprint);
+    }
+}
+
+DocumentOrdinal SearchServer::AddOrdinal(int document_id, int rating, DocumentStatus status, double inv_word_count) {
+    const auto ordinal = static_cast<DocumentOrdinal>(ordinal_to_document_id_.size());
+    document_ids_.Insert(document_id, ordinal);
+    ordinal_to_document_id_.push_back(document_id);
+    document_ratings_.push_back(rating);
+    document_statuses_.push_back(status);
+    inverse_document_lengths_.push_back(inv_word_count);
+    if (ordinal % 64 == 0) {
+        deleted_ordinals_.push_back(0);
+        for (auto& status_ordinals : status_ordinals_) {
+            status_ordinals.push_back(0);
+        }
+    }
+    status_ordinals_[static_cast<size_t>(status)][ordinal / 64] |= uint64_t{1} << (ordinal % 64);
+    if (word_offsets_.empty()) {
+        word_offsets_.push_back(0);
+    }
+    word_offsets_.push_back(word_term_ids_.size());
+    return ordinal;
+}
+
+DocumentOrdinal SearchServer::FindOrdinal(int document_id) const {
+    if (IsMapped()) {
+        const auto& document_ordinals = mapped_index_->document_ordinals;
+        const auto it = std::lower_bound(document_ordinals.begin(), document_ordinals.end(), document_id,
+                                         [](const DocumentIdOrdinal& entry, int id) { return entry.id < id; });
+        return it != document_ordinals.end() && it->id == document_id ? it->ordinal : PostingList::END_ORDINAL;
+    }
+    return document_ids_.Find(document_id);
+}
+
+TermId SearchServer::AddTerm(const std::string_view word) {
+    TermId term_id = term_dictionary_.Find(word);
+    if (term_id == TermDictionary::INVALID_TERM_ID) {
+        term_id = term_dictionary_.Intern(term_texts_.Store(word));
+        term_postings_.emplace_back(postings_compressed_);
+        term_deleted_counts_.push_back(0);
+    }
+    return term_id;
+}
+
+void SearchServer::ReclaimTerms() {
+    const size_t term_count = term_postings_.size();
+    const auto empty_count = static_cast<size_t>(std::count_if(term_postings_.begin(), term_postings_.end(),
+                                                               [](const PostingList& postings) { return postings.Size() == 0; }));
+    if (empty_count == 0 || empty_count * 2 < term_count) {
+        return;
+    }
+    Detach();
+    TextArena term_texts;
+    TermDictionary term_dictionary;
+    std::vector<PostingList> term_postings;
+    term_postings.reserve(term_count - empty_count);
+    std::vector<TermId> new_term_ids(term_count, TermDictionary::INVALID_TERM_ID);
+    for (TermId term_id = 0; term_id < term_count; ++term_id) {
+        if (term_postings_[term_id].Size() > 0) {
+            new_term_ids[term_id] = term_dictionary.Intern(term_texts.Store(term_dictionary_.GetTerm(term_id)));
+            term_postings.push_back(std::move(term_postings_[term_id]));
+        }
+    }
+    // Compaction has dropped the words of removed documents, so every word left has postings
+    for (size_t i = 0; i < word_term_ids_.size(); ++i) {
+        word_term_ids_[i] = new_term_ids[word_term_ids_[i]];
+    }
+    term_texts_ = std::move(term_texts);
+    term_dictionary_ = std::move(term_dictionary);
+    term_postings_ = std::move(term_postings);
+    term_deleted_counts_.clear();
+    term_deleted_counts_.resize(term_postings_.size(), 0);
+}
+
+std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query, DocumentStatus status, size_t max_result_count) const {
+    return FindTopDocuments(std::execution::seq, raw_query, status, max_result_count);
+}
+
+// Every member but the terms, the result cache and the metrics, in the order of declaration
+SearchServer::SearchServer(const SearchServer& other)
+    : stop_words_(other.stop_words_),
+    term_postings_(other.term_postings_),
+    term_deleted_counts_(other.term_deleted_counts_),
+    document_ids_(other.document_ids_),
+    ordinal_to_document_id_(other.ordinal_to_document_id_),
+    document_ratings_(other.document_ratings_),
+    document_statuses_(other.document_statuses_),
+    inverse_document_lengths_(other.inverse_document_lengths_),
+    deleted_ordinals_(other.deleted_ordinals_),
+    status_ordinals_(other.status_ordinals_),
+    word_offsets_(other.word_offsets_),
+    word_term_ids_(other.word_term_ids_),
+    word_term_counts_(other.word_term_counts_),
+    deleted_document_count_(other.deleted_document_count_),
+    auto_compaction_ratio_(other.auto_compaction_ratio_),
+    postings_compressed_(other.postings_compressed_),
+    scoring_mode_(other.scoring_mode_),
+    mapped_file_(other.mapped_file_),
+    mapped_index_(other.mapped_index_),
+    thread_pool_(other.thread_pool_),
+    duplicate_mode_(other.duplicate_mode_),
+    fingerprint_documents_(other.fingerprint_documents_),
+    flagged_duplicates_(other.flagged_duplicates_),
+    generation_(other.generation_)
+{
+    // Terms of a mapped dictionary stay in the shared file, the others are stored again under the same ids
+    if (other.term_dictionary_.IsMapped()) {
+        term_dictionary_ = other.term_dictionary_;
+    }
+    else {
+        for (TermId term_id = 0; term_id < other.term_dictionary_.GetTermCount(); ++term_id) {
+            term_dictionary_.Intern(term_texts_.Store(other.term_dictionary_.GetTerm(term_id)));
+        }
+    }
+    if (other.result_cache_) {
+        result_cache_ = std::make_unique<QueryResultCache>(other.result_cache_->GetCapacity());
+    }
+    if (other.query_metrics_) {
+        query_metrics_ = std::make_shared<QueryMetrics>();
+    }
+}
+
+SearchServer& SearchServer::operator=(const SearchServer& other) {
+    if (this != &other) {
+        *this = SearchServer(other);
+    }
+    return *this;
+}
+
+void SearchServer::SetResultCacheCapacity(size_t capacity) {
+    result_cache_ = capacity > 0 ? std::make_unique<QueryResultCache>(capacity) : nullptr;
+}
+
+QueryResultCache::Stats SearchServer::GetResultCacheStats() const {
+    return result_cache_ ? result_cache_->GetStats() : QueryResultCache::Stats{};
+}
+
+
+std::string SearchServer::NormalizeQuery(const Query& query) {
+    // ParseQuery has sorted the words and removed the repeats
+    std::string text;
+    for (const std::string_view word : query.plus_words) {
+        text.append(word).push_back(' ');
+    }
+    for (const std::string_view word : query.minus_words) {
+        text.append("-"s).append(word).push_back(' ');
+    }
+    return text;
+}
+
+SearchServer::OrdinalBitmap SearchServer::MakeBitmapFilter(const DocumentFilter& filter, OrdinalRange range) const {
+    OrdinalBitmap result;
+    const StorageVector<uint64_t>* status_ordinals = filter.status ? &status_ordinals_[static_cast<size_t>(*filter.status)] : nullptr;
+    if (status_ordinals != nullptr && !filter.HasRatingBounds()) {
+        result.words = status_ordinals->data();
+        return result;
+    }
+    const size_t first_word = range.begin / 64;
+    const size_t end_word = (range.end + 63) / 64;
+    const auto ordinal_count = static_cast<DocumentOrdinal>(ordinal_to_document_id_.size());
+    result.owned_words.resize(end_word - first_word);
+    for (size_t word = first_word; word < end_word; ++word) {
+        uint64_t bits = status_ordinals != nullptr ? (*status_ordinals)[word] : ~deleted_ordinals_[word];
+        if (filter.HasRatingBounds()) {
+            // No branches on the ratings, so the compiler vectorizes the comparisons
+            const auto word_begin = static_cast<DocumentOrdinal>(word * 64);
+            const DocumentOrdinal word_end = std::min(word_begin + 64, ordinal_count);
+            uint64_t rating_bits = 0;
+            for (DocumentOrdinal ordinal = word_begin; ordinal < word_end; ++ordinal) {
+                const int rating = document_ratings_[ordinal];
+                rating_bits |= uint64_t{rating >= filter.min_rating && rating <= filter.max_rating} << (ordinal - word_begin);
+            }
+            bits &= rating_bits;
+        }
+        result.owned_words[word - first_word] = bits;
+    }
+    result.words = result.owned_words.data();
+    result.first_ordinal = static_cast<DocumentOrdinal>(first_word * 64);
+    return result;
+}
+
+SearchServer::OrdinalBitmap SearchServer::MakeExclusionBitmap(const std::vector<const PostingList*>& minus_postings,
+                                                             OrdinalRange range) const {
+    OrdinalBitmap result;
+    const size_t first_word = range.begin / 64;
+    result.first_ordinal = static_cast<DocumentOrdinal>(first_word * 64);
+    result.owned_words.resize((range.end + 63) / 64 - first_word, 0);
+    PostingList::BlockBuffer buffer;
+    for (const PostingList* postings : minus_postings) {
+        ForEachBlockInRange(*postings, range, buffer, nullptr, [&result](const PostingList::Block& block, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                const DocumentOrdinal bit = block.ordinals[i] - result.first_ordinal;
+                result.owned_words[bit / 64] |= uint64_t{1} << (bit % 64);
+            }
+        });
+    }
+    result.words = result.owned_words.data();
+    return result;
+}
+
+bool SearchServer::HasCandidates(const OrdinalBitmap& excluded, OrdinalRange range) const {
+    for (DocumentOrdinal word_begin = range.begin - range.begin % 64; word_begin < range.end; word_begin += 64) {
+        uint64_t candidates = ~deleted_ordinals_[word_begin / 64] & ~excluded.words[(word_begin - excluded.first_ordinal) / 64];
+        if (word_begin < range.begin) {
+            candidates &= ~uint64_t{0} << (range.begin - word_begin);
+        }
+        if (range.end - word_begin < 64) {
+            candidates &= (uint64_t{1} << (range.end - word_begin)) - 1;
+        }
+        if (candidates != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string SearchServer::GetFilterKey(const DocumentFilter& filter) {
+    if (!filter.HasRatingBounds()) {
+        return filter.status ? std::string() : "filter:"s;
+    }
+    return "filter:rating:"s + std::to_string(filter.min_rating) + ":"s + std::to_string(filter.max_rating);
 }
 
 std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query) const {
     return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
 }
 
+std::vector<std::vector<Document>> SearchServer::FindTopDocumentsBatch(const std::vector<std::string_view>& raw_queries,
+                                                                      DocumentStatus status, size_t max_result_count) const {
+    return FindTopDocumentsBatchImpl(std::execution::par, raw_queries, status, max_result_count);
+}
+
+std::vector<std::vector<Document>> SearchServer::FindTopDocumentsBatch(const std::execution::sequenced_policy& policy,
+                                                                      const std::vector<std::string_view>& raw_queries,
+                                                                      DocumentStatus status, size_t max_result_count) const {
+    return FindTopDocumentsBatchImpl(policy, raw_queries, status, max_result_count);
+}
+
+template <typename ExecPolicy>
+std::vector<std::vector<Document>> SearchServer::FindTopDocumentsBatchImpl(ExecPolicy&& policy,
+                                                                          const std::vector<std::string_view>& raw_queries,
+                                                                          DocumentStatus status, size_t max_result_count) const {
+    QUERY_METRICS_STAGE(GetRecordedQueryMetrics(), QueryStage::BATCH);
+    QUERY_METRICS_ADD(GetRecordedQueryMetrics(), QueryCounter::QUERIES, raw_queries.size());
+    std::vector<Query> parsed_queries(raw_queries.size());
+    ForEachIndex(policy, raw_queries.size(), [&](size_t i) {
+        parsed_queries[i] = ParseQuery(raw_queries[i]);
+    });
+    if (max_result_count == 0) {
+        return std::vector<std::vector<Document>>(raw_queries.size());
+    }
+
+    // Repeated queries are run once: distinct queries are numbered by their normalized text
+    std::vector<const Query*> distinct_queries;
+    std::vector<std::string> distinct_texts;
+    std::vector<size_t> distinct_indexes(raw_queries.size());
+    {
+        std::unordered_map<std::string, size_t> text_indexes;
+        for (size_t i = 0; i < parsed_queries.size(); ++i) {
+            const auto [it, inserted] = text_indexes.emplace(NormalizeQuery(parsed_queries[i]), distinct_queries.size());
+            if (inserted) {
+                distinct_queries.push_back(&parsed_queries[i]);
+                distinct_texts.push_back(it->first);
+            }
+            distinct_indexes[i] = it->second;
+        }
+    }
+
+    std::vector<std::vector<Document>> distinct_results(distinct_queries.size());
+    std::vector<size_t> scored_queries;   // distinct queries not found in the cache
+    const uint64_t generation = generation_;
+    for (size_t i = 0; i < distinct_queries.size(); ++i) {
+        if (result_cache_) {
+            const QueryResultCache::Key key{ distinct_texts[i], static_cast<int>(status), {}, max_result_count };
+            if (auto documents = result_cache_->Find(key, generation)) {
+                distinct_results[i] = std::move(*documents);
+                continue;
+            }
+        }
+        scored_queries.push_back(i);
+    }
+
+    // Every distinct word of the batch is looked up once
+    std::vector<std::string_view> words;
+    for (const size_t i : scored_queries) {
+        words.insert(words.end(), distinct_queries[i]->plus_words.begin(), distinct_queries[i]->plus_words.end());
+        words.insert(words.end(), distinct_queries[i]->minus_words.begin(), distinct_queries[i]->minus_words.end());
+    }
+    std::sort(words.begin(), words.end());
+    words.erase(std::unique(words.begin(), words.end()), words.end());
+
+    QueryBatch batch;
+    batch.terms.resize(words.size(), { nullptr, 0.0 });
+    std::vector<int> word_document_counts(words.size(), 0);
+    for (size_t i = 0; i < words.size(); ++i) {
+        const TermId term_id = term_dictionary_.Find(words[i]);
+        if (term_id == TermDictionary::INVALID_TERM_ID) {
+            continue;
+        }
+        word_document_counts[i] = GetTermDocumentCount(term_id);
+        batch.terms[i].postings = &term_postings_[term_id];
+        if (word_document_counts[i] > 0) {
+            batch.terms[i].inverse_document_freq = ComputeWordInverseDocumentFreq(words[i], word_document_counts[i], nullptr);
+        }
+    }
+    const auto find_term = [&words](std::string_view word) {
+        return static_cast<uint32_t>(std::lower_bound(words.begin(), words.end(), word) - words.begin());
+    };
+
+    // Plus terms stay in word order, so every document sums its scores in the order of FindAllDocuments
+    batch.queries.resize(distinct_queries.size());
+    std::vector<size_t> group_order;
+    for (const size_t i : scored_queries) {
+        QueryBatch::BatchQuery& query = batch.queries[i];
+        const std::vector<std::string_view>& minus_words = distinct_queries[i]->minus_words;
+        if (std::any_of(minus_words.begin(), minus_words.end(),
+                        [&](std::string_view word) { return word_document_counts[find_term(word)] == GetDocumentCount(); })) {
+            continue;   // every document has a minus word, the result is empty
+        }
+        for (const std::string_view word : minus_words) {
+            const uint32_t term = find_term(word);
+            if (word_document_counts[term] > 0) {
+                query.minus_terms.push_back(term);
+            }
+        }
+        // Documents with a plus word that is also a minus word are excluded anyway
+        for (const std::string_view word : distinct_queries[i]->plus_words) {
+            const uint32_t term = find_term(word);
+            if (word_document_counts[term] > 0 && !std::binary_search(minus_words.begin(), minus_words.end(), word)) {
+                query.plus_terms.push_back(term);
+            }
+        }
+        if (!query.plus_terms.empty()) {
+            group_order.push_back(i);
+        }
+    }
+    // Sorting by terms puts queries sharing words next to each other
+    std::sort(group_order.begin(), group_order.end(), [&batch](size_t lhs, size_t rhs) {
+        return batch.queries[lhs].plus_terms < batch.queries[rhs].plus_terms;
+    });
+    for (size_t i = 0; i < group_order.size(); i += BATCH_GROUP_SIZE) {
+        const size_t end = std::min(group_order.size(), i + BATCH_GROUP_SIZE);
+        batch.groups.emplace_back(group_order.begin() + i, group_order.begin() + end);
+    }
+
+    ForEachIndex(policy, batch.groups.size(), [&](size_t i) {
+        ScoreQueryGroup(batch, batch.groups[i], status, max_result_count, distinct_results);
+    });
+
+    if (result_cache_) {
+        for (const size_t i : scored_queries) {
+            const QueryResultCache::Key key{ std::move(distinct_texts[i]), static_cast<int>(status), {}, max_result_count };
+            result_cache_->Insert(key, generation, distinct_results[i]);
+        }
+    }
+
+    std::vector<std::vector<Document>> results(raw_queries.size());
+    for (size_t i = 0; i < raw_queries.size(); ++i) {
+        results[i] = distinct_results[distinct_indexes[i]];
+    }
+    return results;
+}
+
+void SearchServer::ScoreQueryGroup(const QueryBatch& batch, const std::vector<size_t>& group, DocumentStatus status,
+                                   size_t max_result_count, std::vector<std::vector<Document>>& results) const {
+    // Postings of a term of the group, read range by range. Every block is decoded once
+    // and added to all queries of the group with the term
+    struct GroupTerm {
+        uint32_t term;
+        std::vector<uint32_t> queries;   // positions in the group
+        size_t next_block = 0;
+        PostingList::Block block = {};
+        size_t position = 0;
+    };
+
+    const auto collect_terms = [&](bool is_plus) {
+        std::vector<std::pair<uint32_t, uint32_t>> uses;   // (term, position in the group)
+        for (uint32_t i = 0; i < group.size(); ++i) {
+            const auto& query = batch.queries[group[i]];
+            for (const uint32_t term : is_plus ? query.plus_terms : query.minus_terms) {
+                uses.emplace_back(term, i);
+            }
+        }
+        std::sort(uses.begin(), uses.end());
+        std::vector<GroupTerm> terms;
+        for (const auto& [term, position] : uses) {
+            if (terms.empty() || terms.back().term != term) {
+                terms.push_back({ term, {} });
+            }
+            terms.back().queries.push_back(position);
+        }
+        return terms;
+    };
+    std::vector<GroupTerm> plus_terms = collect_terms(true);
+    std::vector<GroupTerm> minus_terms = collect_terms(false);
+    std::vector<PostingList::BlockBuffer> buffers(plus_terms.size() + minus_terms.size());
+
+    // Calls function(block, begin, end) for the postings of the term below range_end,
+    // leaving the term at the first posting of the next range
+    const auto read_until = [&](GroupTerm& term, PostingList::BlockBuffer& buffer, const double* inverse_lengths,
+                                DocumentOrdinal range_end, auto function) {
+        const PostingList& postings = *batch.terms[term.term].postings;
+        while (true) {
+            if (term.position == term.block.size) {
+                if (term.next_block == postings.GetBlockCount()) {
+                    return;
+                }
+                term.block = postings.GetBlock(term.next_block++, &buffer, inverse_lengths);
+                term.position = 0;
+            }
+            const DocumentOrdinal* block_end = term.block.ordinals + term.block.size;
+            const DocumentOrdinal* end = std::lower_bound(term.block.ordinals + term.position, block_end, range_end);
+            const size_t end_position = end - term.block.ordinals;
+            if (end_position > term.position) {
+                function(term.block, term.position, end_position);
+                term.position = end_position;
+            }
+            if (end != block_end) {
+                return;
+            }
+        }
+    };
+
+    thread_local std::vector<ScoreAccumulator> accumulators;
+    if (accumulators.size() < group.size()) {
+        accumulators.resize(group.size());
+    }
+    std::vector<TopDocuments> top_documents(group.size(), TopDocuments(max_result_count));
+    [[maybe_unused]] uint64_t postings_scanned = 0;
+    [[maybe_unused]] uint64_t documents_scored = 0;
+
+    const auto ordinal_count = static_cast<DocumentOrdinal>(ordinal_to_document_id_.size());
+    for (DocumentOrdinal range_begin = 0; range_begin < ordinal_count; range_begin += MIN_SCORING_RANGE_SIZE) {
+        const DocumentOrdinal range_end = std::min(ordinal_count, range_begin + MIN_SCORING_RANGE_SIZE);
+        for (size_t i = 0; i < group.size(); ++i) {
+            accumulators[i].Reset(range_begin, range_end);
+        }
+
+        // Minus words go first, so documents with them are never scored
+        {
+            QUERY_METRICS_STAGE(GetRecordedQueryMetrics(), QueryStage::MINUS_FILTER);
+            for (size_t t = 0; t < minus_terms.size(); ++t) {
+                read_until(minus_terms[t], buffers[plus_terms.size() + t], nullptr, range_end,
+                           [&](const PostingList::Block& block, size_t begin, size_t end) {
+                    postings_scanned += end - begin;
+                    for (const uint32_t query : minus_terms[t].queries) {
+                        for (size_t i = begin; i < end; ++i) {
+                            accumulators[query].ExcludeAhead(block.ordinals[i]);
+                        }
+                    }
+                });
+            }
+        }
+
+        {
+            QUERY_METRICS_STAGE(GetRecordedQueryMetrics(), QueryStage::SCORE);
+            for (size_t t = 0; t < plus_terms.size(); ++t) {
+                const double inverse_document_freq = batch.terms[plus_terms[t].term].inverse_document_freq;
+                read_until(plus_terms[t], buffers[t], inverse_document_lengths_.data(), range_end,
+                           [&](const PostingList::Block& block, size_t begin, size_t end) {
+                    postings_scanned += end - begin;
+                    for (const uint32_t query : plus_terms[t].queries) {
+                        ScoreAccumulator& accumulator = accumulators[query];
+                        for (size_t i = begin; i < end; ++i) {
+                            const DocumentOrdinal ordinal = block.ordinals[i];
+                            if (!accumulator.IsTouched(ordinal)) {
+                                accumulator.Touch(ordinal, !HasStatus(ordinal, status));
+                            }
+                            accumulator.Add(ordinal, block.term_freqs[i] * inverse_document_freq);
+                        }
+                    }
+                });
+            }
+        }
+
+        QUERY_METRICS_STAGE(GetRecordedQueryMetrics(), QueryStage::TOP_K);
+        for (size_t i = 0; i < group.size(); ++i) {
+            TopDocuments& top = top_documents[i];
+            accumulators[i].ForEachScored([&](DocumentOrdinal ordinal, double relevance) {
+                ++documents_scored;
+                if (top.IsFull() && top.GetWorst().relevance - relevance >= EPSILON) {
+                    return;
+                }
+                top.Push({ ordinal_to_document_id_[ordinal], relevance, document_ratings_[ordinal] });
+            });
+        }
+    }
+    QUERY_METRICS_ADD(GetRecordedQueryMetrics(), QueryCounter::POSTINGS_SCANNED, postings_scanned);
+    QUERY_METRICS_ADD(GetRecordedQueryMetrics(), QueryCounter::DOCUMENTS_SCORED, documents_scored);
+
+    for (size_t i = 0; i < group.size(); ++i) {
+        results[group[i]] = ExtractDocuments(top_documents[i]);
+    }
+}
+
+std::vector<std::string_view> SearchServer::FindMatchingWords(const std::string_view pattern) const {
+    std::vector<std::string_view> words;
+    for (const TermId term_id : term_dictionary_.FindMatching(pattern)) {
+        words.push_back(term_dictionary_.GetTerm(term_id));
+    }
+    return words;
+}
+
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::string_view raw_query, int document_id) const {
     const Query query = ParseQuery(raw_query);
+    const DocumentOrdinal ordinal = FindOrdinal(document_id);
+    if (ordinal == PostingList::END_ORDINAL) {
+        throw std::out_of_range("Document with this id does not exist");
+    }
+    const DocumentStatus status = document_statuses_[ordinal];
     for (const std::string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
-            return { std::vector<std::string_view>{}, documents_.at(document_id).status };
+        const PostingList* postings = FindPostings(word);
+        if (postings != nullptr && postings->Contains(ordinal)) {
+            return { std::vector<std::string_view>{}, status };
         }
     }
 
     std::vector<std::string_view> matched_words;
     matched_words.reserve(query.plus_words.size());
     for (const std::string_view word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
+        const PostingList* postings = FindPostings(word);
+        if (postings != nullptr && postings->Contains(ordinal)) {
             matched_words.push_back(word);
         }
     }
 
-    return {matched_words, documents_.at(document_id).status};
+    return {matched_words, status};
+}
+
+std::map<std::string_view, double> SearchServer::GetWordFrequencies(int document_id) const {
+    std::map<std::string_view, double> word_freqs;
+    const DocumentOrdinal ordinal = FindOrdinal(document_id);
+    if (ordinal == PostingList::END_ORDINAL) {
+        return word_freqs;
+    }
+    for (uint64_t i = word_offsets_[ordinal]; i < word_offsets_[ordinal + 1]; ++i) {
+        word_freqs.emplace_hint(word_freqs.end(), term_dictionary_.GetTerm(word_term_ids_[i]),
+                                word_term_counts_[i] * inverse_document_lengths_[ordinal]);
+    }
+    return word_freqs;
+}
+
+WordSetFingerprint SearchServer::ComputeWordSetFingerprint(DocumentOrdinal ordinal) const {
+    WordSetFingerprint fingerprint;
+    for (uint64_t i = word_offsets_[ordinal]; i < word_offsets_[ordinal + 1]; ++i) {
+        fingerprint.AddWord(term_dictionary_.GetTerm(word_term_ids_[i]));
+    }
+    return fingerprint;
+}
+
+WordSetFingerprint SearchServer::GetWordSetFingerprint(int document_id) const {
+    const DocumentOrdinal ordinal = FindOrdinal(document_id);
+    return ordinal == PostingList::END_ORDINAL ? WordSetFingerprint{} : ComputeWordSetFingerprint(ordinal);
+}
+
+std::vector<std::pair<int, WordSetFingerprint>> SearchServer::GetWordSetFingerprints() const {
+    std::vector<std::pair<int, DocumentOrdinal>> documents;
+    documents.reserve(GetDocumentCount());
+    if (IsMapped()) {
+        for (const auto& [document_id, ordinal] : mapped_index_->document_ordinals) {
+            documents.emplace_back(document_id, ordinal);
+        }
+    }
+    else {
+        for (auto it = document_ids_.begin(); it != document_ids_.end(); ++it) {
+            documents.emplace_back(*it, it.GetOrdinal());
+        }
+    }
+    std::vector<std::pair<int, WordSetFingerprint>> fingerprints(documents.size());
+    ForEachIndex(std::execution::par, documents.size(), [&](size_t i) {
+        fingerprints[i] = { documents[i].first, ComputeWordSetFingerprint(documents[i].second) };
+    });
+    return fingerprints;
+}
+
+bool SearchServer::HasSameWords(int lhs_document_id, int rhs_document_id) const {
+    const DocumentOrdinal lhs = FindOrdinal(lhs_document_id);
+    const DocumentOrdinal rhs = FindOrdinal(rhs_document_id);
+    return lhs != PostingList::END_ORDINAL && rhs != PostingList::END_ORDINAL && HasSameWordSet(lhs, rhs);
+}
+
+bool SearchServer::HasWords(DocumentOrdinal ordinal, const std::vector<std::string_view>& words) const {
+    const uint64_t words_begin = word_offsets_[ordinal];
+    if (word_offsets_[ordinal + 1] - words_begin != words.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < words.size(); ++i) {
+        if (term_dictionary_.GetTerm(word_term_ids_[words_begin + i]) != words[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SearchServer::HasSameWordSet(DocumentOrdinal lhs, DocumentOrdinal rhs) const {
+    // The words of both are in word order and equal words have the same term id
+    const uint64_t lhs_begin = word_offsets_[lhs];
+    const uint64_t rhs_begin = word_offsets_[rhs];
+    const uint64_t word_count = word_offsets_[lhs + 1] - lhs_begin;
+    if (word_offsets_[rhs + 1] - rhs_begin != word_count) {
+        return false;
+    }
+    for (uint64_t i = 0; i < word_count; ++i) {
+        if (word_term_ids_[lhs_begin + i] != word_term_ids_[rhs_begin + i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void SearchServer::SetDuplicateMode(DuplicateMode mode) {
+    if (mode == DuplicateMode::ALLOW) {
+        fingerprint_documents_.clear();
+        flagged_duplicates_.clear();
+    }
+    else if (duplicate_mode_ == DuplicateMode::ALLOW) {
+        for (const auto& [document_id, fingerprint] : GetWordSetFingerprints()) {
+            fingerprint_documents_[fingerprint].push_back(document_id);
+        }
+    }
+    duplicate_mode_ = mode;
+}
+
+void SearchServer::CheckDuplicate(const WordSetFingerprint& fingerprint, const std::vector<std::string_view>& words) const {
+    if (duplicate_mode_ != DuplicateMode::REJECT) {
+        return;
+    }
+    const auto it = fingerprint_documents_.find(fingerprint);
+    if (it == fingerprint_documents_.end()) {
+        return;
+    }
+    for (const int document_id : it->second) {
+        if (HasWords(FindOrdinal(document_id), words)) {
+            throw std::invalid_argument("Document duplicates an indexed document");
+        }
+    }
+}
+
+void SearchServer::RegisterFingerprint(int document_id, DocumentOrdinal ordinal, const WordSetFingerprint& fingerprint) {
+    std::vector<int>& document_ids = fingerprint_documents_[fingerprint];
+    if (duplicate_mode_ == DuplicateMode::FLAG) {
+        const bool is_duplicate = std::any_of(document_ids.begin(), document_ids.end(), [&](int other_id) {
+            return HasSameWordSet(FindOrdinal(other_id), ordinal);
+        });
+        if (is_duplicate) {
+            flagged_duplicates_.insert(document_id);
+        }
+    }
+    document_ids.push_back(document_id);
 }
 
-const std::map<std::string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
-    static const std::map<std::string_view, double> map;
-    if (documents_.count(document_id) > 0)
-        return document_to_word_freqs_.at(document_id);
-    return map;
+void SearchServer::Detach() {
+    if (!IsMapped()) {
+        return;
+    }
+    for (const auto& [document_id, ordinal] : mapped_index_->document_ordinals) {
+        document_ids_.Insert(document_id, ordinal);
+    }
+    mapped_index_.reset();
 }
 
 void SearchServer::RemoveDocument(int document_id) {
-    //RemoveDocument(std::execution::seq, document_id);
-    if (documents_.count(document_id) == 0) return;
-    documents_.erase(document_id);
-    //      
-    document_ids_.erase(document_id);  //  
-    for (auto& [word, _] : document_to_word_freqs_.at(document_id)) {
-        word_to_document_freqs_.at(word).erase(document_id);
+    if (MarkDeleted(document_id) && NeedsCompaction()) {
+        Compact();
     }
-    document_to_word_freqs_.erase(document_id);
+}
+
+bool SearchServer::MarkDeleted(int document_id) {
+    Detach();
+    const DocumentOrdinal ordinal = document_ids_.Find(document_id);
+    if (ordinal == DocumentIdMap::NO_ORDINAL) {
+        return false;
+    }
+    for (uint64_t i = word_offsets_[ordinal]; i < word_offsets_[ordinal + 1]; ++i) {
+        ++term_deleted_counts_[word_term_ids_[i]];
+    }
+    if (duplicate_mode_ != DuplicateMode::ALLOW) {
+        const auto fingerprint_it = fingerprint_documents_.find(ComputeWordSetFingerprint(ordinal));
+        std::vector<int>& document_ids = fingerprint_it->second;
+        document_ids.erase(std::find(document_ids.begin(), document_ids.end(), document_id));
+        if (document_ids.empty()) {
+            fingerprint_documents_.erase(fingerprint_it);
+        }
+        flagged_duplicates_.erase(document_id);
+    }
+    ordinal_to_document_id_[ordinal] = INVALID_DOCUMENT_ID;
+    deleted_ordinals_[ordinal / 64] |= uint64_t{1} << (ordinal % 64);
+    status_ordinals_[static_cast<size_t>(document_statuses_[ordinal])][ordinal / 64] &= ~(uint64_t{1} << (ordinal % 64));
+    ++deleted_document_count_;
+    //      
+    document_ids_.Erase(document_id);
+    ++generation_;
+    return true;
+}
+
+SearchServer::DeletionStats SearchServer::GetDeletionStats() const {
+    DeletionStats stats;
+    stats.deleted_document_count = deleted_document_count_;
+    stats.document_count = GetDocumentCount();
+    const int indexed_document_count = stats.deleted_document_count + stats.document_count;
+    stats.deleted_ratio = indexed_document_count > 0 ? stats.deleted_document_count * 1.0 / indexed_document_count : 0.0;
+    return stats;
+}
+
+void SearchServer::Compact() {
+    Compact(std::execution::seq);
+}
+
+std::vector<DocumentOrdinal> SearchServer::MakeCompactedOrdinals() const {
+    std::vector<DocumentOrdinal> new_ordinals(ordinal_to_document_id_.size(), PostingList::END_ORDINAL);
+    DocumentOrdinal next_ordinal = 0;
+    for (DocumentOrdinal ordinal = 0; ordinal < new_ordinals.size(); ++ordinal) {
+        if (!IsDeleted(ordinal)) {
+            new_ordinals[ordinal] = next_ordinal++;
+        }
+    }
+    return new_ordinals;
+}
+
+void SearchServer::RenumberDocuments(const std::vector<DocumentOrdinal>& new_ordinals) {
+    // The arrays are built anew, so their capacity shrinks to the documents left
+    const size_t document_count = document_ids_.size();
+    DocumentIdMap document_ids;
+    StorageVector<int> ordinal_to_document_id;
+    StorageVector<int> document_ratings;
+    StorageVector<DocumentStatus> document_statuses;
+    StorageVector<uint64_t> word_offsets;
+    StorageVector<TermId> word_term_ids;
+    StorageVector<uint32_t> word_term_counts;
+    ordinal_to_document_id.reserve(document_count);
+    document_ratings.reserve(document_count);
+    document_statuses.reserve(document_count);
+    word_offsets.reserve(document_count + 1);
+    word_offsets.push_back(0);
+    const size_t bitmap_size = (document_count + 63) / 64;
+    StorageVector<uint64_t> deleted_ordinals;
+    deleted_ordinals.resize(bitmap_size, 0);
+    std::array<StorageVector<uint64_t>, STATUS_COUNT> status_ordinals;
+    for (auto& bitmap : status_ordinals) {
+        bitmap.resize(bitmap_size, 0);
+    }
+
+    for (DocumentOrdinal ordinal = 0; ordinal < new_ordinals.size(); ++ordinal) {
+        const DocumentOrdinal new_ordinal = new_ordinals[ordinal];
+        if (new_ordinal == PostingList::END_ORDINAL) {
+            continue;
+        }
+        const int document_id = ordinal_to_document_id_[ordinal];
+        document_ids.Insert(document_id, new_ordinal);
+        ordinal_to_document_id.push_back(document_id);
+        document_ratings.push_back(document_ratings_[ordinal]);
+        document_statuses.push_back(document_statuses_[ordinal]);
+        status_ordinals[static_cast<size_t>(document_statuses_[ordinal])][new_ordinal / 64] |= uint64_t{1} << (new_ordinal % 64);
+        const uint64_t words_begin = word_offsets_[ordinal];
+        const uint64_t words_end = word_offsets_[ordinal + 1];
+        word_term_ids.append(word_term_ids_.data() + words_begin, words_end - words_begin);
+        word_term_counts.append(word_term_counts_.data() + words_begin, words_end - words_begin);
+        word_offsets.push_back(word_term_ids.size());
+    }
+    word_term_ids.shrink_to_fit();
+    word_term_counts.shrink_to_fit();
+
+    document_ids_ = std::move(document_ids);
+    ordinal_to_document_id_ = std::move(ordinal_to_document_id);
+    document_ratings_ = std::move(document_ratings);
+    document_statuses_ = std::move(document_statuses);
+    deleted_ordinals_ = std::move(deleted_ordinals);
+    status_ordinals_ = std::move(status_ordinals);
+    word_offsets_ = std::move(word_offsets);
+    word_term_ids_ = std::move(word_term_ids);
+    word_term_counts_ = std::move(word_term_counts);
 }
 
 std::vector<std::string_view> SearchServer::SplitIntoWordsNoStop(const std::string_view text) const {
     std::vector<std::string_view> words;
-    for (const std::string_view word : SplitIntoWordsView(text)) {
-        if (!IsValidWord(word)) {
-            throw std::invalid_argument("Word "s + word.data() + " is invalid"s);
+    const size_t invalid_word = SplitIntoWordsValidated(text, words);
+    if (invalid_word < words.size()) {
+        throw std::invalid_argument("Word "s + words[invalid_word].data() + " is invalid"s);
+    }
+    if (!stop_words_.empty()) {
+        words.erase(std::remove_if(words.begin(), words.end(), [this](std::string_view word) { return IsStopWord(word); }),
+                    words.end());
+    }
+    return words;
+}
+
+void SearchServer::SetPostingsCompression(bool compressed) {
+    for (PostingList& postings : term_postings_) {
+        if (compressed) {
+            postings.Compress(inverse_document_lengths_.data());
         }
-        if (!IsStopWord(word)) {
-            words.emplace_back(word);
+        else {
+            postings.Decompress(inverse_document_lengths_.data());
         }
     }
-    return words;
+    postings_compressed_ = compressed;
+}
+
+size_t SearchServer::GetPostingsMemoryUsage() const {
+    size_t bytes = term_postings_.capacity() * sizeof(PostingList);
+    for (const PostingList& postings : term_postings_) {
+        bytes += postings.GetMemoryUsage();
+    }
+    return bytes;
+}
+
+void SearchServer::Save(const std::string& path) const {
+    IndexFileWriter writer(path);
+    writer.Write(INDEX_FILE_MAGIC);
+    writer.Write(INDEX_FILE_VERSION);
+
+    writer.Write<uint64_t>(stop_words_.size());
+    for (const std::string& stop_word : stop_words_) {
+        writer.WriteString(stop_word);
+    }
+    writer.Write(scoring_mode_);
+    writer.Write(postings_compressed_);
+    writer.Write(auto_compaction_ratio_);
+    writer.Write(deleted_document_count_);
+
+    term_dictionary_.Save(writer);
+    writer.WriteArray(term_deleted_counts_);
+    for (const PostingList& postings : term_postings_) {
+        postings.Save(writer);
+    }
+
+    writer.WriteArray(ordinal_to_document_id_);
+    writer.WriteArray(document_ratings_);
+    writer.WriteArray(document_statuses_);
+    writer.WriteArray(inverse_document_lengths_);
+    writer.WriteArray(deleted_ordinals_);
+    for (const auto& status_ordinals : status_ordinals_) {
+        writer.WriteArray(status_ordinals);
+    }
+
+    std::vector<DocumentIdOrdinal> document_ordinals;
+    document_ordinals.reserve(GetDocumentCount());
+    for (const int document_id : *this) {
+        document_ordinals.push_back({ document_id, FindOrdinal(document_id) });
+    }
+    writer.WriteArray(document_ordinals);
+
+    // Forward index as is, words of removed documents stay until compaction
+    if (word_offsets_.empty()) {
+        writer.WriteArray(std::vector<uint64_t>{ 0 });
+    }
+    else {
+        writer.WriteArray(word_offsets_);
+    }
+    writer.WriteArray(word_term_ids_);
+    writer.WriteArray(word_term_counts_);
+    writer.Close();
+}
+
+SearchServer SearchServer::Open(const std::string& path) {
+    auto file = std::make_shared<const MappedFile>(path);
+    IndexFileReader reader(*file);
+    if (reader.Read<uint64_t>() != INDEX_FILE_MAGIC) {
+        throw std::runtime_error("Not an index file "s + path);
+    }
+    if (reader.Read<uint32_t>() != INDEX_FILE_VERSION) {
+        throw std::runtime_error("Unsupported version of index file "s + path);
+    }
+    const auto corrupted = [] { return std::runtime_error("Index file is corrupted"); };
+
+    SearchServer search_server;
+    const auto stop_word_count = reader.Read<uint64_t>();
+    for (uint64_t i = 0; i < stop_word_count; ++i) {
+        search_server.stop_words_.emplace(reader.ReadString());
+    }
+    search_server.scoring_mode_ = reader.Read<ScoringMode>();
+    search_server.postings_compressed_ = reader.Read<bool>();
+    search_server.auto_compaction_ratio_ = reader.Read<double>();
+    search_server.deleted_document_count_ = reader.Read<int>();
+
+    search_server.term_dictionary_ = TermDictionary::Load(reader);
+    const size_t term_count = search_server.term_dictionary_.GetTermCount();
+    search_server.term_deleted_counts_ = reader.ReadArray<uint32_t>();
+    if (search_server.term_deleted_counts_.size() != term_count) {
+        throw corrupted();
+    }
+    search_server.term_postings_.reserve(term_count);
+    for (size_t term_id = 0; term_id < term_count; ++term_id) {
+        search_server.term_postings_.push_back(PostingList::Load(reader));
+    }
+
+    search_server.ordinal_to_document_id_ = reader.ReadArray<int>();
+    search_server.document_ratings_ = reader.ReadArray<int>();
+    search_server.document_statuses_ = reader.ReadArray<DocumentStatus>();
+    search_server.inverse_document_lengths_ = reader.ReadArray<double>();
+    search_server.deleted_ordinals_ = reader.ReadArray<uint64_t>();
+    const size_t ordinal_count = search_server.ordinal_to_document_id_.size();
+    const size_t bitmap_size = (ordinal_count + 63) / 64;
+    if (search_server.document_ratings_.size() != ordinal_count || search_server.document_statuses_.size() != ordinal_count
+        || search_server.inverse_document_lengths_.size() != ordinal_count || search_server.deleted_ordinals_.size() != bitmap_size) {
+        throw corrupted();
+    }
+    for (auto& status_ordinals : search_server.status_ordinals_) {
+        status_ordinals = reader.ReadArray<uint64_t>();
+        if (status_ordinals.size() != bitmap_size) {
+            throw corrupted();
+        }
+    }
+
+    auto mapped_index = std::make_shared<MappedIndex>();
+    mapped_index->document_ordinals = reader.ReadArray<DocumentIdOrdinal>();
+    search_server.word_offsets_ = reader.ReadArray<uint64_t>();
+    search_server.word_term_ids_ = reader.ReadArray<TermId>();
+    search_server.word_term_counts_ = reader.ReadArray<uint32_t>();
+    const auto& word_offsets = search_server.word_offsets_;
+    if (word_offsets.size() != ordinal_count + 1 || word_offsets.back() != search_server.word_term_ids_.size()
+        || search_server.word_term_counts_.size() != search_server.word_term_ids_.size()) {
+        throw corrupted();
+    }
+    const bool ordinals_valid = std::all_of(mapped_index->document_ordinals.begin(), mapped_index->document_ordinals.end(),
+                                            [ordinal_count](const DocumentIdOrdinal& entry) { return entry.ordinal < ordinal_count; });
+    if (!ordinals_valid) {
+        throw corrupted();
+    }
+
+    search_server.mapped_file_ = std::move(file);
+    search_server.mapped_index_ = std::move(mapped_index);
+    return search_server;
+}
+
+SearchServer::MemoryUsage SearchServer::GetMemoryUsage() const {
+    MemoryUsage usage;
+    usage.term_text_bytes = term_texts_.GetMemoryUsage();
+    usage.term_dictionary_bytes = term_dictionary_.GetMemoryUsage() + term_deleted_counts_.capacity() * sizeof(uint32_t);
+    usage.postings_bytes = GetPostingsMemoryUsage();
+
+    size_t document_bytes = ordinal_to_document_id_.capacity() * sizeof(int)
+                            + document_ratings_.capacity() * sizeof(int)
+                            + document_statuses_.capacity() * sizeof(DocumentStatus)
+                            + inverse_document_lengths_.capacity() * sizeof(double)
+                            + deleted_ordinals_.capacity() * sizeof(uint64_t)
+                            + document_ids_.GetMemoryUsage()
+                            + word_offsets_.capacity() * sizeof(uint64_t)
+                            + word_term_ids_.capacity() * sizeof(TermId)
+                            + word_term_counts_.capacity() * sizeof(uint32_t);
+    for (const auto& status_ordinals : status_ordinals_) {
+        document_bytes += status_ordinals.capacity() * sizeof(uint64_t);
+    }
+    usage.document_bytes = document_bytes;
+    return usage;
+}
+
+std::vector<SearchServer::OrdinalRange> SearchServer::SplitOrdinals(DocumentOrdinal ordinal_count,
+                                                                    DocumentOrdinal min_range_size) const {
+    // The calling thread runs ranges too
+    const size_t max_range_count = (GetThreadPool().GetWorkerCount() + 1) * 4;
+    const size_t range_count = std::clamp<size_t>(ordinal_count / min_range_size, 1, max_range_count);
+
+    std::vector<OrdinalRange> ranges;
+    ranges.reserve(range_count);
+    for (size_t i = 0; i < range_count; ++i) {
+        ranges.push_back({ static_cast<DocumentOrdinal>(ordinal_count * i / range_count),
+                           static_cast<DocumentOrdinal>(ordinal_count * (i + 1) / range_count) });
+    }
+    return ranges;
 }
 
 int SearchServer::ComputeAverageRating(const std::vector<int>& ratings) {
@@ -98,26 +1195,26 @@ int SearchServer::ComputeAverageRating(const std::vector<int>& ratings) {
     return rating_sum / static_cast<int>(ratings.size());
 }
 
-void RemoveDuplicates(SearchServer& search_server) {
-    using namespace std;
-    set<int> documentsToRemove;
-    set<vector<string_view>> matchedWords; //   
-    for (int document_id : search_server) {
-        vector<string_view> wordsInDocument;
-        for (auto& [words, _] : search_server.GetWordFrequencies(document_id)) {
-            wordsInDocument.push_back(words);
+std::vector<int> RemoveDuplicates(SearchServer& search_server) {
+    // Ids ascend, so the first document of every word set is kept
+    std::vector<int> duplicate_ids;
+    std::unordered_map<WordSetFingerprint, std::vector<int>, WordSetFingerprintHash> kept_ids;
+    for (const auto& [document_id, fingerprint] : search_server.GetWordSetFingerprints()) {
+        std::vector<int>& same_fingerprint_ids = kept_ids[fingerprint];
+        const bool is_duplicate = std::any_of(same_fingerprint_ids.begin(), same_fingerprint_ids.end(), [&](int kept_id) {
+            return search_server.HasSameWords(kept_id, document_id);
+        });
+        if (is_duplicate) {
+            duplicate_ids.push_back(document_id);
         }
-        if (matchedWords.count(wordsInDocument) > 0) {
-            documentsToRemove.insert(document_id);
-            continue;
+        else {
+            same_fingerprint_ids.push_back(document_id);
         }
-        matchedWords.insert(wordsInDocument);
     }
-    //       
-    for (int removedDocument : documentsToRemove) {
-        cout << "Found duplicate document id " << removedDocument << endl;
-        search_server.RemoveDocument(removedDocument);
+    for (const int document_id : duplicate_ids) {
+        search_server.RemoveDocument(document_id);
     }
+    return duplicate_ids;
 }
 
 void AddDocument(SearchServer& search_server, int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings) {
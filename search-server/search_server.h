@@ -2,14 +2,31 @@
 
 #include <stdexcept>
 #include <algorithm>
+#include <array>
 #include <cmath>
 #include <execution>
-#include <deque>        // garbage with document text
-#include <future>       // for ForEach
+#include <map>
+#include <memory>
+#include <set>
+#include <unordered_map>
+#include <mutex>
+#include <optional>
 #include "log_duration.h"
 #include "document.h"
+#include "document_id_map.h"
 #include "string_processing.h"
-#include "concurrent_map.h"
+#include "score_accumulator.h"
+#include "posting_list.h"
+#include "query_metrics.h"
+#include "query_result_cache.h"
+#include "storage_vector.h"
+#include "term_dictionary.h"
+#include "text_arena.h"
+#include "thread_pool.h"
+#include "top_k.h"
+#include "word_set_fingerprint.h"
+
+class MappedFile;
 
 template <typename ExecutionPolicy, typename ForwardRange, typename Function>   // prototype
 void ForEach(const ExecutionPolicy& policy, ForwardRange& range, Function function);
@@ -17,6 +34,37 @@ void ForEach(const ExecutionPolicy& policy, ForwardRange& range, Function functi
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
 const double EPSILON = 1e-6;
 
+// Order of search results: higher relevance first, relevances closer than EPSILON are compared by rating.
+// The id settles the remaining ties, so the result does not depend on the order documents were scored in
+struct DocumentRelevanceGreater {
+    bool operator()(const Document& lhs, const Document& rhs) const {
+        if (std::abs(lhs.relevance - rhs.relevance) >= EPSILON) {
+            return lhs.relevance > rhs.relevance;
+        }
+        if (lhs.rating != rhs.rating) {
+            return lhs.rating > rhs.rating;
+        }
+        return lhs.id < rhs.id;
+    }
+};
+
+using TopDocuments = TopK<Document, DocumentRelevanceGreater>;
+
+// Collection statistics for scoring a query over several indexes (e.g. segments) with the IDF
+// of their union, so the relevance does not depend on how documents are spread between them
+struct CorpusStatistics {
+    int document_count = 0;
+    std::map<std::string_view, int> document_freqs;   // by query word
+};
+
+// A document of a bulk load batch
+struct NewDocument {
+    int id = 0;
+    std::string_view text;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+};
+
 class SearchServer {
 public:
     // Defines an invalid document id
@@ -46,51 +94,364 @@ public:
 
     SearchServer() = default;
 
+    // A copy has the documents and settings of the original, with its own copy of the terms. It starts
+    // with an empty result cache of the same capacity and with its own metrics if the original has them
+    SearchServer(const SearchServer& other);
+
+    SearchServer& operator=(const SearchServer& other);
+
+    SearchServer(SearchServer&&) = default;
+
+    SearchServer& operator=(SearchServer&&) = default;
+
+    // How queries are scored. MAX_SCORE walks the postings document-at-a-time and skips documents
+    // whose per-term and per-block tf-idf bounds can not beat the current top;
+    // the result is the same as with EXHAUSTIVE scoring of every posting
+    enum class ScoringMode {
+        EXHAUSTIVE,
+        MAX_SCORE,
+    };
+
+    void SetScoringMode(ScoringMode scoring_mode) { scoring_mode_ = scoring_mode; }
+
+    ScoringMode GetScoringMode() const { return scoring_mode_; }
+
+    // Switches every posting list between the flat and the bit packed format (see PostingList).
+    // Compressed postings take several times less memory at the cost of block decoding while scoring
+    void SetPostingsCompression(bool compressed);
+
+    bool IsPostingsCompressed() const { return postings_compressed_; }
+
+    // Heap bytes taken by the posting lists
+    size_t GetPostingsMemoryUsage() const;
+
+    // Heap bytes by part of the index. Map nodes are estimated from their size and links
+    struct MemoryUsage {
+        size_t term_text_bytes = 0;        // arena chunks with the terms
+        size_t term_dictionary_bytes = 0;
+        size_t postings_bytes = 0;
+        size_t document_bytes = 0;         // document columns, id map and forward index
+
+        size_t GetTotal() const {
+            return term_text_bytes + term_dictionary_bytes + postings_bytes + document_bytes;
+        }
+    };
+
+    MemoryUsage GetMemoryUsage() const;
+
+    // Writes the index to a versioned binary file; document texts are not stored
+    void Save(const std::string& path) const;
+
+    // Opens an index written by Save. The file is mapped and queries are served right from
+    // the mapped pages without building maps, so opening takes time proportional to the number
+    // of terms only. The first modification moves the document maps to memory
+    static SearchServer Open(const std::string& path);
+
+    bool IsMapped() const { return mapped_index_ != nullptr; }
+
+    // Caches up to capacity results of queries by status or by predicate key, 0 turns the cache off.
+    // Every modification of the index starts a new generation, which invalidates the cached results
+    void SetResultCacheCapacity(size_t capacity);
+
+    QueryResultCache::Stats GetResultCacheStats() const;
+
+    // Latency histograms of the query stages and counters of the work done by queries: of this server
+    // when it has its own metrics, of every server sharing the default ones otherwise.
+    // Stay empty when built with SEARCH_SERVER_DISABLE_METRICS
+    const QueryMetrics& GetQueryMetrics() const { return GetRecordedQueryMetrics(); }
+
+    void ResetQueryMetrics() { GetRecordedQueryMetrics().Reset(); }
+
+    // Queries are recorded into these metrics instead of the default ones shared by all servers,
+    // so a group of servers (shards, segments) can be measured together
+    void SetQueryMetrics(std::shared_ptr<QueryMetrics> query_metrics) { query_metrics_ = std::move(query_metrics); }
+
+    uint64_t GetGeneration() const { return generation_; }
+
+    // Parallel overloads run on this pool instead of the default one shared by all servers
+    void SetThreadPool(std::shared_ptr<ThreadPool> thread_pool) { thread_pool_ = std::move(thread_pool); }
+
+    ThreadPool& GetThreadPool() const { return thread_pool_ ? *thread_pool_ : ThreadPool::GetDefault(); }
+
+    // What adding a document does when an indexed document has the same set of words
+    enum class DuplicateMode {
+        ALLOW,    // no detection
+        FLAG,     // the document is added and IsDuplicate reports it
+        REJECT,   // std::invalid_argument is thrown and nothing is added
+    };
+
+    // Detection looks the documents up by word set fingerprint and compares the words of the ones
+    // with the same fingerprint, so a full RemoveDuplicates pass is not needed. Turning it on
+    // fingerprints the indexed documents on the thread pool
+    void SetDuplicateMode(DuplicateMode mode);
+
+    DuplicateMode GetDuplicateMode() const { return duplicate_mode_; }
+
+    // True for a document added as a duplicate in the FLAG mode
+    bool IsDuplicate(int document_id) const { return flagged_duplicates_.count(document_id) > 0; }
+
+    // Zero fingerprint for an unknown document
+    WordSetFingerprint GetWordSetFingerprint(int document_id) const;
+
+    // (id, fingerprint) of every document in ascending id order, computed on the thread pool
+    std::vector<std::pair<int, WordSetFingerprint>> GetWordSetFingerprints() const;
+
+    // True when both documents are indexed and have the same set of distinct words
+    bool HasSameWords(int lhs_document_id, int rhs_document_id) const;
+
     void AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
 
+    // Bulk load: the batch is split into ranges tokenized and indexed into partial indexes in parallel,
+    // which are then appended to the index. Adds all documents or, if any of them is invalid, none.
+    // The sequential policy and batches below MIN_PARALLEL_LOAD_SIZE index the documents one by one
+    // instead: building and merging partial indexes only pays off in parallel
+    void AddDocuments(const std::vector<NewDocument>& documents);
+
+    template <typename ExecPolicy>
+    void AddDocuments(ExecPolicy&& policy, const std::vector<NewDocument>& documents) {
+        Detach();
+        CheckNewDocumentIds(documents);
+        if constexpr (std::is_same_v<std::decay_t<ExecPolicy>, std::execution::sequenced_policy>) {
+            AddDocumentsSequentially(documents);
+            return;
+        }
+        if (documents.size() < MIN_PARALLEL_LOAD_SIZE) {
+            AddDocumentsSequentially(documents);
+            return;
+        }
+        const auto first_ordinal = static_cast<DocumentOrdinal>(ordinal_to_document_id_.size());
+
+        std::vector<PartialIndex> partial_indexes;
+        for (const OrdinalRange range : SplitOrdinals(static_cast<DocumentOrdinal>(documents.size()), MIN_LOAD_RANGE_SIZE)) {
+            partial_indexes.emplace_back();
+            partial_indexes.back().range = range;
+        }
+        // Nothing is modified until every partial index is built, so an invalid document leaves the index as it was
+        ForEachIndex(policy, partial_indexes.size(), [&](size_t i) {
+            BuildPartialIndex(documents, first_ordinal, partial_indexes[i]);
+        });
+        CheckNewDocumentDuplicates(partial_indexes);
+
+        // Terms are added in order, so term ids do not depend on the policy
+        for (PartialIndex& partial_index : partial_indexes) {
+            partial_index.term_ids.reserve(partial_index.terms.size());
+            for (const std::string_view term : partial_index.terms) {
+                partial_index.term_ids.push_back(AddTerm(term));
+            }
+        }
+        AddNewDocumentData(documents, partial_indexes);
+
+        // Postings of different terms are independent, so every partial index is appended term by term
+        // in parallel. Partial indexes go in order to keep the posting lists sorted by ordinal
+        for (const PartialIndex& partial_index : partial_indexes) {
+            const std::vector<TermId>& term_ids = partial_index.term_ids;
+            const double* inverse_lengths = inverse_document_lengths_.data();
+            ForEachIndex(policy, term_ids.size(), [&](size_t local_term_id) {
+                PostingList& postings = term_postings_[term_ids[local_term_id]];
+                for (const auto& [ordinal, term_count] : partial_index.postings[local_term_id]) {
+                    postings.Append(ordinal, term_count, term_count * inverse_lengths[ordinal]);
+                }
+            });
+        }
+        ++generation_;
+    }
+
+    // max_result_count limits the result size per query (MAX_RESULT_DOCUMENT_COUNT by default)
     template <typename DocumentPredicate>
-    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate) const {
-        return FindTopDocuments(std::execution::seq, raw_query, document_predicate);
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate,
+                                           size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const {
+        return FindTopDocuments(std::execution::seq, raw_query, document_predicate, max_result_count);
     }
 
-    // Вызывает версию с предикатом
+    // Вызывает версию с фильтром
     template <typename ExecPolicy>
-    std::vector<Document> FindTopDocuments(ExecPolicy&& policy, const std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL) const {
-        return FindTopDocuments(policy, raw_query, [status] (   // predicate
-                [[maybe_unused]] int document_id, DocumentStatus document_status, [[maybe_unused]] int rating) {
-            return document_status == status;
-        });
+    std::vector<Document> FindTopDocuments(ExecPolicy&& policy, const std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL,
+                                           size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const {
+        return FindTopDocuments(policy, raw_query, DocumentFilter{ status }, max_result_count);
+    }
+
+    // Candidates are checked with a bit of the status bitmap or of a bitmap built for the rating bounds,
+    // so a structured filter costs much less than a predicate doing the same
+    template <typename ExecPolicy>
+    std::vector<Document> FindTopDocuments(ExecPolicy&& policy, const std::string_view raw_query, const DocumentFilter& filter,
+                                           size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const {
+        return FindTopDocumentsCached(policy, raw_query, MakeStructuredFilter(filter),
+                                      filter.status ? static_cast<int>(*filter.status) : -1, GetFilterKey(filter), max_result_count);
+    }
+
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, const DocumentFilter& filter,
+                                           size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const {
+        return FindTopDocuments(std::execution::seq, raw_query, filter, max_result_count);
+    }
+
+    // Search-after pagination: up to page_size documents following the cursor, in the order of the other
+    // overloads. Documents before the cursor are not retained, so a deep page costs about as much as the
+    // first one. Pass SearchCursor(page.back()) for the next page. Pages are not cached
+    template <typename ExecPolicy>
+    std::vector<Document> FindTopDocuments(ExecPolicy&& policy, const std::string_view raw_query, const DocumentFilter& filter,
+                                           size_t page_size, const SearchCursor& after) const {
+        QUERY_METRICS_STAGE(GetRecordedQueryMetrics(), QueryStage::QUERY);
+        QUERY_METRICS_ADD(GetRecordedQueryMetrics(), QueryCounter::QUERIES, 1);
+        const auto query = ParseQuery(raw_query);
+        TopDocuments top_documents(page_size, DocumentRelevanceGreater(), after.last_document_);
+        FindAllDocuments(policy, query, MakeStructuredFilter(filter), top_documents, nullptr);
+        return ExtractDocuments(top_documents);
+    }
+
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, const DocumentFilter& filter,
+                                           size_t page_size, const SearchCursor& after) const {
+        return FindTopDocuments(std::execution::seq, raw_query, filter, page_size, after);
+    }
+
+    // Predicate version with the result cache: equal predicate keys must mean equal predicates.
+    // Keys starting with "filter:" are taken by structured filters
+    template <typename ExecPolicy, typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(ExecPolicy&& policy, const std::string_view raw_query, DocumentPredicate document_predicate,
+                                           const std::string_view predicate_key,
+                                           size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const {
+        return FindTopDocumentsCached(policy, raw_query, MakePredicateFilter(document_predicate), -1, predicate_key, max_result_count);
     }
 
     // new version with Execution policy (Final task sprint9)
     template <typename ExecPolicy, typename DocumentPredicate>
-    std::vector<Document> FindTopDocuments(ExecPolicy&& policy, const std::string_view raw_query, DocumentPredicate document_predicate) const {
-        auto query = ParseQuery(raw_query);
-        auto matched_documents = FindAllDocuments(policy, query, document_predicate);
+    std::vector<Document> FindTopDocuments(ExecPolicy&& policy, const std::string_view raw_query, DocumentPredicate document_predicate,
+                                           size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const {
+        QUERY_METRICS_STAGE(GetRecordedQueryMetrics(), QueryStage::QUERY);
+        QUERY_METRICS_ADD(GetRecordedQueryMetrics(), QueryCounter::QUERIES, 1);
+        const auto query = ParseQuery(raw_query);
+        TopDocuments top_documents(max_result_count);
+        FindAllDocuments(policy, query, MakePredicateFilter(document_predicate), top_documents, nullptr);
+        return ExtractDocuments(top_documents);
+    }
+
+    // Scores with the document count and word document frequencies of corpus_statistics
+    // instead of the ones of this index
+    template <typename ExecPolicy, typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(ExecPolicy&& policy, const std::string_view raw_query, DocumentPredicate document_predicate,
+                                           size_t max_result_count, const CorpusStatistics& corpus_statistics) const {
+        QUERY_METRICS_STAGE(GetRecordedQueryMetrics(), QueryStage::QUERY);
+        QUERY_METRICS_ADD(GetRecordedQueryMetrics(), QueryCounter::QUERIES, 1);
+        const auto query = ParseQuery(raw_query);
+        TopDocuments top_documents(max_result_count);
+        FindAllDocuments(policy, query, MakePredicateFilter(document_predicate), top_documents, &corpus_statistics);
+        return ExtractDocuments(top_documents);
+    }
+
+    template <typename ExecPolicy>
+    std::vector<Document> FindTopDocuments(ExecPolicy&& policy, const std::string_view raw_query, const DocumentFilter& filter,
+                                           size_t max_result_count, const CorpusStatistics& corpus_statistics) const {
+        QUERY_METRICS_STAGE(GetRecordedQueryMetrics(), QueryStage::QUERY);
+        QUERY_METRICS_ADD(GetRecordedQueryMetrics(), QueryCounter::QUERIES, 1);
+        const auto query = ParseQuery(raw_query);
+        TopDocuments top_documents(max_result_count);
+        FindAllDocuments(policy, query, MakeStructuredFilter(filter), top_documents, &corpus_statistics);
+        return ExtractDocuments(top_documents);
+    }
+
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status,
+                                           size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query) const;
+
+    // Runs a batch of queries on the thread pool, the results are the ones of FindTopDocuments(query, status)
+    // in query order. Repeated queries are run once, every distinct word is looked up once for the whole
+    // batch, and queries sharing words are scored together, decoding every block of postings once for all of them
+    std::vector<std::vector<Document>> FindTopDocumentsBatch(const std::vector<std::string_view>& raw_queries,
+                                                             DocumentStatus status = DocumentStatus::ACTUAL,
+                                                             size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    std::vector<std::vector<Document>> FindTopDocumentsBatch(const std::vector<std::string>& raw_queries,
+                                                             DocumentStatus status = DocumentStatus::ACTUAL,
+                                                             size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const {
+        return FindTopDocumentsBatch(std::vector<std::string_view>(raw_queries.begin(), raw_queries.end()), status, max_result_count);
+    }
+
+    // The same batch run on the calling thread only, for callers that run batches in parallel themselves
+    std::vector<std::vector<Document>> FindTopDocumentsBatch(const std::execution::sequenced_policy& policy,
+                                                             const std::vector<std::string_view>& raw_queries,
+                                                             DocumentStatus status = DocumentStatus::ACTUAL,
+                                                             size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    int GetDocumentCount() const {
+        return static_cast<int>(IsMapped() ? mapped_index_->document_ordinals.size() : document_ids_.size());
+    }
+
+    bool HasDocument(int document_id) const { return FindOrdinal(document_id) != PostingList::END_ORDINAL; }
+
+    // Indexed words matching a query word pattern, in which '*' stands for any sequence of characters
+    // and '?' for any one character. A query word with wildcards is replaced by these words
+    std::vector<std::string_view> FindMatchingWords(const std::string_view pattern) const;
+
+    // Number of documents containing the word
+    int GetWordDocumentCount(const std::string_view word) const {
+        const TermId term_id = term_dictionary_.Find(word);
+        return term_id == TermDictionary::INVALID_TERM_ID ? 0 : GetTermDocumentCount(term_id);
+    }
 
-        sort(policy, matched_documents.begin(), matched_documents.end(), [](const Document& lhs, const Document& rhs) {
-            if (std::abs(lhs.relevance - rhs.relevance) < EPSILON) {
-                return lhs.rating > rhs.rating;
+    struct DocumentIdOrdinal {
+        int id;
+        DocumentOrdinal ordinal;
+    };
+
+    // Iterates document ids in ascending order, over the id map or over the ids of a mapped file
+    class DocumentIdIterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = int;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const int*;
+        using reference = const int&;
+
+        DocumentIdIterator() = default;
+
+        explicit DocumentIdIterator(DocumentIdMap::Iterator map_it)
+            : map_it_(map_it)
+        {
+        }
+
+        explicit DocumentIdIterator(const DocumentIdOrdinal* array_it)
+            : array_it_(array_it)
+        {
+        }
+
+        reference operator*() const {
+            return array_it_ != nullptr ? array_it_->id : *map_it_;
+        }
+
+        DocumentIdIterator& operator++() {
+            if (array_it_ != nullptr) {
+                ++array_it_;
             }
             else {
-                return lhs.relevance > rhs.relevance;
+                ++map_it_;
             }
-        });
+            return *this;
+        }
 
-        if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-            matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+        DocumentIdIterator operator++(int) {
+            DocumentIdIterator previous = *this;
+            ++*this;
+            return previous;
         }
-        return matched_documents;
-    }
 
-    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status) const;
-    std::vector<Document> FindTopDocuments(const std::string_view raw_query) const;
+        bool operator==(const DocumentIdIterator& other) const {
+            return array_it_ == other.array_it_ && map_it_ == other.map_it_;
+        }
+
+        bool operator!=(const DocumentIdIterator& other) const {
+            return !(*this == other);
+        }
 
-    int GetDocumentCount() const { return static_cast<int>(documents_.size()); }
+    private:
+        DocumentIdMap::Iterator map_it_;
+        const DocumentIdOrdinal* array_it_ = nullptr;
+    };
 
-    std::set<int>::const_iterator begin() const { return document_ids_.begin(); }
+    DocumentIdIterator begin() const {
+        return IsMapped() ? DocumentIdIterator(mapped_index_->document_ordinals.begin()) : DocumentIdIterator(document_ids_.begin());
+    }
 
-    std::set<int>::const_iterator end() const { return document_ids_.end(); }
+    DocumentIdIterator end() const {
+        return IsMapped() ? DocumentIdIterator(mapped_index_->document_ordinals.end()) : DocumentIdIterator(document_ids_.end());
+    }
 
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::string_view raw_query, int document_id) const;
 
@@ -98,84 +459,286 @@ public:
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(
             ExecPolicy&& policy, const std::string_view raw_query, int document_id) const {
 
-        if (documents_.count(document_id) == 0) {
+        const DocumentOrdinal ordinal = FindOrdinal(document_id);
+        if (ordinal == PostingList::END_ORDINAL) {
             throw std::invalid_argument(" ");
         }
         const Query query = ParseQuery(policy, raw_query);
+        const DocumentStatus status = document_statuses_[ordinal];
 
-        auto checker = [this, document_id](const auto word) {
-            return word_to_document_freqs_.count(word) > 0 &&
-                   word_to_document_freqs_.at(word).count(document_id);
+        // Every word is looked up separately, the flags keep the words in query order
+        const auto find_words = [&](const std::vector<std::string_view>& words) {
+            std::vector<char> found(words.size());
+            ForEachIndex(policy, words.size(), [&](size_t i) {
+                const PostingList* postings = FindPostings(words[i]);
+                found[i] = postings != nullptr && postings->Contains(ordinal);
+            });
+            return found;
         };
 
-        if (std::any_of(policy, query.minus_words.begin(), query.minus_words.end(), checker)) {
-            return {std::vector<std::string_view>{}, documents_.at(document_id).status};
+        const std::vector<char> found_minus_words = find_words(query.minus_words);
+        if (std::find(found_minus_words.begin(), found_minus_words.end(), true) != found_minus_words.end()) {
+            return {std::vector<std::string_view>{}, status};
         }
 
-        std::vector<std::string_view> matched_words(query.plus_words.size());
-        auto it = std::copy_if(policy,
-                               query.plus_words.begin(),
-                               query.plus_words.end(),
-                               matched_words.begin(),
-                               checker);
+        const std::vector<char> found_plus_words = find_words(query.plus_words);
+        std::vector<std::string_view> matched_words;
+        for (size_t i = 0; i < query.plus_words.size(); ++i) {
+            if (found_plus_words[i]) {
+                matched_words.push_back(query.plus_words[i]);
+            }
+        }
 
-        if constexpr (!std::is_same_v<std::execution::sequenced_policy, ExecPolicy>) {
-            std::sort(policy, matched_words.begin(), it);
-            it = std::unique(policy, matched_words.begin(), it);
-            matched_words.erase(it, matched_words.end());
+        if constexpr (!std::is_same_v<std::execution::sequenced_policy, std::decay_t<ExecPolicy>>) {
+            std::sort(matched_words.begin(), matched_words.end());   // the parallel ParseQuery keeps repeats
+            matched_words.erase(std::unique(matched_words.begin(), matched_words.end()), matched_words.end());
         }
-        return {matched_words, documents_.at(document_id).status};
+        return {matched_words, status};
     }
 
-    const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
+    // Built from the forward index on every call and not kept; empty for an unknown document.
+    // The words point into the index and stay valid until a document is removed
+    std::map<std::string_view, double> GetWordFrequencies(int document_id) const;
+
+    // Calls function(word, term_count) for every distinct word of the document in word order,
+    // straight from the forward index. Nothing is called for an unknown document
+    template <typename Function>
+    void ForEachDocumentWord(int document_id, Function function) const {
+        const DocumentOrdinal ordinal = FindOrdinal(document_id);
+        if (ordinal == PostingList::END_ORDINAL) {
+            return;
+        }
+        for (uint64_t i = word_offsets_[ordinal]; i < word_offsets_[ordinal + 1]; ++i) {
+            function(term_dictionary_.GetTerm(word_term_ids_[i]), word_term_counts_[i]);
+        }
+    }
 
+    // Copies the indexed documents of source accepted by document_predicate(id, status, rating)
+    // without tokenizing their text again. The words are copied, so source may be destroyed afterwards
+    template <typename DocumentPredicate>
+    void AddDocuments(const SearchServer& source, DocumentPredicate document_predicate) {
+        Detach();
+        for (DocumentOrdinal ordinal = 0; ordinal < source.ordinal_to_document_id_.size(); ++ordinal) {
+            const int document_id = source.ordinal_to_document_id_[ordinal];
+            if (document_id == INVALID_DOCUMENT_ID) {
+                continue;
+            }
+            if (document_predicate(document_id, source.document_statuses_[ordinal], source.document_ratings_[ordinal])) {
+                CopyDocument(source, ordinal);
+            }
+        }
+        ++generation_;
+    }
+
+    // A removed document is only marked in the deleted bitmap, scoring skips it.
+    // Its postings are purged by Compact(), which runs by itself once the deleted ratio
+    // exceeds the auto compaction ratio
     void RemoveDocument(int document_id);
 
+    // Marking the document is cheap, only the compaction it may trigger runs with the policy
     template <typename ExecPolicy>
     void RemoveDocument(ExecPolicy&& policy, int document_id) {
-        if (documents_.count(document_id) == 0) return;
-        documents_.erase(document_id);
+        if (MarkDeleted(document_id) && NeedsCompaction()) {
+            Compact(policy);
+        }
+    }
+
+    struct DeletionStats {
+        int deleted_document_count = 0;   // removed documents still present in the postings
+        int document_count = 0;
+        double deleted_ratio = 0.0;       // share of removed documents among all in the postings
+    };
 
-        const std::map<std::string_view, double>& wordsToFreqs = GetWordFrequencies(document_id);
-        std::vector<std::string_view> words(wordsToFreqs.size());
+    DeletionStats GetDeletionStats() const;
 
-        for (auto& [word, _] : document_to_word_freqs_.at(document_id)) {
-            words.push_back(word);
+    // RemoveDocument compacts the index when the deleted ratio gets greater than ratio;
+    // 1 turns automatic compaction off
+    void SetAutoCompactionRatio(double ratio) { auto_compaction_ratio_ = ratio; }
+
+    double GetAutoCompactionRatio() const { return auto_compaction_ratio_; }
+
+    // Purges removed documents from the posting lists in one batch and renumbers the documents left,
+    // so the ordinal indexed arrays, the bitmaps and the forward index shrink to the live documents
+    void Compact();
+
+    template <typename ExecPolicy>
+    void Compact(ExecPolicy&& policy) {
+        Detach();
+        if (deleted_document_count_ == 0) {
+            return;
         }
-        
-        std::for_each(policy, words.begin(), words.end(), [&](std::string_view word) {
-            if (word_to_document_freqs_.count(word) > 0) {
-                word_to_document_freqs_.at(word).erase(document_id);
+        const std::vector<DocumentOrdinal> new_ordinals = MakeCompactedOrdinals();
+        StorageVector<double> inverse_lengths;   // by new ordinal
+        inverse_lengths.reserve(document_ids_.size());
+        for (DocumentOrdinal ordinal = 0; ordinal < new_ordinals.size(); ++ordinal) {
+            if (new_ordinals[ordinal] != PostingList::END_ORDINAL) {
+                inverse_lengths.push_back(inverse_document_lengths_[ordinal]);
             }
+        }
+        const double* old_inverse_lengths = inverse_document_lengths_.data();
+        ForEachIndex(policy, term_postings_.size(), [&](size_t term_id) {
+            term_postings_[term_id].Renumber(new_ordinals.data(), old_inverse_lengths, inverse_lengths.data());
         });
-        document_to_word_freqs_.erase(document_id);
-        document_ids_.erase(document_id);
+        inverse_document_lengths_ = std::move(inverse_lengths);
+        for (TermId term_id = 0; term_id < term_deleted_counts_.size(); ++term_id) {
+            term_deleted_counts_[term_id] = 0;
+        }
+        deleted_document_count_ = 0;
+        RenumberDocuments(new_ordinals);
+        ReclaimTerms();
+        ++generation_;
     }
 
 private:
-    struct DocumentData {
-        int rating;
-        DocumentStatus status;
+    inline static constexpr size_t STATUS_COUNT = static_cast<size_t>(DocumentStatus::REMOVED) + 1;
+
+    // Ids of an index opened from a file, binary searched until the index is modified
+    struct MappedIndex {
+        StorageVector<DocumentIdOrdinal> document_ordinals;   // sorted by id
     };
 
-    std::deque<std::string> words_;
+    inline static constexpr uint64_t INDEX_FILE_MAGIC = 0x5844'4e49'4843'5253;   // "SRCHINDX"
+    inline static constexpr uint32_t INDEX_FILE_VERSION = 2;
+
+    // The copy constructor lists the members one by one: a member added here must be added there as well
     std::set<std::string, std::less<>> stop_words_;
-    std::map<std::string_view, std::map<int, double>, std::less<>> word_to_document_freqs_;
-    std::map<int, std::map<std::string_view, double>> document_to_word_freqs_;
-    std::map<int, DocumentData> documents_;
-    std::set<int> document_ids_;
+    TextArena term_texts_;   // every term stored once, the index points here instead of document texts
+    TermDictionary term_dictionary_;
+    std::vector<PostingList> term_postings_;   // indexed by TermId
+    StorageVector<uint32_t> term_deleted_counts_;   // postings of removed documents, indexed by TermId
+    DocumentIdMap document_ids_;   // ids are translated to ordinals at the API boundary only
+    // Indexed by ordinal
+    StorageVector<int> ordinal_to_document_id_;  // INVALID_DOCUMENT_ID for removed documents until compaction
+    StorageVector<int> document_ratings_;
+    StorageVector<DocumentStatus> document_statuses_;
+    StorageVector<double> inverse_document_lengths_;   // 1 / word count
+    StorageVector<uint64_t> deleted_ordinals_;   // bitmap of removed documents
+    // Bitmaps of the documents by DocumentStatus, removed documents are not in any of them
+    std::array<StorageVector<uint64_t>, STATUS_COUNT> status_ordinals_;
+    // Forward index: the words of the document with ordinal i are [word_offsets_[i], word_offsets_[i + 1])
+    // in word order. Compaction drops removed documents along with their words
+    StorageVector<uint64_t> word_offsets_;
+    StorageVector<TermId> word_term_ids_;
+    StorageVector<uint32_t> word_term_counts_;
+    int deleted_document_count_ = 0;           // removed documents not compacted yet
+    double auto_compaction_ratio_ = 0.25;
+    bool postings_compressed_ = false;
+    ScoringMode scoring_mode_ = ScoringMode::MAX_SCORE;
+    std::shared_ptr<const MappedFile> mapped_file_;   // keeps the arrays of an opened index valid
+    std::shared_ptr<MappedIndex> mapped_index_;       // null unless the document ids are in the file
+    std::unique_ptr<QueryResultCache> result_cache_;
+    std::shared_ptr<ThreadPool> thread_pool_;   // null for the default pool
+    std::shared_ptr<QueryMetrics> query_metrics_;   // null for the default metrics
+    DuplicateMode duplicate_mode_ = DuplicateMode::ALLOW;
+    // Ids of the documents by word set fingerprint, empty in the ALLOW mode
+    std::unordered_map<WordSetFingerprint, std::vector<int>, WordSetFingerprintHash> fingerprint_documents_;
+    std::set<int> flagged_duplicates_;
+    uint64_t generation_ = 0;   // number of modifications
 
-    bool IsStopWord(const std::string_view word) const {
-        return stop_words_.count(std::string(word)) > 0;
+    QueryMetrics& GetRecordedQueryMetrics() const {
+        return query_metrics_ ? *query_metrics_ : QueryMetrics::GetDefault();
     }
 
-    bool IsValidWord(const std::string_view word) const {
-        return IsValidWord(std::execution::seq, word);
+    // Number of documents with the term that are not removed
+    int GetTermDocumentCount(TermId term_id) const {
+        return static_cast<int>(term_postings_[term_id].Size() - term_deleted_counts_[term_id]);
     }
 
-    template <typename ExecPolicy>
-    bool IsValidWord(ExecPolicy&& policy, const std::string_view word) const {
-        return std::none_of(policy, word.begin(), word.end(), [](char symbol) {
+    // Calls function(i) for every i in [0, count): in order with the sequenced policy, on the thread pool otherwise
+    template <typename ExecPolicy, typename Function>
+    void ForEachIndex([[maybe_unused]] ExecPolicy&& policy, size_t count, Function function) const {
+        if constexpr (std::is_same_v<std::decay_t<ExecPolicy>, std::execution::sequenced_policy>) {
+            for (size_t i = 0; i < count; ++i) {
+                function(i);
+            }
+        }
+        else {
+            GetThreadPool().ParallelFor(count, function);
+        }
+    }
+
+    // Returns the id of the word, storing a new term with its postings
+    TermId AddTerm(const std::string_view word);
+
+    // Compaction leaves the terms of removed documents without postings. Once they are
+    // at least half of the terms, the term storage is rebuilt with the live terms only
+    void ReclaimTerms();
+
+    // Sorts the words and calls function(word, count) for every distinct word in order
+    template <typename Function>
+    static void ForEachWordCount(std::vector<std::string_view>& words, Function function) {
+        std::sort(words.begin(), words.end());
+        for (auto it = words.begin(); it != words.end();) {
+            const auto next = std::find_if(it + 1, words.end(), [it](std::string_view word) { return word != *it; });
+            function(*it, static_cast<uint32_t>(next - it));
+            it = next;
+        }
+    }
+
+    // Appends the document to the ordinal indexed arrays, returns its ordinal.
+    // Its words are added to the forward index by AddDocumentWord
+    DocumentOrdinal AddOrdinal(int document_id, int rating, DocumentStatus status, double inv_word_count);
+
+    void AddDocumentWord(TermId term_id, uint32_t term_count) {
+        word_term_ids_.push_back(term_id);
+        word_term_counts_.push_back(term_count);
+        word_offsets_.back() = word_term_ids_.size();
+    }
+
+    // New ordinal of every ordinal: removed documents get END_ORDINAL, the others are numbered in order
+    std::vector<DocumentOrdinal> MakeCompactedOrdinals() const;
+
+    // Moves the documents to their new ordinals in the id map, the ordinal indexed arrays, the bitmaps
+    // and the forward index, dropping the removed ones. Inverse lengths and postings are renumbered by Compact
+    void RenumberDocuments(const std::vector<DocumentOrdinal>& new_ordinals);
+
+    // PostingList::END_ORDINAL for an unknown document
+    DocumentOrdinal FindOrdinal(int document_id) const;
+
+    bool IsDeleted(DocumentOrdinal ordinal) const {
+        return (deleted_ordinals_[ordinal / 64] >> (ordinal % 64)) & 1;
+    }
+
+    // False for a removed document
+    bool HasStatus(DocumentOrdinal ordinal, DocumentStatus status) const {
+        return (status_ordinals_[static_cast<size_t>(status)][ordinal / 64] >> (ordinal % 64)) & 1;
+    }
+
+    // Returns false for an unknown document
+    bool MarkDeleted(int document_id);
+
+    // Moves the document ids of an opened index to the id map before a modification
+    void Detach();
+
+    WordSetFingerprint ComputeWordSetFingerprint(DocumentOrdinal ordinal) const;
+
+    // True when the document has exactly these distinct words, given in order
+    bool HasWords(DocumentOrdinal ordinal, const std::vector<std::string_view>& words) const;
+
+    bool HasSameWordSet(DocumentOrdinal lhs, DocumentOrdinal rhs) const;
+
+    // Throws in the REJECT mode if an indexed document has the same fingerprint and the same words
+    void CheckDuplicate(const WordSetFingerprint& fingerprint, const std::vector<std::string_view>& words) const;
+
+    // Files the fingerprint of an added document, flagging a duplicate in the FLAG mode
+    void RegisterFingerprint(int document_id, DocumentOrdinal ordinal, const WordSetFingerprint& fingerprint);
+
+    bool NeedsCompaction() const {
+        return GetDeletionStats().deleted_ratio > auto_compaction_ratio_;
+    }
+
+    const PostingList* FindPostings(const std::string_view word) const {
+        const TermId term_id = term_dictionary_.Find(word);
+        return term_id == TermDictionary::INVALID_TERM_ID ? nullptr : &term_postings_[term_id];
+    }
+
+    bool IsStopWord(const std::string_view word) const {
+        return !stop_words_.empty() && stop_words_.find(word) != stop_words_.end();
+    }
+
+    // Texts are checked by SplitIntoWordsValidated while being split, this is for single words
+    static bool IsValidWord(const std::string_view word) {
+        return std::none_of(word.begin(), word.end(), [](char symbol) {
             return symbol >= '\0' && symbol < ' '; });
     }
 
@@ -187,14 +750,11 @@ private:
         std::string_view data;
         bool is_minus;
         bool is_stop;
+        bool is_pattern;   // has wildcards, stands for the indexed words matching it
     };
 
-    [[nodiscard]] QueryWord ParseQueryWord(const std::string_view text) const {
-        return ParseQueryWord(std::execution::seq, text);
-    }
-
-    template <typename ExecutionPolicy>
-    [[nodiscard]] QueryWord ParseQueryWord(ExecutionPolicy&& policy, const std::string_view text) const {
+    // has_control_chars comes from the tokenizer, which looks for them in the whole query at once
+    [[nodiscard]] QueryWord ParseQueryWord(const std::string_view text, bool has_control_chars) const {
         using namespace std::literals;
         if (text.empty()) {
             throw std::invalid_argument("Query word is empty"s);
@@ -205,10 +765,10 @@ private:
             is_minus = true;
             word = word.substr(1);
         }
-        if (word.empty() || word[0] == '-' || !IsValidWord(policy, word)) {
+        if (word.empty() || word[0] == '-' || has_control_chars) {
             throw std::invalid_argument("Query word "s + text.data() + " is invalid");
         }
-        return { word, is_minus, IsStopWord(word) };
+        return { word, is_minus, IsStopWord(word), IsWildcardPattern(word) };
     }
 
     struct Query {
@@ -245,17 +805,26 @@ private:
 
     template <typename ExecPolicy>
     Query ParseQuery(ExecPolicy policy, const std::string_view text) const {
-        const auto query_words = SplitIntoWordsView(text);
+        QUERY_METRICS_STAGE(GetRecordedQueryMetrics(), QueryStage::PARSE);
+        std::vector<std::string_view> query_words;
+        const size_t invalid_word = SplitIntoWordsValidated(text, query_words);
         Query result;
         result.plus_words.reserve(query_words.size());
 
-        for (const auto word : query_words) {
-            const auto query_word = ParseQueryWord(word);
+        for (size_t i = 0; i < query_words.size(); ++i) {
+            const auto query_word = ParseQueryWord(query_words[i], i == invalid_word);
             if (query_word.is_stop)
                 continue;
-            query_word.is_minus ?
-            result.minus_words.emplace_back(query_word.data) :
-            result.plus_words.emplace_back(query_word.data);
+            std::vector<std::string_view>& words = query_word.is_minus ? result.minus_words : result.plus_words;
+            if (query_word.is_pattern) {
+                // Every matching word is a query word of its own, so all their postings are scored in one pass
+                for (const TermId term_id : term_dictionary_.FindMatching(query_word.data)) {
+                    words.push_back(term_dictionary_.GetTerm(term_id));
+                }
+            }
+            else {
+                words.push_back(query_word.data);
+            }
         }
         if constexpr (std::is_same_v<std::execution::sequenced_policy, ExecPolicy>) {
             result.RemoveDuplicates();
@@ -263,87 +832,502 @@ private:
         return result;
     }
 
-    // Existence required
-    double ComputeWordInverseDocumentFreq(const std::string_view word) const {
-        return log(GetDocumentCount() * 1.0 / static_cast<int>(word_to_document_freqs_.at(word).size()));
+    template <typename ExecPolicy, typename MakeFilter>
+    std::vector<Document> FindTopDocumentsCached(ExecPolicy&& policy, const std::string_view raw_query, MakeFilter make_filter,
+                                                 int status, const std::string_view predicate_key, size_t max_result_count) const {
+        QUERY_METRICS_STAGE(GetRecordedQueryMetrics(), QueryStage::QUERY);
+        QUERY_METRICS_ADD(GetRecordedQueryMetrics(), QueryCounter::QUERIES, 1);
+        const auto query = ParseQuery(raw_query);
+        std::optional<QueryResultCache::Key> key;
+        if (result_cache_) {
+            key = QueryResultCache::Key{ NormalizeQuery(query), status, std::string(predicate_key), max_result_count };
+            if (auto documents = result_cache_->Find(*key, generation_)) {
+                return std::move(*documents);
+            }
+        }
+        TopDocuments top_documents(max_result_count);
+        FindAllDocuments(policy, query, make_filter, top_documents, nullptr);
+        auto documents = ExtractDocuments(top_documents);
+        if (key) {
+            result_cache_->Insert(*key, generation_, documents);
+        }
+        return documents;
+    }
+
+    std::vector<Document> ExtractDocuments(TopDocuments& top_documents) const {
+        QUERY_METRICS_STAGE(GetRecordedQueryMetrics(), QueryStage::SORT);
+        return std::move(top_documents).Extract();
     }
 
+    // Text of the parsed query that does not depend on word order and repeats
+    static std::string NormalizeQuery(const Query& query);
+
+    struct ScoredPostings {
+        const PostingList* postings;
+        double inverse_document_freq;
+    };
+
+    struct OrdinalRange {
+        DocumentOrdinal begin;
+        DocumentOrdinal end;
+    };
+
+    // Distinct queries of a batch with their words resolved once for the whole batch
+    struct QueryBatch {
+        struct BatchQuery {
+            std::vector<uint32_t> plus_terms;    // indexes in terms, ascending like the words
+            std::vector<uint32_t> minus_terms;
+        };
+
+        std::vector<ScoredPostings> terms;   // by distinct word of the batch in word order
+        std::vector<BatchQuery> queries;
+        std::vector<std::vector<size_t>> groups;   // queries scored together
+    };
+
+    // Queries with common words go to the same group. The group accumulators
+    // take BATCH_GROUP_SIZE * MIN_SCORING_RANGE_SIZE scores, which stay in the cache
+    inline static constexpr size_t BATCH_GROUP_SIZE = 32;
+
+    template <typename ExecPolicy>
+    std::vector<std::vector<Document>> FindTopDocumentsBatchImpl(ExecPolicy&& policy, const std::vector<std::string_view>& raw_queries,
+                                                                 DocumentStatus status, size_t max_result_count) const;
+
+    // Scores the queries of a group term at a time range by range, results go to results[query]
+    void ScoreQueryGroup(const QueryBatch& batch, const std::vector<size_t>& group, DocumentStatus status,
+                         size_t max_result_count, std::vector<std::vector<Document>>& results) const;
+
+    // Splits [0, ordinal_count) into ranges scored or indexed in parallel, a few per thread of the pool
+    // of the server. Small ranges are not worth a task of their own
+    std::vector<OrdinalRange> SplitOrdinals(DocumentOrdinal ordinal_count, DocumentOrdinal min_range_size) const;
+
+    inline static constexpr DocumentOrdinal MIN_SCORING_RANGE_SIZE = 4096;
+    inline static constexpr DocumentOrdinal MIN_LOAD_RANGE_SIZE = 256;
+    inline static constexpr size_t MIN_PARALLEL_LOAD_SIZE = 4096;
+
+    // Index of a range of a bulk load batch. Terms point into the batch texts, ordinals are already global.
+    // Local terms need no term order, so a plain hash map numbers them
+    struct PartialIndex {
+        OrdinalRange range;   // positions in the batch
+        std::unordered_map<std::string_view, TermId> local_term_ids;
+        std::vector<std::string_view> terms;   // by local TermId
+        std::vector<std::vector<std::pair<DocumentOrdinal, uint32_t>>> postings;   // (ordinal, term count) by local TermId
+        std::vector<std::pair<TermId, uint32_t>> document_terms;   // (local TermId, term count) of all documents by term
+        std::vector<size_t> document_term_offsets;   // document i has [offsets[i], offsets[i + 1]) of document_terms
+        std::vector<double> inverse_lengths;
+        std::vector<TermId> term_ids;   // global TermId by local TermId
+        std::vector<WordSetFingerprint> fingerprints;   // by position, unless the duplicate mode is ALLOW
+    };
+
+    void CheckNewDocumentIds(const std::vector<NewDocument>& documents) const;
+
+    // Throws in the REJECT mode if a document of the batch duplicates an indexed one or an earlier one of the batch.
+    // document_words are the distinct words of the documents in word order, by position in the batch
+    void CheckNewDocumentDuplicates(const std::vector<WordSetFingerprint>& fingerprints,
+                                    const std::vector<std::vector<std::string_view>>& document_words) const;
+
+    void CheckNewDocumentDuplicates(const std::vector<PartialIndex>& partial_indexes) const;
+
+    // Tokenizes and checks every document of the batch before indexing them one by one as AddDocument does
+    void AddDocumentsSequentially(const std::vector<NewDocument>& documents);
+
+    void BuildPartialIndex(const std::vector<NewDocument>& documents, DocumentOrdinal first_ordinal,
+                           PartialIndex& partial_index) const;
+
+    // Registers the documents of the batch once the terms of the partial indexes are added
+    void AddNewDocumentData(const std::vector<NewDocument>& documents, const std::vector<PartialIndex>& partial_indexes);
+
+    void CopyDocument(const SearchServer& source, DocumentOrdinal source_ordinal);
+
+    double ComputeWordInverseDocumentFreq(const std::string_view word, int word_document_count,
+                                          const CorpusStatistics* corpus_statistics) const {
+        if (corpus_statistics != nullptr) {
+            const auto it = corpus_statistics->document_freqs.find(word);
+            if (it != corpus_statistics->document_freqs.end() && it->second > 0) {
+                return log(corpus_statistics->document_count * 1.0 / it->second);
+            }
+        }
+        return log(GetDocumentCount() * 1.0 / word_document_count);
+    }
+
+    // Candidate filters: make_filter(range) returns is_allowed(ordinal) for the ordinals of the range,
+    // which is false for removed documents
+
+    // Set of ordinals of a range, words[i] holds the ordinals from first_ordinal + 64 * i.
+    // As a filter it allows the ordinals in the set
+    struct OrdinalBitmap {
+        const uint64_t* words = nullptr;
+        DocumentOrdinal first_ordinal = 0;   // multiple of 64
+        std::vector<uint64_t> owned_words;   // empty when words point to a bitmap of the index
+
+        bool Contains(DocumentOrdinal ordinal) const {
+            const DocumentOrdinal bit = ordinal - first_ordinal;
+            return (words[bit / 64] >> (bit % 64)) & 1;
+        }
+
+        bool operator()(DocumentOrdinal ordinal) const { return Contains(ordinal); }
+    };
+
+    // Documents passing a structured filter. A status only filter reads the status bitmap as is.
+    // Rating bounds are applied to the words of the range a word at a time over the rating column
+    OrdinalBitmap MakeBitmapFilter(const DocumentFilter& filter, OrdinalRange range) const;
+
+    // Documents of the range with any of the minus words
+    OrdinalBitmap MakeExclusionBitmap(const std::vector<const PostingList*>& minus_postings, OrdinalRange range) const;
+
+    // False when every document of the range is removed or excluded
+    bool HasCandidates(const OrdinalBitmap& excluded, OrdinalRange range) const;
+
+    auto MakeStructuredFilter(const DocumentFilter& filter) const {
+        return [this, &filter](OrdinalRange range) {
+            return MakeBitmapFilter(filter, range);
+        };
+    }
+
+    // Result cache key of a structured filter, the status goes to the key status. A filter by status alone
+    // shares the empty key of the status overloads; one without a status takes "filter:", which no predicate key may
+    static std::string GetFilterKey(const DocumentFilter& filter);
+
+    // The slow path: a predicate call for every candidate document
     template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const Query& query, DocumentPredicate document_predicate) const {
-        return FindAllDocuments(std::execution::seq, query, document_predicate);
+    auto MakePredicateFilter(DocumentPredicate& document_predicate) const {
+        return [this, &document_predicate]([[maybe_unused]] OrdinalRange range) {
+            return [this, &document_predicate](DocumentOrdinal ordinal) {
+                return !IsDeleted(ordinal)
+                       && document_predicate(ordinal_to_document_id_[ordinal], document_statuses_[ordinal], document_ratings_[ordinal]);
+            };
+        };
     }
 
-    template <typename ExecPolicy, typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(ExecPolicy&& policy, const Query& query, DocumentPredicate document_predicate) const {
-        const int BUCKET_COUNT = 8;
-        ConcurrentMap<int, double> document_to_relevance(BUCKET_COUNT);
+    // Scores every matching document allowed by the filter, keeping only the best ones in top_documents.
+    // corpus_statistics may be null to score with the statistics of this index
+    template <typename MakeFilter>
+    void FindAllDocuments(const Query& query, MakeFilter make_filter, TopDocuments& top_documents,
+                          const CorpusStatistics* corpus_statistics) const {
+        FindAllDocuments(std::execution::seq, query, make_filter, top_documents, corpus_statistics);
+    }
 
-        const auto plusWordsIDF = [this, &document_predicate, &document_to_relevance] (const std::string_view word) {
-            if (word_to_document_freqs_.count(word) == 0) {
+    template <typename ExecPolicy, typename MakeFilter>
+    void FindAllDocuments(ExecPolicy&& policy, const Query& query, MakeFilter make_filter, TopDocuments& top_documents,
+                          const CorpusStatistics* corpus_statistics) const {
+        if (top_documents.GetLimit() == 0) {
+            return;
+        }
+        std::vector<ScoredPostings> plus_postings;
+        plus_postings.reserve(query.plus_words.size());
+        for (const std::string_view word : query.plus_words) {
+            // Documents with a plus word that is also a minus word are excluded anyway
+            if (std::find(query.minus_words.begin(), query.minus_words.end(), word) != query.minus_words.end()) {
+                continue;
+            }
+            const TermId term_id = term_dictionary_.Find(word);
+            if (term_id == TermDictionary::INVALID_TERM_ID) {
+                continue;
+            }
+            const int word_document_count = GetTermDocumentCount(term_id);
+            if (word_document_count > 0) {
+                plus_postings.push_back({ &term_postings_[term_id],
+                                          ComputeWordInverseDocumentFreq(word, word_document_count, corpus_statistics) });
+            }
+        }
+        if (plus_postings.empty()) {
+            return;
+        }
+        std::vector<const PostingList*> minus_postings;
+        for (const std::string_view word : query.minus_words) {
+            const TermId term_id = term_dictionary_.Find(word);
+            if (term_id == TermDictionary::INVALID_TERM_ID) {
+                continue;
+            }
+            const int word_document_count = GetTermDocumentCount(term_id);
+            if (word_document_count == GetDocumentCount()) {
+                return;   // every document has the minus word
+            }
+            if (word_document_count > 0) {
+                minus_postings.push_back(&term_postings_[term_id]);
+            }
+        }
+
+        const auto ordinal_count = static_cast<DocumentOrdinal>(ordinal_to_document_id_.size());
+        if constexpr (std::is_same_v<std::decay_t<ExecPolicy>, std::execution::sequenced_policy>) {
+            const OrdinalRange range{ 0, ordinal_count };
+            auto is_allowed = make_filter(range);
+            FindDocumentsInRange(range, plus_postings, minus_postings, is_allowed, top_documents);
+        }
+        else {
+            // Every range is scored by one thread in its own accumulator, then the partial tops are merged
+            const auto ranges = SplitOrdinals(ordinal_count, MIN_SCORING_RANGE_SIZE);
+            std::vector<TopDocuments> range_top_documents(
+                    ranges.size(), TopDocuments(top_documents.GetLimit(), DocumentRelevanceGreater(), top_documents.GetAfter()));
+            ForEachIndex(policy, ranges.size(), [&](size_t i) {
+                auto is_allowed = make_filter(ranges[i]);
+                FindDocumentsInRange(ranges[i], plus_postings, minus_postings, is_allowed, range_top_documents[i]);
+            });
+            for (TopDocuments& range_top : range_top_documents) {
+                top_documents.Merge(std::move(range_top));
+            }
+        }
+    }
+
+    // Minus words are resolved into an exclusion bitmap of the range before scoring,
+    // so documents with them are rejected by the same check as filtered out ones
+    template <typename IsAllowed>
+    void FindDocumentsInRange(OrdinalRange range, const std::vector<ScoredPostings>& plus_postings,
+                              const std::vector<const PostingList*>& minus_postings,
+                              IsAllowed& is_allowed, TopDocuments& top_documents) const {
+        if (minus_postings.empty()) {
+            ScoreDocumentsInRange(range, plus_postings, is_allowed, top_documents);
+            return;
+        }
+        OrdinalBitmap excluded;
+        {
+            QUERY_METRICS_STAGE(GetRecordedQueryMetrics(), QueryStage::MINUS_FILTER);
+            excluded = MakeExclusionBitmap(minus_postings, range);
+            if (!HasCandidates(excluded, range)) {
                 return;
             }
-            const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-            for (const auto& [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-                const auto& document_data = documents_.at(document_id);
-                if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                    document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
+        }
+        auto is_candidate = [&excluded, &is_allowed](DocumentOrdinal ordinal) {
+            return !excluded.Contains(ordinal) && is_allowed(ordinal);
+        };
+        ScoreDocumentsInRange(range, plus_postings, is_candidate, top_documents);
+    }
+
+    template <typename IsAllowed>
+    void ScoreDocumentsInRange(OrdinalRange range, const std::vector<ScoredPostings>& plus_postings,
+                               IsAllowed& is_allowed, TopDocuments& top_documents) const {
+        if (scoring_mode_ == ScoringMode::MAX_SCORE) {
+            FindDocumentsInRangeMaxScore(range, plus_postings, is_allowed, top_documents);
+            return;
+        }
+        ScoreAccumulator& accumulator = ScoreAccumulator::ForCurrentThread();
+        accumulator.Reset(range.begin, range.end);
+        [[maybe_unused]] uint64_t postings_scanned = 0;
+        [[maybe_unused]] uint64_t documents_scored = 0;
+
+        PostingList::BlockBuffer buffer;
+        {
+            QUERY_METRICS_STAGE(GetRecordedQueryMetrics(), QueryStage::SCORE);
+            for (const auto& [postings, inverse_document_freq] : plus_postings) {
+                ForEachBlockInRange(*postings, range, buffer, inverse_document_lengths_.data(),
+                                    [&](const PostingList::Block& block, size_t begin, size_t end) {
+                    postings_scanned += end - begin;
+                    for (size_t i = begin; i < end; ++i) {
+                        const DocumentOrdinal ordinal = block.ordinals[i];
+                        if (!accumulator.IsTouched(ordinal)) {
+                            accumulator.Touch(ordinal, !is_allowed(ordinal));
+                        }
+                        accumulator.Add(ordinal, block.term_freqs[i] * inverse_document_freq);
+                    }
+                });
+            }
+        }
+
+        {
+            QUERY_METRICS_STAGE(GetRecordedQueryMetrics(), QueryStage::TOP_K);
+            accumulator.ForEachScored([&](DocumentOrdinal ordinal, double relevance) {
+                ++documents_scored;
+                if (top_documents.IsFull() && top_documents.GetWorst().relevance - relevance >= EPSILON) {
+                    return;   // can not get into the top, skip the rating lookup
                 }
+                const int document_id = ordinal_to_document_id_[ordinal];
+                top_documents.Push({ document_id, relevance, document_ratings_[ordinal] });
+            });
+        }
+        QUERY_METRICS_ADD(GetRecordedQueryMetrics(), QueryCounter::POSTINGS_SCANNED, postings_scanned);
+        QUERY_METRICS_ADD(GetRecordedQueryMetrics(), QueryCounter::DOCUMENTS_SCORED, documents_scored);
+    }
+
+    // Calls function(block, begin, end) for the postings [begin, end) of every block that fall into the range
+    template <typename Function>
+    static void ForEachBlockInRange(const PostingList& postings, OrdinalRange range, PostingList::BlockBuffer& buffer,
+                                    const double* inverse_lengths, Function function) {
+        const auto& blocks = postings.GetBlocks();
+        for (size_t i = postings.FindBlock(range.begin); i < blocks.size(); ++i) {
+            const PostingList::Block block = postings.GetBlock(i, &buffer, inverse_lengths);
+            const DocumentOrdinal* block_end = block.ordinals + block.size;
+            const DocumentOrdinal* begin = block.ordinals[0] < range.begin
+                                           ? std::lower_bound(block.ordinals, block_end, range.begin)
+                                           : block.ordinals;
+            const DocumentOrdinal* end = blocks[i].last_ordinal < range.end
+                                         ? block_end
+                                         : std::lower_bound(begin, block_end, range.end);
+            function(block, begin - block.ordinals, end - block.ordinals);
+            if (end != block_end) {
+                break;
             }
+        }
+    }
+
+    // MaxScore: terms are ordered by their largest possible contribution. The prefix of terms whose bounds
+    // sum below the current top threshold is non-essential: a document found only there can not get
+    // into the top, so candidates are taken from the essential terms only. Non-essential terms are
+    // probed for a candidate only while block bounds still allow it to get into the top
+    template <typename IsAllowed>
+    void FindDocumentsInRangeMaxScore(OrdinalRange range, const std::vector<ScoredPostings>& plus_postings,
+                                      IsAllowed& is_allowed, TopDocuments& top_documents) const {
+        // The top is offered every candidate during the walk: a sample of the offers is timed as the
+        // top stage and recorded once per range, the rest of the walk is the score stage
+        QUERY_METRICS_STOPWATCH(top_stopwatch);
+        QUERY_METRICS_STAGE_EXCLUDING(GetRecordedQueryMetrics(), QueryStage::SCORE, top_stopwatch);
+        [[maybe_unused]] uint64_t postings_scanned = 0;
+        [[maybe_unused]] uint64_t documents_scored = 0;
+        struct TermCursor {
+            PostingList::Cursor cursor;
+            double inverse_document_freq;
+            double max_score;
+            size_t query_index;
         };
 
-        ForEach(policy, query.plus_words, plusWordsIDF);
+        std::vector<TermCursor> terms;
+        terms.reserve(plus_postings.size());
+        for (size_t i = 0; i < plus_postings.size(); ++i) {
+            const auto& [postings, inverse_document_freq] = plus_postings[i];
+            terms.push_back({ PostingList::Cursor(*postings, inverse_document_lengths_.data()), inverse_document_freq,
+                              postings->GetMaxTermFreq() * inverse_document_freq, i });
+            terms.back().cursor.SkipTo(range.begin);
+        }
+        std::sort(terms.begin(), terms.end(), [](const TermCursor& lhs, const TermCursor& rhs) {
+            return lhs.max_score < rhs.max_score;
+        });
+        std::vector<double> max_score_prefix(terms.size());   // bound of a document matching terms[0..i] only
+        for (size_t i = 0; i < terms.size(); ++i) {
+            max_score_prefix[i] = terms[i].max_score + (i > 0 ? max_score_prefix[i - 1] : 0.0);
+        }
 
-        auto docToRel = document_to_relevance.BuildOrdinaryMap();
-        const auto eraseMinusWords = [&] (const std::string_view word) {
-            if (word_to_document_freqs_.count(word) == 0) {
-                return;
+        // Bounds are sums in another order than the exact score, the margin covers rounding
+        const auto is_hopeless = [&top_documents](double score_bound) {
+            return top_documents.IsFull() && score_bound < top_documents.GetWorst().relevance - 2 * EPSILON;
+        };
+
+        // Min-heap of (current ordinal, term) over the essential terms. Terms that turned non-essential
+        // are dropped lazily when they come to the top
+        std::vector<std::pair<DocumentOrdinal, size_t>> essential_heap;
+        essential_heap.reserve(terms.size());
+        for (size_t i = 0; i < terms.size(); ++i) {
+            if (terms[i].cursor.GetOrdinal() < range.end) {
+                essential_heap.emplace_back(terms[i].cursor.GetOrdinal(), i);
             }
-            for (const auto& [document_id, _] : word_to_document_freqs_.at(word)) {
-                docToRel.erase(document_id);
+        }
+        const auto heap_order = std::greater<std::pair<DocumentOrdinal, size_t>>();
+        std::make_heap(essential_heap.begin(), essential_heap.end(), heap_order);
+
+        std::vector<std::pair<size_t, double>> contributions;   // (query index, tf-idf) of the candidate
+        size_t first_essential = 0;
+        while (true) {
+            while (first_essential < terms.size() && is_hopeless(max_score_prefix[first_essential])) {
+                ++first_essential;
+            }
+            while (!essential_heap.empty() && essential_heap.front().second < first_essential) {
+                std::pop_heap(essential_heap.begin(), essential_heap.end(), heap_order);
+                essential_heap.pop_back();
+            }
+            if (essential_heap.empty()) {
+                break;
+            }
+            const DocumentOrdinal candidate = essential_heap.front().first;
+
+            postings_scanned += contributions.size();
+            contributions.clear();
+            double score_bound = 0.0;
+            while (!essential_heap.empty() && essential_heap.front().first == candidate) {
+                std::pop_heap(essential_heap.begin(), essential_heap.end(), heap_order);
+                const size_t i = essential_heap.back().second;
+                essential_heap.pop_back();
+                if (i < first_essential) {
+                    continue;
+                }
+                auto& term = terms[i];
+                const double score = term.cursor.GetTermFreq() * term.inverse_document_freq;
+                contributions.emplace_back(term.query_index, score);
+                score_bound += score;
+                term.cursor.Next();
+                if (term.cursor.GetOrdinal() < range.end) {
+                    essential_heap.emplace_back(term.cursor.GetOrdinal(), i);
+                    std::push_heap(essential_heap.begin(), essential_heap.end(), heap_order);
+                }
+            }
+
+            if (first_essential > 0) {
+                if (is_hopeless(score_bound + max_score_prefix[first_essential - 1])) {
+                    continue;
+                }
+                double block_bound = score_bound;
+                for (size_t i = 0; i < first_essential; ++i) {
+                    block_bound += terms[i].cursor.GetBlockMaxTermFreq(candidate) * terms[i].inverse_document_freq;
+                }
+                if (is_hopeless(block_bound)) {
+                    continue;
+                }
+            }
+
+            if (!is_allowed(candidate)) {
+                continue;
             }
-        };
 
-        ForEach(policy, query.minus_words, eraseMinusWords);
+            bool hopeless = false;
+            for (size_t i = first_essential; i-- > 0;) {
+                if (is_hopeless(score_bound + max_score_prefix[i])) {
+                    hopeless = true;
+                    break;
+                }
+                auto& term = terms[i];
+                term.cursor.SkipTo(candidate);
+                if (term.cursor.GetOrdinal() == candidate) {
+                    const double score = term.cursor.GetTermFreq() * term.inverse_document_freq;
+                    contributions.emplace_back(term.query_index, score);
+                    score_bound += score;
+                }
+            }
+            if (hopeless) {
+                continue;
+            }
 
-        std::vector<Document> matched_documents;
-        for (const auto& [document_id, relevance] : docToRel) {
-            matched_documents.push_back({ document_id, relevance, documents_.at(document_id).rating });
+            // Summed in query order, exactly as the exhaustive accumulator does
+            std::sort(contributions.begin(), contributions.end());
+            double relevance = 0.0;
+            for (const auto& [_, score] : contributions) {
+                relevance += score;
+            }
+            ++documents_scored;
+            QUERY_METRICS_SECTION(top_stopwatch);
+            top_documents.Push({ ordinal_to_document_id_[candidate], relevance, document_ratings_[candidate] });
         }
-        return matched_documents;
+        postings_scanned += contributions.size();
+        QUERY_METRICS_RECORD(GetRecordedQueryMetrics(), QueryStage::TOP_K, top_stopwatch);
+        QUERY_METRICS_ADD(GetRecordedQueryMetrics(), QueryCounter::POSTINGS_SCANNED, postings_scanned);
+        QUERY_METRICS_ADD(GetRecordedQueryMetrics(), QueryCounter::DOCUMENTS_SCORED, documents_scored);
     }
 };
 
-void RemoveDuplicates(SearchServer& search_server);
+// Removes every document whose set of words equals the one of a document with a smaller id.
+// Fingerprints computed in parallel select the candidates, whose words are then compared.
+// Returns the removed ids in ascending order
+std::vector<int> RemoveDuplicates(SearchServer& search_server);
 
 void AddDocument(SearchServer& search_server, int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
 
+// The parallel version splits the range into parts run on the default thread pool
 template <typename ExecutionPolicy, typename ForwardRange, typename Function>
 void ForEach(const ExecutionPolicy& policy, ForwardRange& range, Function function) {
     using namespace std;
-    if constexpr (
-            is_same_v<ExecutionPolicy, execution::sequenced_policy>
-                                       || is_same_v<typename iterator_traits<typename ForwardRange::iterator>::iterator_category,
-                    random_access_iterator_tag>
-            ) {
+    if constexpr (is_same_v<ExecutionPolicy, execution::sequenced_policy>) {
         for_each(policy, range.begin(), range.end(), function);
-
     } else {
-        static constexpr int PART_COUNT = 4;
-        const auto part_length = size(range) / PART_COUNT;
+        ThreadPool& thread_pool = ThreadPool::GetDefault();
+        const size_t range_size = size(range);
+        const size_t part_count = min(range_size, thread_pool.GetWorkerCount() * 4);
+        // Part boundaries are found in one pass, so forward ranges split as well as random access ones
+        vector<typename ForwardRange::iterator> part_begins;
+        part_begins.reserve(part_count + 1);
         auto part_begin = range.begin();
-        auto part_end = next(part_begin, part_length);
-
-        vector<future<void>> futures;
-        for (int i = 0;
-             i < PART_COUNT;
-             ++i, part_begin = part_end, part_end = (i == PART_COUNT - 1
-                                 ? range.end()
-                                 : next(part_begin, part_length))
-             ) {
-            futures.push_back(async([function, part_begin, part_end] {
-                for_each(part_begin, part_end, function);
-            }));
+        for (size_t i = 0; i < part_count; ++i) {
+            part_begins.push_back(part_begin);
+            part_begin = next(part_begin, range_size / part_count + (i < range_size % part_count ? 1 : 0));
         }
+        part_begins.push_back(range.end());
+        thread_pool.ParallelFor(part_count, [&](size_t i) {
+            for_each(part_begins[i], part_begins[i + 1], function);
+        });
     }
 }
 
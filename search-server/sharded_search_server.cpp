@@ -0,0 +1,78 @@
+#include "sharded_search_server.h"
+
+void ShardedSearchServer::SetThreadPool(std::shared_ptr<ThreadPool> thread_pool) {
+    thread_pool_ = std::move(thread_pool);
+    for (SearchServer& shard : shards_) {
+        shard.SetThreadPool(thread_pool_);
+    }
+}
+
+std::vector<Document> ShardedSearchServer::FindTopDocuments(const std::string_view raw_query, const DocumentFilter& filter,
+                                                            size_t max_result_count) const {
+    const CorpusStatistics corpus_statistics = CollectStatistics(raw_query);
+    std::vector<std::vector<Document>> shard_documents(shards_.size());
+    GetThreadPool().ParallelFor(shards_.size(), [&](size_t i) {
+        shard_documents[i] = shards_[i].FindTopDocuments(std::execution::seq, raw_query, filter, max_result_count, corpus_statistics);
+    });
+    return MergeShardDocuments(shard_documents, max_result_count);
+}
+
+void ShardedSearchServer::RemoveDocuments(const std::vector<int>& document_ids) {
+    std::vector<std::vector<int>> shard_document_ids(shards_.size());
+    for (const int document_id : document_ids) {
+        shard_document_ids[GetShardIndex(document_id)].push_back(document_id);
+    }
+    GetThreadPool().ParallelFor(shards_.size(), [&](size_t i) {
+        for (const int document_id : shard_document_ids[i]) {
+            shards_[i].RemoveDocument(document_id);
+        }
+    });
+}
+
+int ShardedSearchServer::GetDocumentCount() const {
+    int document_count = 0;
+    for (const SearchServer& shard : shards_) {
+        document_count += shard.GetDocumentCount();
+    }
+    return document_count;
+}
+
+CorpusStatistics ShardedSearchServer::CollectStatistics(const std::string_view raw_query) const {
+    CorpusStatistics corpus_statistics;
+    corpus_statistics.document_count = GetDocumentCount();
+    const auto add_word = [&](std::string_view word) {
+        const auto [it, inserted] = corpus_statistics.document_freqs.emplace(word, 0);
+        if (!inserted) {
+            return;
+        }
+        for (const SearchServer& shard : shards_) {
+            it->second += shard.GetWordDocumentCount(word);
+        }
+    };
+    for (std::string_view word : SplitIntoWordsView(raw_query)) {
+        if (!word.empty() && word[0] == '-') {
+            word.remove_prefix(1);
+        }
+        if (!IsWildcardPattern(word)) {
+            add_word(word);
+            continue;
+        }
+        for (const SearchServer& shard : shards_) {
+            for (const std::string_view matching_word : shard.FindMatchingWords(word)) {
+                add_word(matching_word);
+            }
+        }
+    }
+    return corpus_statistics;
+}
+
+std::vector<Document> ShardedSearchServer::MergeShardDocuments(std::vector<std::vector<Document>>& shard_documents,
+                                                               size_t max_result_count) {
+    TopDocuments top_documents(max_result_count);
+    for (std::vector<Document>& documents : shard_documents) {
+        for (Document& document : documents) {
+            top_documents.Push(std::move(document));
+        }
+    }
+    return std::move(top_documents).Extract();
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include "search_server.h"
+
+// Index partitioned by document id into SearchServer shards, so one query is scored by all cores.
+// A query is scattered to every shard at once on the thread pool: each shard selects its own top
+// with the document count and word document frequencies of all shards, and the shard tops are merged
+// in the result order of SearchServer. Results are the same as with one SearchServer holding
+// every document. A document lives in exactly one shard, which alone adds, matches and removes it
+class ShardedSearchServer {
+public:
+    template <typename StringContainer>
+    ShardedSearchServer(const StringContainer& stop_words, size_t shard_count) {
+        using namespace std::literals;
+        if (shard_count == 0) {
+            throw std::invalid_argument("Shard count must be positive"s);
+        }
+        shards_.reserve(shard_count);
+        for (size_t i = 0; i < shard_count; ++i) {
+            shards_.emplace_back(stop_words).SetQueryMetrics(query_metrics_);
+        }
+    }
+
+    ShardedSearchServer(const std::string_view stop_words_text, size_t shard_count)
+        : ShardedSearchServer(SplitIntoWordsView(stop_words_text), shard_count)
+    {
+    }
+
+    ShardedSearchServer(const std::string& stop_words_text, size_t shard_count)
+        : ShardedSearchServer(std::string_view(stop_words_text), shard_count)
+    {
+    }
+
+    size_t GetShardCount() const { return shards_.size(); }
+
+    const SearchServer& GetShard(size_t shard_index) const { return shards_[shard_index]; }
+
+    // Ids are hashed, so documents with ids in a stride still spread over all shards
+    size_t GetShardIndex(int document_id) const {
+        const uint64_t hash = static_cast<uint32_t>(document_id) * uint64_t{ 0x9E37'79B9'7F4A'7C15 };
+        return static_cast<size_t>((hash >> 32) % shards_.size());
+    }
+
+    // Queries scatter over this pool instead of the default one. Shards score on the pool too
+    void SetThreadPool(std::shared_ptr<ThreadPool> thread_pool);
+
+    ThreadPool& GetThreadPool() const { return thread_pool_ ? *thread_pool_ : ThreadPool::GetDefault(); }
+
+    // Queries of all shards are recorded together
+    const QueryMetrics& GetQueryMetrics() const {
+        return query_metrics_ ? *query_metrics_ : QueryMetrics::GetDefault();
+    }
+
+    void AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings) {
+        shards_[GetShardIndex(document_id)].AddDocument(document_id, document, status, ratings);
+    }
+
+    // Every shard scores its documents sequentially, the shards run in parallel
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate,
+                                           size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const {
+        const CorpusStatistics corpus_statistics = CollectStatistics(raw_query);
+        std::vector<std::vector<Document>> shard_documents(shards_.size());
+        GetThreadPool().ParallelFor(shards_.size(), [&](size_t i) {
+            shard_documents[i] = shards_[i].FindTopDocuments(std::execution::seq, raw_query, document_predicate,
+                                                             max_result_count, corpus_statistics);
+        });
+        return MergeShardDocuments(shard_documents, max_result_count);
+    }
+
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, const DocumentFilter& filter,
+                                           size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL,
+                                           size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const {
+        return FindTopDocuments(raw_query, DocumentFilter{ status }, max_result_count);
+    }
+
+    // The matched words point into the shard of the document
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::string_view raw_query, int document_id) const {
+        return shards_[GetShardIndex(document_id)].MatchDocument(raw_query, document_id);
+    }
+
+    template <typename ExecPolicy>
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(
+            ExecPolicy&& policy, const std::string_view raw_query, int document_id) const {
+        return shards_[GetShardIndex(document_id)].MatchDocument(policy, raw_query, document_id);
+    }
+
+    void RemoveDocument(int document_id) {
+        shards_[GetShardIndex(document_id)].RemoveDocument(document_id);
+    }
+
+    template <typename ExecPolicy>
+    void RemoveDocument(ExecPolicy&& policy, int document_id) {
+        shards_[GetShardIndex(document_id)].RemoveDocument(policy, document_id);
+    }
+
+    // Every shard removes its part of the documents in parallel, including the compactions
+    // the removals trigger. Unknown ids are ignored
+    void RemoveDocuments(const std::vector<int>& document_ids);
+
+    int GetDocumentCount() const;
+
+    bool HasDocument(int document_id) const { return shards_[GetShardIndex(document_id)].HasDocument(document_id); }
+
+private:
+    std::vector<SearchServer> shards_;
+    std::shared_ptr<ThreadPool> thread_pool_;
+    // Shared by the shards, null when metrics are compiled out
+    std::shared_ptr<QueryMetrics> query_metrics_ = QueryMetrics::IS_ENABLED ? std::make_shared<QueryMetrics>() : nullptr;
+
+    // Statistics of all shards for the query words, wildcard words are expanded in every shard
+    CorpusStatistics CollectStatistics(const std::string_view raw_query) const;
+
+    static std::vector<Document> MergeShardDocuments(std::vector<std::vector<Document>>& shard_documents,
+                                                     size_t max_result_count);
+};
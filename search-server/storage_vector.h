@@ -0,0 +1,148 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+// Array of trivially copyable values that either owns its elements or views read-only memory
+// owned by someone else, e.g. a mapped index file. A view is copied into owned memory
+// on the first modification, so reading never allocates and writing works the same in both cases.
+template <typename T>
+class StorageVector {
+    static_assert(std::is_trivially_copyable_v<T>);
+
+public:
+    StorageVector() = default;
+
+    // The memory must outlive the vector and every copy of it
+    static StorageVector View(const T* data, size_t size) {
+        StorageVector result;
+        result.view_ = true;
+        result.data_ = data;
+        result.size_ = size;
+        return result;
+    }
+
+    StorageVector(const StorageVector& other)
+        : owned_(other.owned_), view_(other.view_), data_(other.data_), size_(other.size_)
+    {
+        Sync();
+    }
+
+    StorageVector(StorageVector&& other) noexcept
+        : owned_(std::move(other.owned_)), view_(other.view_), data_(other.data_), size_(other.size_)
+    {
+        Sync();
+        other.Sync();
+    }
+
+    StorageVector& operator=(const StorageVector& other) {
+        if (this != &other) {
+            owned_ = other.owned_;
+            view_ = other.view_;
+            data_ = other.data_;
+            size_ = other.size_;
+            Sync();
+        }
+        return *this;
+    }
+
+    StorageVector& operator=(StorageVector&& other) noexcept {
+        if (this != &other) {
+            owned_ = std::move(other.owned_);
+            view_ = other.view_;
+            data_ = other.data_;
+            size_ = other.size_;
+            Sync();
+            other.Sync();
+        }
+        return *this;
+    }
+
+    bool IsView() const { return view_; }
+
+    size_t size() const { return size_; }
+
+    bool empty() const { return size_ == 0; }
+
+    const T* data() const { return data_; }
+
+    const T* begin() const { return data_; }
+
+    const T* end() const { return data_ + size_; }
+
+    const T& operator[](size_t index) const { return data_[index]; }
+
+    T& operator[](size_t index) {
+        Own();
+        return owned_[index];
+    }
+
+    const T& back() const { return data_[size_ - 1]; }
+
+    T& back() {
+        Own();
+        return owned_.back();
+    }
+
+    // Heap bytes owned by the vector, a view owns none
+    size_t capacity() const { return owned_.capacity(); }
+
+    void push_back(const T& value) {
+        Own();
+        owned_.push_back(value);
+        Sync();
+    }
+
+    void append(const T* data, size_t size) {
+        Own();
+        owned_.insert(owned_.end(), data, data + size);
+        Sync();
+    }
+
+    void resize(size_t size, const T& value = T()) {
+        Own();
+        owned_.resize(size, value);
+        Sync();
+    }
+
+    void reserve(size_t capacity) {
+        Own();
+        owned_.reserve(capacity);
+        Sync();
+    }
+
+    void clear() {
+        view_ = false;
+        owned_.clear();
+        Sync();
+    }
+
+    void shrink_to_fit() {
+        if (!view_) {
+            owned_.shrink_to_fit();
+            Sync();
+        }
+    }
+
+private:
+    std::vector<T> owned_;
+    bool view_ = false;
+    const T* data_ = nullptr;
+    size_t size_ = 0;
+
+    void Own() {
+        if (view_) {
+            owned_.assign(data_, data_ + size_);
+            view_ = false;
+            Sync();
+        }
+    }
+
+    void Sync() {
+        if (!view_) {
+            data_ = owned_.data();
+            size_ = owned_.size();
+        }
+    }
+};
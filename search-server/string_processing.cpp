@@ -1,5 +1,81 @@
 #include "string_processing.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace {
+
+constexpr size_t SCAN_BLOCK_SIZE = 64;
+
+// Bit i of a mask describes character i of a block
+struct BlockMasks {
+    uint64_t spaces;
+    uint64_t controls;
+};
+
+BlockMasks ScanBlock(const char* block) {
+    BlockMasks masks{ 0, 0 };
+#if defined(__AVX2__)
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i max_control = _mm256_set1_epi8(' ' - 1);
+    for (size_t i = 0; i < SCAN_BLOCK_SIZE; i += 32) {
+        const __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + i));
+        // A character is a control one if the unsigned minimum with 31 leaves it unchanged
+        const __m256i controls = _mm256_cmpeq_epi8(_mm256_min_epu8(chars, max_control), chars);
+        masks.spaces |= uint64_t{ static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chars, space))) } << i;
+        masks.controls |= uint64_t{ static_cast<uint32_t>(_mm256_movemask_epi8(controls)) } << i;
+    }
+#elif defined(__SSE2__)
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i max_control = _mm_set1_epi8(' ' - 1);
+    for (size_t i = 0; i < SCAN_BLOCK_SIZE; i += 16) {
+        const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i));
+        // A character is a control one if the unsigned minimum with 31 leaves it unchanged
+        const __m128i controls = _mm_cmpeq_epi8(_mm_min_epu8(chars, max_control), chars);
+        masks.spaces |= uint64_t{ static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chars, space))) } << i;
+        masks.controls |= uint64_t{ static_cast<uint16_t>(_mm_movemask_epi8(controls)) } << i;
+    }
+#else
+    for (size_t i = 0; i < SCAN_BLOCK_SIZE; ++i) {
+        const auto symbol = static_cast<unsigned char>(block[i]);
+        masks.spaces |= uint64_t{ symbol == ' ' } << i;
+        masks.controls |= uint64_t{ symbol < ' ' } << i;
+    }
+#endif
+    return masks;
+}
+
+int LowestBit(uint64_t mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(mask);
+#endif
+}
+
+int PopCount(uint64_t mask) {
+#if defined(_MSC_VER)
+    return static_cast<int>(__popcnt64(mask));
+#else
+    return __builtin_popcountll(mask);
+#endif
+}
+
+} // namespace
+
 std::vector<std::string> SplitIntoWords(const std::string_view text) {
     std::vector<std::string> words;
     std::string word;
@@ -31,4 +107,82 @@ std::vector<std::string_view> SplitIntoWordsView(std::string_view str) {
         pos = str.find_first_not_of(" ", space);
     }
     return result;
-}
\ No newline at end of file
+}
+
+size_t SplitIntoWordsValidated(std::string_view text, std::vector<std::string_view>& words) {
+    words.clear();
+    size_t invalid_word = SIZE_MAX;
+    bool in_word = false;   // the character before the block belongs to a word
+    size_t word_begin = 0;
+    char tail[SCAN_BLOCK_SIZE];
+    for (size_t block_begin = 0; block_begin < text.size(); block_begin += SCAN_BLOCK_SIZE) {
+        const char* block = text.data() + block_begin;
+        const size_t block_size = std::min(SCAN_BLOCK_SIZE, text.size() - block_begin);
+        if (block_size < SCAN_BLOCK_SIZE) {
+            // The tail is padded with spaces, so a word at the end of the text ends inside the block
+            std::memset(tail, ' ', SCAN_BLOCK_SIZE);
+            std::memcpy(tail, block, block_size);
+            block = tail;
+        }
+        const BlockMasks masks = ScanBlock(block);
+        const uint64_t word_chars = ~masks.spaces;
+        const uint64_t previous_word_chars = (word_chars << 1) | uint64_t{ in_word };
+
+        if (masks.controls != 0 && invalid_word == SIZE_MAX) {
+            // The invalid word is the last one started at or before the first control character
+            const int position = LowestBit(masks.controls);
+            const uint64_t word_starts = word_chars & ~previous_word_chars;
+            const uint64_t up_to_position = (uint64_t{ 2 } << position) - 1;
+            invalid_word = words.size() + (in_word ? 1 : 0) + PopCount(word_starts & up_to_position) - 1;
+        }
+
+        // Every bit where a character differs from the previous one starts or ends a word
+        for (uint64_t transitions = word_chars ^ previous_word_chars; transitions != 0; transitions &= transitions - 1) {
+            const size_t position = block_begin + LowestBit(transitions);
+            if (in_word) {
+                words.emplace_back(text.data() + word_begin, position - word_begin);
+            }
+            else {
+                word_begin = position;
+            }
+            in_word = !in_word;
+        }
+    }
+    if (in_word) {   // the text ends with a full block
+        words.emplace_back(text.data() + word_begin, text.size() - word_begin);
+    }
+    return invalid_word == SIZE_MAX ? words.size() : invalid_word;
+}
+
+bool IsWildcardPattern(std::string_view word) {
+    return word.find_first_of("*?") != std::string_view::npos;
+}
+
+bool MatchesWildcard(std::string_view text, std::string_view pattern) {
+    // On a mismatch the last '*' takes one more character, earlier ones never need to take more
+    size_t text_pos = 0;
+    size_t pattern_pos = 0;
+    size_t star_pos = std::string_view::npos;
+    size_t star_text_pos = 0;
+    while (text_pos < text.size()) {
+        if (pattern_pos < pattern.size() && pattern[pattern_pos] == '*') {
+            star_pos = pattern_pos++;
+            star_text_pos = text_pos;
+        }
+        else if (pattern_pos < pattern.size() && (pattern[pattern_pos] == '?' || pattern[pattern_pos] == text[text_pos])) {
+            ++text_pos;
+            ++pattern_pos;
+        }
+        else if (star_pos != std::string_view::npos) {
+            pattern_pos = star_pos + 1;
+            text_pos = ++star_text_pos;
+        }
+        else {
+            return false;
+        }
+    }
+    while (pattern_pos < pattern.size() && pattern[pattern_pos] == '*') {
+        ++pattern_pos;
+    }
+    return pattern_pos == pattern.size();
+}
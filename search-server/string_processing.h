@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <string>
 #include <set>
 #include <string_view>
@@ -9,10 +10,21 @@ std::vector<std::string> SplitIntoWords(std::string_view text);
 
 std::vector<std::string_view> SplitIntoWordsView(std::string_view str);
 
+// Splits the text by spaces like SplitIntoWordsView into words, in the same pass looking for
+// control characters (codes 0-31) that make a word invalid. The text is scanned 64 characters
+// at a time with AVX2 or SSE2 when available.
+// Returns the index of the first invalid word, words.size() if every word is valid
+size_t SplitIntoWordsValidated(std::string_view text, std::vector<std::string_view>& words);
+
+// True for a query word with the wildcards '*' (any sequence of characters) or '?' (any one character)
+bool IsWildcardPattern(std::string_view word);
+
+bool MatchesWildcard(std::string_view text, std::string_view pattern);
+
 template <typename StringContainer>
 std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
     std::set<std::string, std::less<>> non_empty_strings;
-    for (const auto str : strings) {
+    for (const auto& str : strings) {
         if (!str.empty()) {
             non_empty_strings.insert(std::string(str));
         }
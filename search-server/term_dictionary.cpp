@@ -0,0 +1,267 @@
+#include "term_dictionary.h"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <string>
+#include "index_file.h"
+#include "string_processing.h"
+
+namespace {
+
+void WriteVarint(std::vector<char>& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+uint32_t ReadVarint(const char*& in) {
+    uint32_t value = 0;
+    for (int shift = 0;; shift += 7) {
+        const auto byte = static_cast<uint8_t>(*in++);
+        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if (byte < 0x80) {
+            return value;
+        }
+    }
+}
+
+bool StartsWith(std::string_view text, std::string_view prefix) {
+    return text.substr(0, prefix.size()) == prefix;
+}
+
+} // namespace
+
+size_t TermDictionary::GetMemoryUsage() const {
+    // A hash node holds the value, the cached hash and the link to the next node
+    const size_t node_size = sizeof(std::pair<const std::string_view, TermId>) + 2 * sizeof(void*);
+    return term_to_id_.bucket_count() * sizeof(void*) + term_to_id_.size() * node_size
+           + id_to_term_.capacity() * sizeof(std::string_view)
+           + term_chars_.capacity() + term_offsets_.capacity() * sizeof(uint64_t)
+           + sorted_term_ids_.capacity() * sizeof(TermId)
+           + term_blocks_.capacity() + block_offsets_.capacity() * sizeof(uint32_t)
+           + sorted_tail_.capacity() * sizeof(TermId) + tail_run_ends_.capacity() * sizeof(size_t);
+}
+
+std::vector<TermId> TermDictionary::FindMatching(std::string_view pattern) const {
+    const size_t wildcard = pattern.find_first_of("*?");
+    const std::string_view prefix = pattern.substr(0, wildcard);
+    std::vector<TermId> term_ids;
+    const auto add_if_matches = [&](TermId term_id, std::string_view term) {
+        if (wildcard == std::string_view::npos ? term.size() == prefix.size()
+                                               : MatchesWildcard(term.substr(prefix.size()), pattern.substr(prefix.size()))) {
+            term_ids.push_back(term_id);
+        }
+    };
+    const auto by_term = [this](TermId term_id, std::string_view value) {
+        return GetTerm(term_id) < value;
+    };
+
+    if (IsMapped()) {
+        for (auto it = std::lower_bound(sorted_term_ids_.begin(), sorted_term_ids_.end(), prefix, by_term);
+             it != sorted_term_ids_.end() && StartsWith(GetTerm(*it), prefix); ++it) {
+            add_if_matches(*it, GetTerm(*it));
+        }
+        return term_ids;
+    }
+    ForEachBlockedTermWithPrefix(prefix, add_if_matches);
+    size_t run_begin = 0;
+    for (const size_t run_end : tail_run_ends_) {
+        const auto end = sorted_tail_.begin() + run_end;
+        for (auto it = std::lower_bound(sorted_tail_.begin() + run_begin, end, prefix, by_term);
+             it != end && StartsWith(id_to_term_[*it], prefix); ++it) {
+            add_if_matches(*it, id_to_term_[*it]);
+        }
+        run_begin = run_end;
+    }
+    return term_ids;
+}
+
+void TermDictionary::Save(IndexFileWriter& writer) const {
+    const size_t term_count = GetTermCount();
+    std::vector<char> term_chars;
+    std::vector<uint64_t> term_offsets;
+    term_offsets.reserve(term_count + 1);
+    for (TermId term_id = 0; term_id < term_count; ++term_id) {
+        term_offsets.push_back(term_chars.size());
+        const std::string_view term = GetTerm(term_id);
+        term_chars.insert(term_chars.end(), term.begin(), term.end());
+    }
+    term_offsets.push_back(term_chars.size());
+
+    std::vector<TermId> sorted_term_ids(term_count);
+    std::iota(sorted_term_ids.begin(), sorted_term_ids.end(), 0);
+    std::sort(sorted_term_ids.begin(), sorted_term_ids.end(), [this](TermId lhs, TermId rhs) {
+        return GetTerm(lhs) < GetTerm(rhs);
+    });
+
+    writer.WriteArray(term_chars);
+    writer.WriteArray(term_offsets);
+    writer.WriteArray(sorted_term_ids);
+}
+
+TermDictionary TermDictionary::Load(IndexFileReader& reader) {
+    TermDictionary dictionary;
+    dictionary.term_chars_ = reader.ReadArray<char>();
+    dictionary.term_offsets_ = reader.ReadArray<uint64_t>();
+    dictionary.sorted_term_ids_ = reader.ReadArray<TermId>();
+
+    const auto& offsets = dictionary.term_offsets_;
+    const bool offsets_valid = offsets.size() == dictionary.sorted_term_ids_.size() + 1
+                               && std::is_sorted(offsets.begin(), offsets.end())
+                               && offsets.back() == dictionary.term_chars_.size();
+    const bool ids_valid = std::all_of(dictionary.sorted_term_ids_.begin(), dictionary.sorted_term_ids_.end(),
+                                       [&](TermId term_id) { return term_id < dictionary.sorted_term_ids_.size(); });
+    if (!offsets_valid || !ids_valid) {
+        throw std::runtime_error("Index file is corrupted");
+    }
+    if (dictionary.sorted_term_ids_.empty()) {
+        dictionary.term_offsets_.clear();   // nothing to serve from the file
+    }
+    return dictionary;
+}
+
+TermId TermDictionary::FindMapped(std::string_view term) const {
+    const auto it = std::lower_bound(sorted_term_ids_.begin(), sorted_term_ids_.end(), term,
+                                     [this](TermId term_id, std::string_view value) {
+        return GetTerm(term_id) < value;
+    });
+    return it != sorted_term_ids_.end() && GetTerm(*it) == term ? *it : INVALID_TERM_ID;
+}
+
+void TermDictionary::AddToSortedTail(TermId term_id) {
+    sorted_tail_.push_back(term_id);
+    tail_run_ends_.push_back(sorted_tail_.size());
+    while (tail_run_ends_.size() > 1) {
+        const size_t run_count = tail_run_ends_.size();
+        const size_t last_run_begin = tail_run_ends_[run_count - 2];
+        const size_t previous_run_begin = run_count > 2 ? tail_run_ends_[run_count - 3] : 0;
+        if (sorted_tail_.size() - last_run_begin < last_run_begin - previous_run_begin) {
+            break;
+        }
+        MergeLastTailRuns();
+    }
+    // Merging into the blocks takes time proportional to all the terms. Runs keep the tail cheap to grow,
+    // so it may reach a quarter of the blocked terms and a term is encoded about five times in all
+    if (sorted_tail_.size() <= std::max(MIN_TAIL_SIZE, blocked_term_count_ / 4)) {
+        return;
+    }
+    while (tail_run_ends_.size() > 1) {
+        MergeLastTailRuns();
+    }
+    const auto by_term = [this](TermId lhs, TermId rhs) {
+        return id_to_term_[lhs] < id_to_term_[rhs];
+    };
+    std::vector<TermId> sorted_term_ids;
+    sorted_term_ids.reserve(blocked_term_count_ + sorted_tail_.size());
+    ForEachBlockedTermWithPrefix({}, [&sorted_term_ids](TermId blocked_term_id, std::string_view) {
+        sorted_term_ids.push_back(blocked_term_id);
+    });
+    const auto middle = static_cast<std::ptrdiff_t>(sorted_term_ids.size());
+    sorted_term_ids.insert(sorted_term_ids.end(), sorted_tail_.begin(), sorted_tail_.end());
+    std::inplace_merge(sorted_term_ids.begin(), sorted_term_ids.begin() + middle, sorted_term_ids.end(), by_term);
+    BuildBlocks(sorted_term_ids);
+    sorted_tail_.clear();
+    tail_run_ends_.clear();
+}
+
+void TermDictionary::MergeLastTailRuns() {
+    const size_t run_count = tail_run_ends_.size();
+    const size_t previous_run_begin = run_count > 2 ? tail_run_ends_[run_count - 3] : 0;
+    std::inplace_merge(sorted_tail_.begin() + previous_run_begin, sorted_tail_.begin() + tail_run_ends_[run_count - 2],
+                       sorted_tail_.end(), [this](TermId lhs, TermId rhs) {
+        return id_to_term_[lhs] < id_to_term_[rhs];
+    });
+    tail_run_ends_.pop_back();
+    tail_run_ends_.back() = sorted_tail_.size();
+}
+
+template <typename Function>
+void TermDictionary::ForEachBlockedTermWithPrefix(std::string_view prefix, Function function) const {
+    if (block_offsets_.empty()) {
+        return;
+    }
+    const auto get_first_term = [this](size_t block) {
+        const char* in = term_blocks_.data() + block_offsets_[block];
+        ReadVarint(in);   // nothing shared
+        const uint32_t length = ReadVarint(in);
+        return std::string_view(in, length);
+    };
+    // The terms with the prefix start in the last block whose first term is below the prefix
+    size_t first_block = 0;
+    size_t last_block = block_offsets_.size();
+    while (first_block < last_block) {
+        const size_t middle = (first_block + last_block) / 2;
+        if (get_first_term(middle) < prefix) {
+            first_block = middle + 1;
+        }
+        else {
+            last_block = middle;
+        }
+    }
+    const char* in = term_blocks_.data() + block_offsets_[first_block > 0 ? first_block - 1 : 0];
+    const char* const end = term_blocks_.data() + term_blocks_.size();
+    std::string term;
+    while (in != end) {
+        const uint32_t shared = ReadVarint(in);
+        const uint32_t length = ReadVarint(in);
+        term.resize(shared);
+        term.append(in, length);
+        in += length;
+        TermId term_id;
+        std::memcpy(&term_id, in, sizeof(term_id));
+        in += sizeof(term_id);
+        if (StartsWith(term, prefix)) {
+            function(term_id, std::string_view(term));
+        }
+        else if (term > prefix) {
+            break;
+        }
+    }
+}
+
+void TermDictionary::BuildBlocks(const std::vector<TermId>& sorted_term_ids) {
+    term_blocks_.clear();
+    block_offsets_.clear();
+    std::string_view previous;
+    for (size_t i = 0; i < sorted_term_ids.size(); ++i) {
+        const std::string_view term = GetTerm(sorted_term_ids[i]);
+        size_t shared = 0;
+        if (i % BLOCK_SIZE == 0) {
+            block_offsets_.push_back(static_cast<uint32_t>(term_blocks_.size()));
+        }
+        else {
+            const size_t max_shared = std::min(previous.size(), term.size());
+            while (shared < max_shared && previous[shared] == term[shared]) {
+                ++shared;
+            }
+        }
+        WriteVarint(term_blocks_, static_cast<uint32_t>(shared));
+        WriteVarint(term_blocks_, static_cast<uint32_t>(term.size() - shared));
+        term_blocks_.insert(term_blocks_.end(), term.begin() + shared, term.end());
+        const char* term_id_bytes = reinterpret_cast<const char*>(&sorted_term_ids[i]);
+        term_blocks_.insert(term_blocks_.end(), term_id_bytes, term_id_bytes + sizeof(TermId));
+        previous = term;
+    }
+    blocked_term_count_ = sorted_term_ids.size();
+}
+
+void TermDictionary::Detach() {
+    const size_t term_count = GetTermCount();
+    std::vector<std::string_view> id_to_term;
+    id_to_term.reserve(term_count);
+    for (TermId term_id = 0; term_id < term_count; ++term_id) {
+        id_to_term.push_back(GetTerm(term_id));
+    }
+    term_to_id_.reserve(term_count);
+    for (TermId term_id = 0; term_id < term_count; ++term_id) {
+        term_to_id_.emplace(id_to_term[term_id], term_id);
+    }
+    id_to_term_ = std::move(id_to_term);
+    BuildBlocks(std::vector<TermId>(sorted_term_ids_.begin(), sorted_term_ids_.end()));
+    term_chars_.clear();
+    term_offsets_.clear();
+    sorted_term_ids_.clear();
+}
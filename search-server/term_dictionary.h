@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "storage_vector.h"
+
+class IndexFileWriter;
+class IndexFileReader;
+
+using TermId = uint32_t;
+
+// Maps index terms to dense ids, so postings can live in a plain vector indexed by term.
+// The dictionary keeps views only: term storage must outlive it.
+//
+// Terms are also kept in term order for wildcard lookups, front coded: the order is cut into blocks
+// of BLOCK_SIZE terms, and every term of a block after the first one stores only the suffix that
+// differs from the previous term. A block is a few dozen contiguous bytes, so the terms with a prefix
+// are found by a binary search over the first terms of the blocks and a sequential decode.
+// New terms go to a small tail, which is merged into the blocks once it grows. The tail is kept
+// as runs sorted by term whose sizes at least halve towards its end: a new term is a run of its
+// own, and runs are merged while the last is not the smaller, so a term is moved about log N times.
+//
+// A dictionary loaded from an index file is served from the mapped file: the terms lie there
+// by id in one character array and lookups binary search the ids sorted by term.
+// The hash map and the blocks are built only when a term is added.
+class TermDictionary {
+public:
+    inline static constexpr TermId INVALID_TERM_ID = std::numeric_limits<TermId>::max();
+
+    // Returns the id of the term, assigning the next free one for a new term
+    TermId Intern(std::string_view term) {
+        if (IsMapped()) {
+            Detach();
+        }
+        const auto [it, inserted] = term_to_id_.emplace(term, static_cast<TermId>(id_to_term_.size()));
+        if (inserted) {
+            id_to_term_.push_back(term);
+            AddToSortedTail(it->second);
+        }
+        return it->second;
+    }
+
+    TermId Find(std::string_view term) const {
+        if (IsMapped()) {
+            return FindMapped(term);
+        }
+        const auto it = term_to_id_.find(term);
+        return it == term_to_id_.end() ? INVALID_TERM_ID : it->second;
+    }
+
+    std::string_view GetTerm(TermId term_id) const {
+        if (IsMapped()) {
+            return { term_chars_.data() + term_offsets_[term_id], static_cast<size_t>(term_offsets_[term_id + 1] - term_offsets_[term_id]) };
+        }
+        return id_to_term_[term_id];
+    }
+
+    size_t GetTermCount() const {
+        return IsMapped() ? sorted_term_ids_.size() : id_to_term_.size();
+    }
+
+    // Ids of the terms matching a pattern where '*' stands for any sequence of characters
+    // and '?' for any one character, in no particular order. Only the terms starting with
+    // the part of the pattern before the first wildcard are compared with the pattern
+    std::vector<TermId> FindMatching(std::string_view pattern) const;
+
+    bool IsMapped() const {
+        return !term_offsets_.empty();
+    }
+
+    // Heap bytes taken by the dictionary itself, not counting the term storage
+    size_t GetMemoryUsage() const;
+
+    void Save(IndexFileWriter& writer) const;
+
+    // The terms of the dictionary point into the memory of the reader's file
+    static TermDictionary Load(IndexFileReader& reader);
+
+private:
+    std::unordered_map<std::string_view, TermId> term_to_id_;
+    std::vector<std::string_view> id_to_term_;
+
+    // Mapped format
+    StorageVector<char> term_chars_;
+    StorageVector<uint64_t> term_offsets_;    // term i is [term_offsets_[i], term_offsets_[i + 1]) in term_chars_
+    StorageVector<TermId> sorted_term_ids_;
+
+    // Front coded terms in term order. An entry is the shared prefix length and the suffix length
+    // as varints, the suffix and the term id. The first entry of a block shares nothing
+    inline static constexpr size_t BLOCK_SIZE = 16;
+    inline static constexpr size_t MIN_TAIL_SIZE = 1024;
+    std::vector<char> term_blocks_;
+    std::vector<uint32_t> block_offsets_;   // block i starts at term_blocks_[block_offsets_[i]]
+    size_t blocked_term_count_ = 0;
+    std::vector<TermId> sorted_tail_;       // terms not in the blocks yet, in runs sorted by term
+    std::vector<size_t> tail_run_ends_;     // run i of the tail ends at sorted_tail_[tail_run_ends_[i]]
+
+    TermId FindMapped(std::string_view term) const;
+
+    void AddToSortedTail(TermId term_id);
+
+    // Merges the last run of the tail into the one before it
+    void MergeLastTailRuns();
+
+    // Calls function(term_id, term) for the terms of the blocks starting with prefix, in term order
+    template <typename Function>
+    void ForEachBlockedTermWithPrefix(std::string_view prefix, Function function) const;
+
+    // Encodes the terms, which are given in term order, into the blocks
+    void BuildBlocks(const std::vector<TermId>& sorted_term_ids);
+
+    // Moves a mapped dictionary to the hash map, the terms keep pointing into the file
+    void Detach();
+};
@@ -0,0 +1,30 @@
+#include "text_arena.h"
+
+#include <cstring>
+
+std::string_view TextArena::Store(std::string_view text) {
+    if (text.empty()) {
+        return {};
+    }
+    char* data;
+    if (text.size() > chunk_size_ / 4) {
+        // A long text gets a chunk of its own, so it does not waste the rest of the current one
+        chunks_.push_back(std::unique_ptr<char[]>(new char[text.size()]));
+        allocated_bytes_ += text.size();
+        data = chunks_.back().get();
+    }
+    else {
+        if (text.size() > free_size_) {
+            chunks_.push_back(std::unique_ptr<char[]>(new char[chunk_size_]));
+            allocated_bytes_ += chunk_size_;
+            free_ = chunks_.back().get();
+            free_size_ = chunk_size_;
+        }
+        data = free_;
+        free_ += text.size();
+        free_size_ -= text.size();
+    }
+    std::memcpy(data, text.data(), text.size());
+    used_bytes_ += text.size();
+    return { data, text.size() };
+}
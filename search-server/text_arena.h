@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Append-only string storage in large chunks: one allocation serves many strings.
+// Stored strings never move, so views to them stay valid for the lifetime of the arena.
+// Memory is released only with the whole arena
+class TextArena {
+public:
+    inline static constexpr size_t DEFAULT_CHUNK_SIZE = 64 * 1024;
+
+    explicit TextArena(size_t chunk_size = DEFAULT_CHUNK_SIZE)
+        : chunk_size_(chunk_size)
+    {
+    }
+
+    // Returns the view of the stored copy of the text
+    std::string_view Store(std::string_view text);
+
+    // Bytes taken by the stored strings
+    size_t GetUsedBytes() const { return used_bytes_; }
+
+    // Bytes allocated for chunks
+    size_t GetMemoryUsage() const { return allocated_bytes_ + chunks_.capacity() * sizeof(chunks_[0]); }
+
+private:
+    size_t chunk_size_;
+    std::vector<std::unique_ptr<char[]>> chunks_;
+    char* free_ = nullptr;    // free space of the last regular chunk
+    size_t free_size_ = 0;
+    size_t used_bytes_ = 0;
+    size_t allocated_bytes_ = 0;
+};
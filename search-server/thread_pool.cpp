@@ -0,0 +1,95 @@
+#include "thread_pool.h"
+
+namespace {
+
+// Pool and queue of the worker running on this thread
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_queue = 0;
+
+} // namespace
+
+ThreadPool::ThreadPool(size_t worker_count) {
+    worker_count = std::max<size_t>(1, worker_count);
+    queues_.reserve(worker_count);
+    for (size_t i = 0; i < worker_count; ++i) {
+        queues_.push_back(std::make_unique<TaskQueue>());
+    }
+    threads_.reserve(worker_count);
+    for (size_t i = 0; i < worker_count; ++i) {
+        threads_.emplace_back([this, i] { RunWorker(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard guard(wake_mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread& thread : threads_) {
+        thread.join();
+    }
+}
+
+ThreadPool& ThreadPool::GetDefault() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::Push(Task task) {
+    const size_t queue = current_pool == this ? current_queue : next_queue_++ % queues_.size();
+    {
+        std::lock_guard guard(queues_[queue]->mutex);
+        queues_[queue]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard guard(wake_mutex_);
+        ++pending_count_;
+    }
+    wake_.notify_one();
+}
+
+bool ThreadPool::RunPendingTask() {
+    const size_t own_queue = current_queue;
+    Task task;
+    for (size_t i = 0; i < queues_.size() && !task; ++i) {
+        TaskQueue& queue = *queues_[(own_queue + i) % queues_.size()];
+        std::lock_guard guard(queue.mutex);
+        if (queue.tasks.empty()) {
+            continue;
+        }
+        // The owner takes its newest task, which is likely still in its cache; thieves take the oldest
+        if (i == 0) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+        else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+    }
+    if (!task) {
+        return false;
+    }
+    {
+        std::lock_guard guard(wake_mutex_);
+        --pending_count_;
+    }
+    task();
+    return true;
+}
+
+void ThreadPool::RunWorker(size_t index) {
+    current_pool = this;
+    current_queue = index;
+    while (true) {
+        if (RunPendingTask()) {
+            continue;
+        }
+        std::unique_lock lock(wake_mutex_);
+        wake_.wait(lock, [this] { return stopping_ || pending_count_ > 0; });
+        if (stopping_ && pending_count_ == 0) {
+            return;
+        }
+    }
+}
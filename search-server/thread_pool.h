@@ -0,0 +1,134 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent pool of worker threads with work stealing: every worker has its own task queue,
+// takes the newest task of it and steals the oldest tasks of the others when it runs dry.
+// The thread calling ParallelFor takes calls of its own loop until none is left and then waits
+// for the calls other threads have started, never running tasks of anyone else. So ParallelFor
+// may be called from a task of the same pool, and its latency does not depend on unrelated work
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t worker_count = std::max(1u, std::thread::hardware_concurrency()));
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool();
+
+    size_t GetWorkerCount() const { return threads_.size(); }
+
+    // Calls function(i) for every i in [0, count) on the workers and the calling thread, returns when
+    // all calls are done. The first exception thrown by function is rethrown, the remaining calls are skipped
+    template <typename Function>
+    void ParallelFor(size_t count, Function function) {
+        if (count == 0) {
+            return;
+        }
+        if (count == 1) {
+            function(size_t{ 0 });
+            return;
+        }
+        auto state = std::make_shared<ParallelForState<Function>>(count, std::move(function));
+        const size_t task_count = std::min(count, GetWorkerCount() + 1) - 1;   // the calling thread is one more
+        for (size_t i = 0; i < task_count; ++i) {
+            Push([state] { state->Run(); });
+        }
+        state->Run();
+        state->Wait();
+        if (state->error) {
+            std::rethrow_exception(state->error);
+        }
+    }
+
+    // Queues the task to run on a worker without waiting for it. The task must not throw.
+    // Only the workers run such tasks, a thread waiting for ParallelFor does not pick them up
+    void Submit(std::function<void()> task) {
+        Push(std::move(task));
+    }
+
+    // Pool shared by everyone who does not set up one, with a worker per hardware thread
+    static ThreadPool& GetDefault();
+
+private:
+    using Task = std::function<void()>;
+
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    // Calls are handed out one by one, so a slow call does not hold up a fixed share of the others
+    template <typename Function>
+    struct ParallelForState {
+        ParallelForState(size_t count, Function function)
+            : count(count),
+            function(std::move(function))
+        {
+        }
+
+        void Run() {
+            for (size_t i = next_index++; i < count; i = next_index++) {
+                if (!failed.load(std::memory_order_relaxed)) {
+                    try {
+                        function(i);
+                    }
+                    catch (...) {
+                        std::lock_guard guard(error_mutex);
+                        if (!error) {
+                            error = std::current_exception();
+                        }
+                        failed = true;
+                    }
+                }
+                if (done_count.fetch_add(1, std::memory_order_acq_rel) + 1 == count) {
+                    std::lock_guard guard(done_mutex);
+                    done.notify_all();
+                }
+            }
+        }
+
+        // Only calls already taken by running threads are left, so the wait always ends
+        void Wait() {
+            if (done_count.load(std::memory_order_acquire) == count) {
+                return;
+            }
+            std::unique_lock lock(done_mutex);
+            done.wait(lock, [this] { return done_count.load(std::memory_order_acquire) == count; });
+        }
+
+        const size_t count;
+        Function function;
+        std::atomic<size_t> next_index = 0;
+        std::atomic<size_t> done_count = 0;
+        std::mutex done_mutex;
+        std::condition_variable done;
+        std::atomic<bool> failed = false;
+        std::mutex error_mutex;
+        std::exception_ptr error;
+    };
+
+    std::vector<std::unique_ptr<TaskQueue>> queues_;   // one per worker
+    std::vector<std::thread> threads_;
+    std::atomic<size_t> next_queue_ = 0;   // round robin for threads outside the pool
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+    size_t pending_count_ = 0;   // tasks pushed and not taken yet, guarded by wake_mutex_
+    bool stopping_ = false;
+
+    void Push(Task task);
+
+    // Runs one task on a worker, own ones first; returns false if there was none
+    bool RunPendingTask();
+
+    void RunWorker(size_t index);
+};
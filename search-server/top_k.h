@@ -0,0 +1,81 @@
+#pragma once
+
+#include <algorithm>
+#include <optional>
+#include <utility>
+#include <vector>
+
+// Bounded selection of the k best values without sorting everything that was pushed.
+// Compare(lhs, rhs) must return true when lhs is better than rhs.
+// The heap keeps the worst retained value on top, so a rejected candidate costs one comparison.
+template <typename T, typename Compare>
+class TopK {
+public:
+    explicit TopK(size_t k, Compare compare = Compare())
+        : k_(k),
+        compare_(std::move(compare))
+    {
+        heap_.reserve(k);
+    }
+
+    // Selects only values worse than after, e.g. the k values following the ones of a previous
+    // selection, without retaining the values before them
+    TopK(size_t k, Compare compare, std::optional<T> after)
+        : TopK(k, std::move(compare))
+    {
+        after_ = std::move(after);
+    }
+
+    void Push(T value) {
+        if (after_ && !compare_(*after_, value)) {
+            return;
+        }
+        if (heap_.size() < k_) {
+            heap_.push_back(std::move(value));
+            std::push_heap(heap_.begin(), heap_.end(), compare_);
+        }
+        else if (k_ > 0 && compare_(value, heap_.front())) {
+            std::pop_heap(heap_.begin(), heap_.end(), compare_);
+            heap_.back() = std::move(value);
+            std::push_heap(heap_.begin(), heap_.end(), compare_);
+        }
+    }
+
+    // Absorbs the candidates of a partial selection, e.g. one built by another thread
+    void Merge(TopK&& other) {
+        for (T& value : other.heap_) {
+            Push(std::move(value));
+        }
+        other.heap_.clear();
+    }
+
+    // A selection of no values is never full, so GetWorst is valid whenever IsFull is true
+    bool IsFull() const {
+        return !heap_.empty() && heap_.size() >= k_;
+    }
+
+    // The value a new candidate has to beat. Requires a non-empty selection
+    const T& GetWorst() const {
+        return heap_.front();
+    }
+
+    size_t GetLimit() const {
+        return k_;
+    }
+
+    const std::optional<T>& GetAfter() const {
+        return after_;
+    }
+
+    // Returns the selected values, best first
+    std::vector<T> Extract() && {
+        std::sort_heap(heap_.begin(), heap_.end(), compare_);
+        return std::move(heap_);
+    }
+
+private:
+    size_t k_;
+    Compare compare_;
+    std::optional<T> after_;
+    std::vector<T> heap_;
+};
@@ -0,0 +1,71 @@
+#include "word_hash.h"
+
+#include <random>
+
+namespace {
+
+uint64_t RotateLeft(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+struct SipState {
+    uint64_t v0, v1, v2, v3;
+
+    void Round() {
+        v0 += v1;
+        v1 = RotateLeft(v1, 13) ^ v0;
+        v0 = RotateLeft(v0, 32);
+        v2 += v3;
+        v3 = RotateLeft(v3, 16) ^ v2;
+        v0 += v3;
+        v3 = RotateLeft(v3, 21) ^ v0;
+        v2 += v1;
+        v1 = RotateLeft(v1, 17) ^ v2;
+        v2 = RotateLeft(v2, 32);
+    }
+
+    void Compress(uint64_t message) {
+        v3 ^= message;
+        Round();
+        Round();
+        v0 ^= message;
+    }
+};
+
+// Little-endian word of up to 8 bytes
+uint64_t LoadBytes(const char* bytes, size_t count) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < count; ++i) {
+        value |= uint64_t{ static_cast<unsigned char>(bytes[i]) } << (8 * i);
+    }
+    return value;
+}
+
+} // namespace
+
+WordHashKey MakeRandomWordHashKey() {
+    std::random_device device;
+    const auto draw = [&device] {
+        return (uint64_t{ device() } << 32) ^ device();
+    };
+    WordHashKey key;
+    key.k0 = draw();
+    key.k1 = draw();
+    return key;
+}
+
+uint64_t HashWord(std::string_view word, const WordHashKey& key) {
+    SipState state{ key.k0 ^ 0x736f'6d65'7073'6575, key.k1 ^ 0x646f'7261'6e64'6f6d,
+                    key.k0 ^ 0x6c79'6765'6e65'7261, key.k1 ^ 0x7465'6462'7974'6573 };
+    const size_t tail_size = word.size() % 8;
+    const size_t body_size = word.size() - tail_size;
+    for (size_t i = 0; i < body_size; i += 8) {
+        state.Compress(LoadBytes(word.data() + i, 8));
+    }
+    state.Compress(LoadBytes(word.data() + body_size, tail_size) | (uint64_t{ word.size() } << 56));
+    state.v2 ^= 0xff;
+    for (int i = 0; i < 4; ++i) {
+        state.Round();
+    }
+    return state.v0 ^ state.v1 ^ state.v2 ^ state.v3;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+// Internal hashing of words, shared by the word set fingerprints and the MinHash signatures
+
+// Finalizer of splitmix64: spreads every input bit over the whole result
+inline uint64_t Mix(uint64_t value) {
+    value = (value ^ (value >> 30)) * 0xbf58'476d'1ce4'e5b9;
+    value = (value ^ (value >> 27)) * 0x94d0'49bb'1331'11eb;
+    return value ^ (value >> 31);
+}
+
+// 128-bit key of HashWord
+struct WordHashKey {
+    uint64_t k0 = 0;
+    uint64_t k1 = 0;
+};
+
+// Key drawn from std::random_device, so the hashes differ from process to process
+WordHashKey MakeRandomWordHashKey();
+
+// SipHash-2-4 of the word: a keyed hash whose collisions cannot be found without the key.
+// The result is the same on every platform for the same key
+uint64_t HashWord(std::string_view word, const WordHashKey& key);
@@ -0,0 +1,23 @@
+#include "word_set_fingerprint.h"
+
+#include "word_hash.h"
+
+namespace {
+
+// Keys of the two halves, drawn once per process
+const WordHashKey& GetLowKey() {
+    static const WordHashKey key = MakeRandomWordHashKey();
+    return key;
+}
+
+const WordHashKey& GetHighKey() {
+    static const WordHashKey key = MakeRandomWordHashKey();
+    return key;
+}
+
+} // namespace
+
+void WordSetFingerprint::AddWord(std::string_view word) {
+    low += HashWord(word, GetLowKey());
+    high += HashWord(word, GetHighKey());
+}
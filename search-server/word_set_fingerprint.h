@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+// 128-bit fingerprint of the set of distinct words of a document. Word hashes are summed,
+// so equal word sets give equal fingerprints whatever the word order. Words are hashed with
+// keys drawn once per process, so fingerprints are not comparable between processes and
+// colliding sets cannot be prepared in advance. Different sets may still share a fingerprint:
+// it only selects the candidates, whose words must be compared to tell a duplicate
+struct WordSetFingerprint {
+    uint64_t low = 0;
+    uint64_t high = 0;
+
+    // Every distinct word must be added once
+    void AddWord(std::string_view word);
+
+    bool operator==(const WordSetFingerprint& other) const {
+        return low == other.low && high == other.high;
+    }
+
+    bool operator!=(const WordSetFingerprint& other) const {
+        return !(*this == other);
+    }
+};
+
+struct WordSetFingerprintHash {
+    size_t operator()(const WordSetFingerprint& fingerprint) const {
+        return static_cast<size_t>(fingerprint.low ^ (fingerprint.high >> 1));
+    }
+};